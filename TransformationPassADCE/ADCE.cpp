@@ -4,22 +4,68 @@
 
 #include "llvm/Pass.h"
 #include "llvm/IR/Function.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/PostDominators.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/Transforms/Utils/UnifyFunctionExitNodes.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Local.h"
 #include "llvm/Transforms/Scalar.h"
-#include "llvm/ADT/DepthFirstIterator.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SCCIterator.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/DataLayout.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Support/CommandLine.h"
 
 #include <iostream>
-#include <set>
+#include <limits>
 #include <vector>
 
 using namespace llvm;
 
+// control-dependence mode: a branch is only live if a live instruction is
+// control dependent on it, a dead branch jumps to its nearest live
+// post-dominator instead
+static cl::opt<bool> ControlDependence(
+    "mp5-adce-control-dependence", cl::init(false), cl::Hidden,
+    cl::desc("Remove the branches no live instruction is control dependent on"));
+
+// dead-loop mode: with the control-dependence mode, the branches of a loop
+// that surely terminates are not kept live, so a loop without live
+// instructions is skipped, going from its preheader straight to its exit
+static cl::opt<bool> DeadLoops(
+    "mp5-adce-dead-loops", cl::init(false), cl::Hidden,
+    cl::desc("Remove the loops without live instructions that surely terminate "
+             "(with -mp5-adce-control-dependence)"));
+
+// cfg-cleanup mode: the blocks left unreachable are deleted, and the blocks
+// left with nothing but a jump are merged into their neighbours
+static cl::opt<bool> CFGCleanup(
+    "mp5-adce-cfg-cleanup", cl::init(false), cl::Hidden,
+    cl::desc("Delete the unreachable blocks and merge the forwarding blocks"));
+
+// dead-store mode: the stores into an alloca whose address doesn't escape
+// are only live if a live load may read them
+static cl::opt<bool> DeadStores(
+    "mp5-adce-dead-stores", cl::init(false), cl::Hidden,
+    cl::desc("Remove the stores into local allocas no live load reads"));
+
+// pure-call mode: a call to a readonly, nounwind and willreturn function is
+// dead if its result is unused. mp5-function-attrs infers these attributes
+static cl::opt<bool> PureCalls(
+    "mp5-adce-pure-calls", cl::init(false), cl::Hidden,
+    cl::desc("Remove the unused calls that only read memory and always return"));
+
 namespace {
   //===-------------------------------------------------------------------===//
   // ADCE Class
@@ -29,8 +75,36 @@ namespace {
   class ADCE : public FunctionPass {
   private:
     Function *Func;                      // Function we are working on
-    std::vector<Instruction*> WorkList;  // Instructions that just became live
-    std::set<Instruction*>    LiveSet;   // Set of live instructions
+    std::vector<unsigned>     WorkList;  // Numbers of instructions that just became live
+    BitVector                 LiveSet;   // Live instructions, by number
+    BitVector                 ReachableBBs;  // Reachable basic blocks, by number
+
+    // the instructions and the basic blocks are numbered once per function,
+    // so that the sets above are bit vectors instead of trees of pointers
+    std::vector<Instruction*> Insts;         // Instructions, by number
+    std::vector<unsigned>     BlockOfInst;   // Number of the block of each instruction
+    std::vector<BasicBlock*>  Blocks;        // Basic blocks, by number
+    DenseMap<Instruction*, unsigned> InstNumbers;
+    DenseMap<BasicBlock*, unsigned>  BlockNumbers;
+
+    // only used in the control-dependence mode
+    PostDominatorTree *PDT;
+    BitVector                 LiveBlocks;    // Blocks that have to be reached as before, by number
+    std::vector<std::pair<unsigned, unsigned> > BackEdges;  // Back edges of the depth-first search, as block numbers
+    LoopInfo *LI;                            // Only used in the dead-loop mode
+    ScalarEvolution *SE;
+    std::vector<std::vector<unsigned> > PostDomFrontier;  // Blocks each block is control dependent on
+
+    // only used in the dead-store mode. a local alloca is one whose address
+    // is only used by loads, stores into it and lifetime markers
+    struct LocalStore {
+        unsigned InstNo;                 // Number of the store
+        uint64_t Begin, End;             // Bytes of the alloca it may write
+    };
+    std::vector<unsigned>     LocalOfInst;   // 1 + index of the local alloca accessed by each instruction, or 0
+    BitVector                 LocalWrites;   // Stores and lifetime markers of the local allocas, by number
+    std::vector<std::vector<LocalStore> > StoresOfLocal;   // Stores into each local alloca
+    std::vector<std::vector<unsigned> >   MarkersOfLocal;  // Lifetime markers of each local alloca
     
     //===-----------------------------------------------------------------===//
     // The public interface for this class
@@ -46,13 +120,38 @@ namespace {
       bool Changed = doADCE();
       assert(WorkList.empty());
       LiveSet.clear();
+      ReachableBBs.clear();
+      Insts.clear();
+      BlockOfInst.clear();
+      Blocks.clear();
+      InstNumbers.clear();
+      BlockNumbers.clear();
+      LiveBlocks.clear();
+      BackEdges.clear();
+      PostDomFrontier.clear();
+      LocalOfInst.clear();
+      LocalWrites.clear();
+      StoresOfLocal.clear();
+      MarkersOfLocal.clear();
       return Changed;
     }
     
     // getAnalysisUsage
     //
+    // the control-dependence mode changes the branches, the cfg-cleanup
+    // mode the blocks
+    //
     virtual void getAnalysisUsage(AnalysisUsage &AU) const {
-      AU.setPreservesCFG();
+      if (ControlDependence) {
+        AU.addRequired<PostDominatorTreeWrapperPass>();
+      }
+      if (ControlDependence && DeadLoops) {
+        AU.addRequired<LoopInfoWrapperPass>();
+        AU.addRequired<ScalarEvolutionWrapperPass>();
+      }
+      if (!ControlDependence && !CFGCleanup) {
+        AU.setPreservesCFG();
+      }
     }
     
   private:
@@ -62,8 +161,27 @@ namespace {
     bool doADCE();
 
     // helper function
-    void markLive(Instruction *I);
+    void numberFunction();
+    void markReachable();
+    void markLive(unsigned InstNo);
+    void propagateLiveness();
     bool isTriviallyLive(Instruction *I);
+
+    // helper function of the control-dependence mode
+    void computePostDomFrontier();
+    void markBlockLive(unsigned BlockNo);
+    BasicBlock *findLivePostDominator(BasicBlock *BB);
+    bool isFiniteLoopBackEdge(BasicBlock *BB, BasicBlock *HeaderBB);
+    void redirectDeadBranch(Instruction *Term, BasicBlock *Target);
+
+    // helper function of the cfg-cleanup mode
+    bool removeUnreachableBlocks();
+    bool mergeForwardingBlocks();
+
+    // helper function of the dead-store mode
+    void findLocalAllocas();
+    bool collectLocalAccesses(AllocaInst *AI, std::vector<Instruction*> &Accesses);
+    void getAccessRange(Value *Ptr, Type *AccessTy, uint64_t &Begin, uint64_t &End);
   };
 }  // End of anonymous namespace
 
@@ -74,117 +192,271 @@ static RegisterPass<ADCE> X("mp5-adce", "Aggressive Dead Code Elimination (MP5)"
 bool ADCE::doADCE()
 {
     // LiveSet = emptySet;
-    this->LiveSet.clear();
     this->WorkList.clear();
+    this->numberFunction();
+    this->LiveSet.resize(this->Insts.size());
 
     // keep track of all the reachable basic blocks
-    std::set<BasicBlock*> ReachableBBs;
+    this->markReachable();
+
+    // in the control-dependence mode, a block is control dependent on the
+    // blocks in its post-dominance frontier
+    if (ControlDependence) {
+        this->PDT = &getAnalysis<PostDominatorTreeWrapperPass>().getPostDomTree();
+        this->LiveBlocks.resize(this->Blocks.size());
+        this->computePostDomFrontier();
+    }
+    if (ControlDependence && DeadLoops) {
+        this->LI = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+        this->SE = &getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+    }
+
+    // in the dead-store mode, the writes into the local allocas are not
+    // trivially live
+    if (DeadStores) {
+        this->findLocalAllocas();
+    }
 
-    // since all refs are dropped, keep track of dead / zero use insts to be removed
+    // since all refs are dropped, keep track of dead insts to be removed
     std::vector<Instruction*> deadInstructions;
 
     // whether any modification has been done or not
     bool changed = false;
 
-    // for (each BB in F in depth-first order)
-    //  for (each instruction I in BB)
-    //    if (isTriviallyLive(I))
-    //      markLive(I); insert I in LiveSet if I is not present in LiveSet
-    //    else if (I.use_empty()) // trivially dead
-    //      remove I from BB;
+    // for (each BB in F)
+    //  if (BB is reachable)
+    //    for (each instruction I in BB)
+    //      if (isTriviallyLive(I))
+    //        markLive(I); insert I in LiveSet if I is not present in LiveSet
+    //
+    // a trivially dead instruction (no use) is never marked live, so it is
+    // removed with the other dead instructions below
 
-    for (df_ext_iterator<BasicBlock*> BBI = df_ext_begin(&Func->front(), ReachableBBs), BBE = df_ext_end(&Func->front(), ReachableBBs); BBI != BBE; BBI++) {
-        BasicBlock *BB = *BBI;
+    for (unsigned instNo = 0; instNo != this->Insts.size(); instNo += 1) {
+        if (this->ReachableBBs[this->BlockOfInst[instNo]] && !(DeadStores && this->LocalWrites[instNo]) &&
+            this->isTriviallyLive(this->Insts[instNo])) {
+            // errs() << "Mark Alive: " << *this->Insts[instNo] << "\n";
+            this->markLive(instNo);
+        }
+    }
 
-        for (BasicBlock::iterator II = BB->begin(), EI = BB->end(); II != EI; II++) {
-            Instruction *I = &(*II);
+    // removing the branch of a loop could make an infinite loop finite. in
+    // the dead-loop mode, a loop that surely terminates may be removed
+    for (std::pair<unsigned, unsigned> &backEdge : this->BackEdges) {
+        BasicBlock *BB = this->Blocks[backEdge.first];
+        if (!DeadLoops || !this->isFiniteLoopBackEdge(BB, this->Blocks[backEdge.second])) {
+            this->markLive(this->InstNumbers[BB->getTerminator()]);
+        }
+    }
+
+    this->propagateLiveness();
+
+    // in the control-dependence mode, a dead branch jumps to its nearest
+    // live post-dominator. the blocks in between have no live instruction.
+    // a branch without such a post-dominator becomes live, which may make
+    // other branches live, so this is repeated until no branch is added
+    //
+    // for (each reachable BB with a dead branch)
+    //   if (BB has no live post-dominator)
+    //     markLive(branch of BB);
+
+    std::vector<std::pair<Instruction*, BasicBlock*> > deadBranches;
+
+    bool branchAdded = ControlDependence;
+    while (branchAdded) {
+        branchAdded = false;
+        deadBranches.clear();
 
-            if (this->isTriviallyLive(I)) {
-                // errs() << "Mark Alive: " << *I << "\n";
-                this->markLive(I);
-            }else if (I->use_empty()) {
-                // add to the dead instruction vector
-                // errs() << "Push Zero: " << *I << "\n";
-                deadInstructions.push_back(I);
+        for (unsigned blockNo = 0; blockNo != this->Blocks.size(); blockNo += 1) {
+            Instruction *term = this->Blocks[blockNo]->getTerminator();
+            unsigned termNo = this->InstNumbers[term];
+            if (!this->ReachableBBs[blockNo] || this->LiveSet[termNo]) {
+                continue;
             }
+
+            // an unconditional branch to the live post-dominator stays as it is
+            BasicBlock *target = this->findLivePostDominator(this->Blocks[blockNo]);
+            if (target == NULL) {
+                this->markLive(termNo);
+                branchAdded = true;
+            } else if (term->getNumSuccessors() == 1 && term->getSuccessor(0) == target) {
+                this->LiveSet.set(termNo);
+            } else {
+                deadBranches.push_back(std::make_pair(term, target));
+            }
+        }
+
+        this->propagateLiveness();
+    }
+
+    for (std::pair<Instruction*, BasicBlock*> &deadBranch : deadBranches) {
+        // errs() << "Redirect: " << *deadBranch.first << "\n";
+        this->redirectDeadBranch(deadBranch.first, deadBranch.second);
+        changed = true;
+    }
+
+    // for (each BB in F in any order)
+    //  if (BB is reachable)
+    //    for (each non-live instruction I in BB)
+    //      I.dropAllReferences();
+
+    for (unsigned instNo = 0; instNo != this->Insts.size(); instNo += 1) {
+        if (this->ReachableBBs[this->BlockOfInst[instNo]] && !this->LiveSet[instNo]) {
+            Instruction *I = this->Insts[instNo];
+            // errs() << "Push Dead: " << *I << "\n";
+            I->dropAllReferences();
+            deadInstructions.push_back(I);
         }
     }
 
+    // for (each BB in F in any order)
+    //  if (BB is reachable)
+    //    for (each non-live instruction I in BB)
+    //      erase I from BB;
+
     for(Instruction *deadI : deadInstructions){
-        // errs() << "Erase Zero: " << *deadI << "\n";
+        // errs() << "Erase Dead: " << *deadI << "\n";
         deadI->eraseFromParent();
         changed = true;
     }
 
-    // clear out for other dead instructions
-    deadInstructions.clear();
+    // in the cfg-cleanup mode, the blocks that were never reached or are
+    // bypassed by a dead branch now are deleted. then the blocks that only
+    // jump to another one are removed
+    if (CFGCleanup) {
+        changed = this->removeUnreachableBlocks() || changed;
+        changed = this->mergeForwardingBlocks() || changed;
+    }
+
+    return changed;
+}
+
+
+void ADCE::numberFunction(){
+    // number the basic blocks and the instructions in the function order,
+    // the instructions of a block get consecutive numbers
+
+    for (Function::iterator BBI = Func->begin(), BBE = Func->end(); BBI != BBE; BBI++) {
+        BasicBlock *BB = &(*BBI);
+        unsigned blockNo = this->Blocks.size();
+        this->BlockNumbers[BB] = blockNo;
+        this->Blocks.push_back(BB);
+
+        for (BasicBlock::iterator II = BB->begin(), EI = BB->end(); II != EI; II++) {
+            Instruction *I = &(*II);
+            this->InstNumbers[I] = this->Insts.size();
+            this->Insts.push_back(I);
+            this->BlockOfInst.push_back(blockNo);
+        }
+    }
+}
+
+
+void ADCE::markReachable(){
+    // depth-first search from the entry block, the path is kept as pairs of
+    // a block number and the index of its next successor. an edge back to a
+    // block on the path closes a loop
+
+    this->ReachableBBs.resize(this->Blocks.size());
+    BitVector onPath(this->Blocks.size());
+
+    std::vector<std::pair<unsigned, unsigned> > blockStack;
+    this->ReachableBBs.set(0);
+    onPath.set(0);
+    blockStack.push_back(std::make_pair(0u, 0u));
+
+    while (!blockStack.empty()) {
+        unsigned blockNo = blockStack.back().first;
+        Instruction *term = this->Blocks[blockNo]->getTerminator();
+
+        if (blockStack.back().second == term->getNumSuccessors()) {
+            onPath.reset(blockNo);
+            blockStack.pop_back();
+            continue;
+        }
+
+        unsigned succNo = this->BlockNumbers[term->getSuccessor(blockStack.back().second)];
+        blockStack.back().second += 1;
+
+        if (!this->ReachableBBs[succNo]) {
+            this->ReachableBBs.set(succNo);
+            onPath.set(succNo);
+            blockStack.push_back(std::make_pair(succNo, 0u));
+        } else if (ControlDependence && onPath[succNo]) {
+            this->BackEdges.push_back(std::make_pair(blockNo, succNo));
+        }
+    }
+}
+
 
+void ADCE::propagateLiveness(){
     // while (WorkList is not empty) {
     //  I = get instruction at head of work list;
     //  if (basic block containing I is reachable)
     //    for (all operands op of I)
     //      if (operand op is an instruction)
     //        markLive(op, LiveSet, WorkList);
+    //
+    // in the control-dependence mode, the block of I is marked live too,
+    // and so are the predecessors of a phi, whose value depends on the
+    // edge taken
+    //
+    // in the dead-store mode, a live load of a local alloca makes live the
+    // stores that may write the bytes it reads, and a live local alloca
+    // makes its lifetime markers live
 
     while (!this->WorkList.empty()) {
-        Instruction *I = this->WorkList.back();
+        unsigned instNo = this->WorkList.back();
         this->WorkList.pop_back();
 
-        if(ReachableBBs.count(I->getParent()) > 0){
+        if (this->ReachableBBs[this->BlockOfInst[instNo]]) {
+            Instruction *I = this->Insts[instNo];
             for (unsigned opIdx = 0; opIdx != I->getNumOperands(); opIdx += 1){
                 if (Instruction *operandI = dyn_cast<Instruction>(I->getOperand(opIdx))){
                     // errs() << "Propagated: " << *operandI << "\n";
-                    this->markLive(operandI);
+                    this->markLive(this->InstNumbers[operandI]);
                 }
             }
-        }
-    }
-
-    // for (each BB in F in any order)
-    //  if (BB is reachable)
-    //    for (each non-live instruction I in BB)
-    //      I.dropAllReferences();
-
-    for (Function::iterator BBI = Func->begin(), BBE = Func->end(); BBI != BBE; BBI++) {
-        BasicBlock *BB = &(*BBI);
 
-        if(ReachableBBs.count(BB) > 0) {
-            for (BasicBlock::iterator II = BB->begin(), EI = BB->end(); II != EI; II++) {
-                Instruction *I = &(*II);
+            if (ControlDependence) {
+                this->markBlockLive(this->BlockOfInst[instNo]);
+                if (PHINode *phiI = dyn_cast<PHINode>(I)) {
+                    for (BasicBlock *predBB : phiI->blocks()) {
+                        this->markBlockLive(this->BlockNumbers[predBB]);
+                    }
+                }
+            }
 
-                if(this->LiveSet.count(I) == 0){
-                    // errs() << "Push Dead: " << *I << "\n";
-                    I->dropAllReferences();
-                    deadInstructions.push_back(I);
+            if (DeadStores && this->LocalOfInst[instNo] != 0) {
+                unsigned localNo = this->LocalOfInst[instNo] - 1;
+                if (LoadInst *loadI = dyn_cast<LoadInst>(I)) {
+                    uint64_t begin, end;
+                    this->getAccessRange(loadI->getPointerOperand(), loadI->getType(), begin, end);
+                    for (LocalStore &store : this->StoresOfLocal[localNo]) {
+                        if (store.Begin < end && begin < store.End) {
+                            this->markLive(store.InstNo);
+                        }
+                    }
+                } else if (isa<AllocaInst>(I)) {
+                    for (unsigned markerNo : this->MarkersOfLocal[localNo]) {
+                        this->markLive(markerNo);
+                    }
                 }
             }
         }
     }
-
-    // for (each BB in F in any order)
-    //  if (BB is reachable)
-    //    for (each non-live instruction I in BB)
-    //      erase I from BB;
-
-    for(Instruction *deadI : deadInstructions){
-        // errs() << "Erase Dead: " << *deadI << "\n";
-        deadI->eraseFromParent();
-        changed = true;
-    }
-
-    return changed;
 }
 
 
-void ADCE::markLive(Instruction *I){
+void ADCE::markLive(unsigned InstNo){
     // markLive()
     //  if I is not in LiveSet
     //    insert I in LiveSet
     //    append I at the end of WorkList
 
-    if(this->LiveSet.count(I) == 0){
-        this->LiveSet.insert(I);
-        this->WorkList.push_back(I);
+    if(!this->LiveSet[InstNo]){
+        this->LiveSet.set(InstNo);
+        this->WorkList.push_back(InstNo);
     }
 }
 
@@ -195,9 +467,10 @@ bool ADCE::isTriviallyLive(Instruction *I){
         return true;
     }
 
-    // is a terminator instruction: ret or unwind
+    // is a terminator instruction: ret or unwind. in the control-dependence
+    // mode, a branch is only live if a live instruction depends on it
     if(I->isTerminator()){
-        return true;
+        return !ControlDependence || !(isa<BranchInst>(I) || isa<SwitchInst>(I));
     }
 
     // may write to memory
@@ -213,10 +486,1060 @@ bool ADCE::isTriviallyLive(Instruction *I){
     }
 
     // store, call, free <- unknown
-    if(isa<StoreInst>(I) || isa<CallInst>(I)){
+    if(isa<StoreInst>(I)){
         return true;
     }
 
+    // in the pure-call mode, a call that can't write memory, throw or run
+    // forever is only live if its result is used. the debug intrinsics and
+    // inline assembly are kept
+    if (CallInst *callI = dyn_cast<CallInst>(I)){
+        return !PureCalls || isa<DbgInfoIntrinsic>(callI) || callI->isInlineAsm() ||
+               !callI->onlyReadsMemory() || !callI->doesNotThrow() || !callI->willReturn();
+    }
+
     // not a trivially alive instruction
     return false;
 }
+
+
+void ADCE::computePostDomFrontier(){
+    // a block B is in the post-dominance frontier of every block on the
+    // post-dominator tree path from a successor of B up to (not including)
+    // the immediate post-dominator of B
+
+    this->PostDomFrontier.resize(this->Blocks.size());
+
+    for (unsigned blockNo = 0; blockNo != this->Blocks.size(); blockNo += 1) {
+        BasicBlock *BB = this->Blocks[blockNo];
+        DomTreeNode *node = this->PDT->getNode(BB);
+        if (!this->ReachableBBs[blockNo] || node == NULL || BB->getTerminator()->getNumSuccessors() < 2) {
+            continue;
+        }
+
+        DomTreeNode *ipdomNode = node->getIDom();
+
+        for (BasicBlock *succBB : successors(BB)) {
+            DomTreeNode *runner = this->PDT->getNode(succBB);
+            while (runner != NULL && runner != ipdomNode && runner->getBlock() != NULL) {
+                std::vector<unsigned> &frontier = this->PostDomFrontier[this->BlockNumbers[runner->getBlock()]];
+                if (frontier.empty() || frontier.back() != blockNo) {
+                    frontier.push_back(blockNo);
+                }
+                runner = runner->getIDom();
+            }
+        }
+    }
+}
+
+
+void ADCE::markBlockLive(unsigned BlockNo){
+    // markBlockLive()
+    //  if BB is not live
+    //    mark BB live
+    //    for (each block C that BB is control dependent on)
+    //      markLive(branch of C)
+
+    if(!this->LiveBlocks[BlockNo]){
+        this->LiveBlocks.set(BlockNo);
+        for (unsigned controlBlockNo : this->PostDomFrontier[BlockNo]) {
+            this->markLive(this->InstNumbers[this->Blocks[controlBlockNo]->getTerminator()]);
+        }
+    }
+}
+
+
+BasicBlock *ADCE::findLivePostDominator(BasicBlock *BB){
+    // walk up the post-dominator tree to the first live block. the edge to
+    // it can't be added if it would need a new incoming value of a live phi
+
+    DomTreeNode *node = this->PDT->getNode(BB);
+    if (node == NULL) {
+        return NULL;
+    }
+
+    for (node = node->getIDom(); node != NULL && node->getBlock() != NULL; node = node->getIDom()) {
+        BasicBlock *pdomBB = node->getBlock();
+        if (!this->LiveBlocks[this->BlockNumbers[pdomBB]]) {
+            continue;
+        }
+
+        bool isSuccessor = false;
+        for (BasicBlock *succBB : successors(BB)) {
+            isSuccessor = isSuccessor || (succBB == pdomBB);
+        }
+        for (PHINode &phiI : pdomBB->phis()) {
+            if (!isSuccessor && this->LiveSet[this->InstNumbers[&phiI]]) {
+                return NULL;
+            }
+        }
+        return pdomBB;
+    }
+
+    return NULL;
+}
+
+
+bool ADCE::isFiniteLoopBackEdge(BasicBlock *BB, BasicBlock *HeaderBB){
+    // the edge must close a natural loop, whose number of iterations has a
+    // bound known to scalar evolution. an irreducible cycle isn't a loop
+
+    Loop *L = this->LI->getLoopFor(HeaderBB);
+    if (L == NULL || L->getHeader() != HeaderBB || !L->contains(BB)) {
+        return false;
+    }
+
+    return !isa<SCEVCouldNotCompute>(this->SE->getConstantMaxBackedgeTakenCount(L));
+}
+
+
+void ADCE::redirectDeadBranch(Instruction *Term, BasicBlock *Target){
+    // keep one edge to Target, the other successors lose BB as predecessor.
+    // the phis with one incoming value left are kept, since they are
+    // numbered and may be live
+
+    BasicBlock *BB = Term->getParent();
+    bool keptEdge = false;
+
+    for (unsigned succIdx = 0; succIdx != Term->getNumSuccessors(); succIdx += 1) {
+        BasicBlock *succBB = Term->getSuccessor(succIdx);
+        if (succBB == Target && !keptEdge) {
+            keptEdge = true;
+        } else {
+            succBB->removePredecessor(BB, /*KeepOneInputPHIs=*/true);
+        }
+    }
+
+    // the dead terminator is erased with the other dead instructions
+    BranchInst::Create(Target, Term);
+}
+
+
+bool ADCE::removeUnreachableBlocks(){
+    // the dead branches have been redirected, so the reachable blocks are
+    // searched again. the blocks themselves are still the numbered ones
+
+    this->ReachableBBs.reset();
+    this->BackEdges.clear();
+    this->markReachable();
+
+    std::vector<BasicBlock*> deadBlocks;
+    for (unsigned blockNo = 0; blockNo != this->Blocks.size(); blockNo += 1) {
+        if (!this->ReachableBBs[blockNo]) {
+            deadBlocks.push_back(this->Blocks[blockNo]);
+        }
+    }
+
+    if (deadBlocks.empty()) {
+        return false;
+    }
+
+    // the predecessors of an unreachable block are unreachable too, so only
+    // the phis of the reachable successors lose incoming values
+    // errs() << "Delete Blocks: " << deadBlocks.size() << "\n";
+    DeleteDeadBlocks(deadBlocks);
+    return true;
+}
+
+
+bool ADCE::mergeForwardingBlocks(){
+    // for (each BB in F except the entry)
+    //   if (BB has a single predecessor, which only jumps to BB)
+    //     move BB to the end of its predecessor;
+    //   else if (BB has nothing but phis and a jump)
+    //     make the predecessors of BB jump to its successor;
+    // repeat until no block is removed
+
+    bool changed = false;
+    bool mergedOne = true;
+
+    while (mergedOne) {
+        mergedOne = false;
+
+        for (Function::iterator BBI = Func->begin(), BBE = Func->end(); BBI != BBE;) {
+            BasicBlock *BB = &(*BBI);
+            BBI++;
+
+            if (BB == &Func->getEntryBlock()) {
+                continue;
+            }
+
+            if (MergeBlockIntoPredecessor(BB)) {
+                mergedOne = true;
+                continue;
+            }
+
+            BranchInst *brI = dyn_cast<BranchInst>(BB->getTerminator());
+            if (brI != NULL && brI->isUnconditional() && brI->getSuccessor(0) != BB &&
+                BB->getFirstNonPHIOrDbg()->isTerminator() && TryToSimplifyUncondBranchFromEmptyBlock(BB)) {
+                mergedOne = true;
+            }
+        }
+
+        changed = changed || mergedOne;
+    }
+
+    return changed;
+}
+
+
+void ADCE::findLocalAllocas(){
+    // number the local allocas and record their stores with the bytes they
+    // write, their loads and their lifetime markers
+
+    this->LocalOfInst.assign(this->Insts.size(), 0);
+    this->LocalWrites.resize(this->Insts.size());
+
+    std::vector<Instruction*> accesses;
+
+    for (unsigned instNo = 0; instNo != this->Insts.size(); instNo += 1) {
+        AllocaInst *allocaI = dyn_cast<AllocaInst>(this->Insts[instNo]);
+        accesses.clear();
+        if (allocaI == NULL || !this->collectLocalAccesses(allocaI, accesses)) {
+            continue;
+        }
+
+        unsigned localNo = this->StoresOfLocal.size();
+        this->StoresOfLocal.push_back(std::vector<LocalStore>());
+        this->MarkersOfLocal.push_back(std::vector<unsigned>());
+        this->LocalOfInst[instNo] = localNo + 1;
+
+        for (Instruction *accessI : accesses) {
+            unsigned accessNo = this->InstNumbers[accessI];
+            this->LocalOfInst[accessNo] = localNo + 1;
+
+            if (StoreInst *storeI = dyn_cast<StoreInst>(accessI)) {
+                LocalStore store;
+                store.InstNo = accessNo;
+                this->getAccessRange(storeI->getPointerOperand(), storeI->getValueOperand()->getType(),
+                                     store.Begin, store.End);
+                this->StoresOfLocal[localNo].push_back(store);
+                this->LocalWrites.set(accessNo);
+            } else if (isa<IntrinsicInst>(accessI)) {
+                this->MarkersOfLocal[localNo].push_back(accessNo);
+                this->LocalWrites.set(accessNo);
+            }
+        }
+    }
+}
+
+
+bool ADCE::collectLocalAccesses(AllocaInst *AI, std::vector<Instruction*> &Accesses){
+    // follow the address through bitcasts and getelementptrs. it must only
+    // be loaded from, stored into (not stored itself) or given to a lifetime
+    // marker, and never by a volatile or atomic access
+
+    std::vector<Instruction*> ptrWorkList;
+    ptrWorkList.push_back(AI);
+
+    while (!ptrWorkList.empty()) {
+        Instruction *ptrI = ptrWorkList.back();
+        ptrWorkList.pop_back();
+
+        for (User *U : ptrI->users()) {
+            Instruction *userI = cast<Instruction>(U);
+
+            if (isa<BitCastInst>(userI) || isa<GetElementPtrInst>(userI)) {
+                ptrWorkList.push_back(userI);
+            } else if (LoadInst *loadI = dyn_cast<LoadInst>(userI)) {
+                if (!loadI->isSimple()) {
+                    return false;
+                }
+                Accesses.push_back(loadI);
+            } else if (StoreInst *storeI = dyn_cast<StoreInst>(userI)) {
+                if (!storeI->isSimple() || storeI->getValueOperand() == ptrI) {
+                    return false;
+                }
+                Accesses.push_back(storeI);
+            } else if (IntrinsicInst *intrinsicI = dyn_cast<IntrinsicInst>(userI)) {
+                if (intrinsicI->getIntrinsicID() != Intrinsic::lifetime_start &&
+                    intrinsicI->getIntrinsicID() != Intrinsic::lifetime_end) {
+                    return false;
+                }
+                Accesses.push_back(intrinsicI);
+            } else {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+void ADCE::getAccessRange(Value *Ptr, Type *AccessTy, uint64_t &Begin, uint64_t &End){
+    // the bytes of the alloca accessed through Ptr: the constant offsets of
+    // the getelementptrs are added up. a variable index, or an access that
+    // isn't inside the alloca, may touch any byte
+
+    const DataLayout &DL = Func->getParent()->getDataLayout();
+    int64_t offset = 0;
+    bool offsetKnown = true;
+
+    while (!isa<AllocaInst>(Ptr)) {
+        if (GEPOperator *gepO = dyn_cast<GEPOperator>(Ptr)) {
+            APInt gepOffset(DL.getIndexTypeSizeInBits(gepO->getType()), 0);
+            if (offsetKnown && gepO->accumulateConstantOffset(DL, gepOffset)) {
+                offset += gepOffset.getSExtValue();
+            } else {
+                offsetKnown = false;
+            }
+        }
+        Ptr = cast<Operator>(Ptr)->getOperand(0);
+    }
+
+    AllocaInst *allocaI = cast<AllocaInst>(Ptr);
+    ConstantInt *arraySize = dyn_cast<ConstantInt>(allocaI->getArraySize());
+    uint64_t accessSize = DL.getTypeStoreSize(AccessTy);
+
+    if (offsetKnown && arraySize != NULL && offset >= 0 &&
+        (uint64_t)offset + accessSize <= DL.getTypeAllocSize(allocaI->getAllocatedType()) * arraySize->getZExtValue()) {
+        Begin = offset;
+        End = offset + accessSize;
+    } else {
+        Begin = 0;
+        End = std::numeric_limits<uint64_t>::max();
+    }
+}
+
+
+namespace {
+  //===-------------------------------------------------------------------===//
+  // FunctionAttrsInference Class
+  //
+  // This class infers readnone/readonly, nounwind and willreturn for the
+  // functions defined in the module, so that ADCE can remove the unused
+  // calls of them in the pure-call mode.
+  //
+  class FunctionAttrsInference : public ModulePass {
+    //===-----------------------------------------------------------------===//
+    // The public interface for this class
+    //
+  public:
+    static char ID; // Pass identification
+    FunctionAttrsInference() : ModulePass(ID) {}
+
+    // Visit the strongly connected components of the call graph bottom-up,
+    // so that the callees have their attributes before their callers
+    //
+    virtual bool runOnModule(Module &M);
+
+    // getAnalysisUsage
+    //
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.addRequired<CallGraphWrapperPass>();
+      AU.setPreservesCFG();
+    }
+
+  private:
+    // how a function may access the memory its callers can see
+    enum MemoryBehavior { ReadsNone = 0, ReadsOnly = 1, WritesAny = 2 };
+
+    // helper function
+    bool inferSCCAttrs(const std::vector<Function*> &SCC);
+    bool isLocalMemory(Value *Ptr);
+  };
+}  // End of anonymous namespace
+
+char FunctionAttrsInference::ID = 0;
+static RegisterPass<FunctionAttrsInference> Y("mp5-function-attrs", "Function Attribute Inference for ADCE (MP5)", true /* Only looks at CFG? */, false /* Analysis Pass? */);
+
+
+bool FunctionAttrsInference::runOnModule(Module &M)
+{
+    CallGraph &CG = getAnalysis<CallGraphWrapperPass>().getCallGraph();
+    bool changed = false;
+
+    // for (each SCC of the call graph, callees first)
+    //   if (every function of the SCC is defined here)
+    //     infer the attributes of the whole SCC;
+    //
+    // the external nodes of the call graph have no function
+
+    for (scc_iterator<CallGraph*> SCCI = scc_begin(&CG); !SCCI.isAtEnd(); ++SCCI) {
+        std::vector<Function*> functions;
+        bool allDefined = true;
+
+        for (CallGraphNode *node : *SCCI) {
+            Function *F = node->getFunction();
+            if (F == NULL) {
+                continue;
+            }
+            if (!F->hasExactDefinition()) {
+                allDefined = false;
+            }
+            functions.push_back(F);
+        }
+
+        if (allDefined && !functions.empty()) {
+            changed = this->inferSCCAttrs(functions) || changed;
+        }
+    }
+
+    return changed;
+}
+
+
+bool FunctionAttrsInference::inferSCCAttrs(const std::vector<Function*> &SCC)
+{
+    // the calls inside the SCC are assumed to have the attributes being
+    // inferred, which holds once all the functions of the SCC have them.
+    // the loads and stores of the function's own allocas aren't visible to
+    // its callers. a function only surely returns if it has no loop and
+    // doesn't call itself. the debug intrinsics and the lifetime markers
+    // of the allocas are ignored
+
+    SmallPtrSet<Function*, 8> inSCC(SCC.begin(), SCC.end());
+    MemoryBehavior memory = ReadsNone;
+    bool noUnwind = true;
+    bool willReturn = true;
+
+    for (Function *F : SCC) {
+        if (F->doesNotReturn()) {
+            willReturn = false;
+        }
+
+        for (scc_iterator<Function*> blockSCCI = scc_begin(F); !blockSCCI.isAtEnd(); ++blockSCCI) {
+            if (blockSCCI.hasCycle()) {
+                willReturn = false;
+            }
+        }
+
+        for (BasicBlock &BB : *F) {
+            for (Instruction &I : BB) {
+                if (CallBase *callI = dyn_cast<CallBase>(&I)) {
+                    Function *callee = callI->getCalledFunction();
+                    if (callee != NULL && inSCC.count(callee) > 0) {
+                        willReturn = false;
+                        continue;
+                    }
+                    IntrinsicInst *intrinsicI = dyn_cast<IntrinsicInst>(callI);
+                    if (isa<DbgInfoIntrinsic>(callI) || (intrinsicI != NULL && intrinsicI->isLifetimeStartOrEnd())) {
+                        continue;
+                    }
+
+                    if (!callI->onlyReadsMemory()) {
+                        memory = WritesAny;
+                    } else if (!callI->doesNotAccessMemory() && memory == ReadsNone) {
+                        memory = ReadsOnly;
+                    }
+                    noUnwind = noUnwind && callI->doesNotThrow();
+                    willReturn = willReturn && callI->willReturn();
+                } else if (LoadInst *loadI = dyn_cast<LoadInst>(&I)) {
+                    if (!loadI->isUnordered()) {
+                        memory = WritesAny;
+                    } else if (!this->isLocalMemory(loadI->getPointerOperand()) && memory == ReadsNone) {
+                        memory = ReadsOnly;
+                    }
+                } else if (StoreInst *storeI = dyn_cast<StoreInst>(&I)) {
+                    if (!storeI->isUnordered() || !this->isLocalMemory(storeI->getPointerOperand())) {
+                        memory = WritesAny;
+                    }
+                } else if (I.mayReadOrWriteMemory()) {
+                    // atomics, fences, va_arg
+                    memory = WritesAny;
+                }
+
+                if (!isa<CallBase>(&I) && I.mayThrow()) {
+                    noUnwind = false;
+                }
+            }
+        }
+    }
+
+    // for (each function F of the SCC)
+    //   add the attributes F doesn't have yet;
+
+    bool changed = false;
+
+    for (Function *F : SCC) {
+        if (memory == ReadsNone && !F->doesNotAccessMemory()) {
+            F->setDoesNotAccessMemory();
+            changed = true;
+        } else if (memory == ReadsOnly && !F->onlyReadsMemory()) {
+            F->setOnlyReadsMemory();
+            changed = true;
+        }
+        if (noUnwind && !F->doesNotThrow()) {
+            F->setDoesNotThrow();
+            changed = true;
+        }
+        if (willReturn && !F->willReturn()) {
+            F->addFnAttr(Attribute::WillReturn);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+
+bool FunctionAttrsInference::isLocalMemory(Value *Ptr)
+{
+    // the memory of an alloca of the function itself
+    return isa<AllocaInst>(getUnderlyingObject(Ptr));
+}
+
+
+namespace {
+  //===-------------------------------------------------------------------===//
+  // InterproceduralDCE Class
+  //
+  // This class runs the liveness of ADCE over the whole module. The
+  // arguments and the returned value of an internal function that is only
+  // called directly are only live if a live instruction uses them, so the
+  // dead ones are dropped from the function and from its calls. The
+  // internal functions and globals that nothing live uses are deleted.
+  //
+  class InterproceduralDCE : public ModulePass {
+  private:
+    struct FunctionInfo {
+        Function *F;
+        unsigned FirstArg;                  // Number of the first argument
+        bool Rewritable;                    // Internal and only called directly
+        bool ReturnLive;                    // Some live instruction uses the returned value
+        std::vector<CallInst*>   CallSites; // The calls of a rewritable function
+        std::vector<ReturnInst*> Returns;   // The returns of a rewritable function
+    };
+
+    std::vector<FunctionInfo>        Functions;       // Defined functions, by number
+    DenseMap<Function*, unsigned>    FunctionNumbers;
+    std::vector<Instruction*>        Insts;           // Instructions of the defined functions, by number
+    std::vector<unsigned>            FunctionOfInst;  // Number of the function of each instruction
+    DenseMap<Instruction*, unsigned> InstNumbers;
+    std::vector<unsigned>            FunctionOfArg;   // Number of the function of each argument
+
+    BitVector                 LiveSet;         // Live instructions, by number
+    BitVector                 LiveArgs;        // Live arguments, by number
+    SmallPtrSet<GlobalValue*, 32> LiveGlobals; // Live functions and global variables
+    SmallPtrSet<Constant*, 32>    VisitedConstants;
+
+    std::vector<unsigned>     WorkList;        // Numbers of instructions that just became live
+    std::vector<unsigned>     ArgWorkList;     // Numbers of arguments that just became live
+    std::vector<unsigned>     ReturnWorkList;  // Numbers of functions whose returned value just became live
+    std::vector<GlobalValue*> GlobalWorkList;  // Globals that just became live
+
+    //===-----------------------------------------------------------------===//
+    // The public interface for this class
+    //
+  public:
+    static char ID; // Pass identification
+    InterproceduralDCE() : ModulePass(ID) {}
+
+    // Execute the interprocedural dead code elimination on the module
+    //
+    virtual bool runOnModule(Module &M);
+
+  private:
+    // helper function
+    void numberModule(Module &M);
+    bool isRewritable(Function &F);
+    bool isTriviallyLive(Instruction *I);
+    void propagateLiveness();
+    void markLive(unsigned InstNo);
+    void markValueLive(Value *V);
+    void markArgLive(unsigned ArgNo);
+    void markReturnLive(unsigned FuncNo);
+    void markGlobalLive(GlobalValue *GV);
+    void markConstantLive(Constant *C);
+    void rewriteFunction(FunctionInfo &Info);
+  };
+}  // End of anonymous namespace
+
+char InterproceduralDCE::ID = 0;
+static RegisterPass<InterproceduralDCE> Z("mp5-ipo-adce", "Interprocedural Dead Code Elimination (MP5)", false /* Only looks at CFG? */, false /* Analysis Pass? */);
+
+
+bool InterproceduralDCE::runOnModule(Module &M)
+{
+    this->numberModule(M);
+    this->LiveSet.resize(this->Insts.size());
+    this->LiveArgs.resize(this->FunctionOfArg.size());
+
+    // the globals visible outside of the module are live, so are the ones
+    // in a comdat, which is kept or dropped as a whole. an alias is kept
+    // with what it aliases
+
+    for (GlobalValue &GV : M.global_values()) {
+        if (!GV.hasLocalLinkage() || GV.hasComdat() || isa<GlobalAlias>(&GV) || isa<GlobalIFunc>(&GV)) {
+            this->markGlobalLive(&GV);
+        }
+    }
+
+    // the arguments whose attributes tie them to the call are kept
+
+    for (FunctionInfo &info : this->Functions) {
+        if (!info.Rewritable) {
+            continue;
+        }
+        for (Argument &A : info.F->args()) {
+            if (A.hasAttribute(Attribute::Returned) || A.hasInAllocaAttr() || A.hasPreallocatedAttr() ||
+                A.hasSwiftErrorAttr() || A.hasNestAttr() || A.hasAttribute(Attribute::SwiftSelf)) {
+                this->markArgLive(info.FirstArg + A.getArgNo());
+            }
+        }
+    }
+
+    this->propagateLiveness();
+
+    // the dead globals are found before the live functions are replaced
+
+    BitVector liveFunctions(this->Functions.size());
+    for (unsigned funcNo = 0; funcNo != this->Functions.size(); funcNo += 1) {
+        if (this->LiveGlobals.count(this->Functions[funcNo].F) > 0) {
+            liveFunctions.set(funcNo);
+        }
+    }
+
+    std::vector<GlobalValue*> deadGlobals;
+    for (GlobalValue &GV : M.global_values()) {
+        if (this->LiveGlobals.count(&GV) == 0) {
+            deadGlobals.push_back(&GV);
+        }
+    }
+
+    bool changed = false;
+
+    // for (each live rewritable function F)
+    //   if (F has a dead argument or a dead returned value)
+    //     drop them from F and from every call of F;
+
+    for (unsigned funcNo = 0; funcNo != this->Functions.size(); funcNo += 1) {
+        FunctionInfo &info = this->Functions[funcNo];
+        if (!info.Rewritable || !liveFunctions[funcNo]) {
+            continue;
+        }
+
+        bool hasDeadArg = false;
+        for (unsigned argIdx = 0; argIdx != info.F->arg_size(); argIdx += 1) {
+            hasDeadArg = hasDeadArg || !this->LiveArgs[info.FirstArg + argIdx];
+        }
+        bool hasDeadReturn = !info.F->getReturnType()->isVoidTy() && !info.ReturnLive;
+
+        if (hasDeadArg || hasDeadReturn) {
+            // errs() << "Rewrite: " << info.F->getName() << "\n";
+            this->rewriteFunction(info);
+            changed = true;
+        }
+    }
+
+    // for (each live function F)
+    //   for (each non-live instruction I in F)
+    //     I.dropAllReferences();
+    //     erase I from F;
+    //
+    // the replaced calls and returns were live, so they are never looked at
+
+    std::vector<Instruction*> deadInstructions;
+    for (unsigned instNo = 0; instNo != this->Insts.size(); instNo += 1) {
+        if (liveFunctions[this->FunctionOfInst[instNo]] && !this->LiveSet[instNo]) {
+            this->Insts[instNo]->dropAllReferences();
+            deadInstructions.push_back(this->Insts[instNo]);
+        }
+    }
+
+    for (Instruction *deadI : deadInstructions) {
+        deadI->eraseFromParent();
+        changed = true;
+    }
+
+    // for (each dead global GV)
+    //   drop the body or the initializer of GV;
+    // for (each dead global GV)
+    //   erase GV from the module;
+
+    for (GlobalValue *deadGV : deadGlobals) {
+        // errs() << "Delete Global: " << deadGV->getName() << "\n";
+        if (Function *F = dyn_cast<Function>(deadGV)) {
+            F->deleteBody();
+        } else {
+            cast<GlobalVariable>(deadGV)->setInitializer(NULL);
+        }
+    }
+
+    for (GlobalValue *deadGV : deadGlobals) {
+        deadGV->removeDeadConstantUsers();
+        deadGV->eraseFromParent();
+        changed = true;
+    }
+
+    this->Functions.clear();
+    this->FunctionNumbers.clear();
+    this->Insts.clear();
+    this->FunctionOfInst.clear();
+    this->InstNumbers.clear();
+    this->FunctionOfArg.clear();
+    this->LiveSet.clear();
+    this->LiveArgs.clear();
+    this->LiveGlobals.clear();
+    this->VisitedConstants.clear();
+    return changed;
+}
+
+
+void InterproceduralDCE::numberModule(Module &M){
+    // number the defined functions, their arguments and their instructions.
+    // the calls and the returns of the rewritable functions are recorded
+
+    for (Function &F : M) {
+        if (F.isDeclaration()) {
+            continue;
+        }
+
+        FunctionInfo info;
+        info.F = &F;
+        info.FirstArg = this->FunctionOfArg.size();
+        info.Rewritable = this->isRewritable(F);
+        info.ReturnLive = false;
+
+        unsigned funcNo = this->Functions.size();
+        this->FunctionNumbers[&F] = funcNo;
+        this->FunctionOfArg.resize(this->FunctionOfArg.size() + F.arg_size(), funcNo);
+
+        for (BasicBlock &BB : F) {
+            for (Instruction &I : BB) {
+                this->InstNumbers[&I] = this->Insts.size();
+                this->Insts.push_back(&I);
+                this->FunctionOfInst.push_back(funcNo);
+
+                if (info.Rewritable && isa<ReturnInst>(&I)) {
+                    info.Returns.push_back(cast<ReturnInst>(&I));
+                }
+            }
+        }
+
+        this->Functions.push_back(info);
+    }
+
+    for (FunctionInfo &info : this->Functions) {
+        if (info.Rewritable) {
+            for (User *U : info.F->users()) {
+                info.CallSites.push_back(cast<CallInst>(U));
+            }
+        }
+    }
+}
+
+
+bool InterproceduralDCE::isRewritable(Function &F){
+    // the signature of F can only change if F is internal and every use of F
+    // is a direct call with its exact type. a musttail call has to keep the
+    // signature of its caller
+
+    if (!F.hasLocalLinkage() || F.isVarArg() || F.hasFnAttribute(Attribute::Naked)) {
+        return false;
+    }
+
+    for (User *U : F.users()) {
+        CallInst *callI = dyn_cast<CallInst>(U);
+        if (callI == NULL || callI->getCalledOperand() != &F ||
+            callI->getFunctionType() != F.getFunctionType() || callI->isMustTailCall()) {
+            return false;
+        }
+    }
+
+    for (BasicBlock &BB : F) {
+        for (Instruction &I : BB) {
+            CallInst *callI = dyn_cast<CallInst>(&I);
+            if (callI != NULL && callI->isMustTailCall()) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+bool InterproceduralDCE::isTriviallyLive(Instruction *I){
+    // as in ADCE: side effects, terminators, writes to memory, stores and
+    // calls. the exception handling pads can't be removed on their own
+    return I->mayHaveSideEffects() || I->isTerminator() || I->mayWriteToMemory() ||
+           isa<StoreInst>(I) || isa<CallInst>(I) || I->isEHPad();
+}
+
+
+void InterproceduralDCE::propagateLiveness(){
+    // while (any work list is not empty) {
+    //   G = a global that just became live:
+    //     if (G is a function)
+    //       markLive(each trivially live instruction of G);
+    //     markLive(the globals G refers to);
+    //   A = an argument that just became live:
+    //     markLive(the value passed for A by each live call);
+    //   F = a function whose returned value just became live:
+    //     markLive(the value returned by each live return of F);
+    //   I = an instruction that just became live:
+    //     markLive(each operand of I), except the dead arguments of a call
+    //     of a rewritable function and the value of a return whose
+    //     returned value is dead;
+
+    while (!this->GlobalWorkList.empty() || !this->ArgWorkList.empty() ||
+           !this->ReturnWorkList.empty() || !this->WorkList.empty()) {
+
+        while (!this->GlobalWorkList.empty()) {
+            GlobalValue *GV = this->GlobalWorkList.back();
+            this->GlobalWorkList.pop_back();
+
+            if (Function *F = dyn_cast<Function>(GV)) {
+                if (F->isDeclaration()) {
+                    continue;
+                }
+                for (BasicBlock &BB : *F) {
+                    for (Instruction &I : BB) {
+                        if (this->isTriviallyLive(&I)) {
+                            this->markLive(this->InstNumbers[&I]);
+                        }
+                    }
+                }
+                if (F->hasPersonalityFn()) {
+                    this->markConstantLive(F->getPersonalityFn());
+                }
+                if (F->hasPrefixData()) {
+                    this->markConstantLive(F->getPrefixData());
+                }
+                if (F->hasPrologueData()) {
+                    this->markConstantLive(F->getPrologueData());
+                }
+            } else if (GlobalVariable *GVar = dyn_cast<GlobalVariable>(GV)) {
+                if (GVar->hasInitializer()) {
+                    this->markConstantLive(GVar->getInitializer());
+                }
+            } else if (GlobalAlias *GA = dyn_cast<GlobalAlias>(GV)) {
+                this->markConstantLive(GA->getAliasee());
+            } else if (GlobalIFunc *GI = dyn_cast<GlobalIFunc>(GV)) {
+                this->markConstantLive(GI->getResolver());
+            }
+        }
+
+        while (!this->ArgWorkList.empty()) {
+            unsigned argNo = this->ArgWorkList.back();
+            this->ArgWorkList.pop_back();
+
+            FunctionInfo &info = this->Functions[this->FunctionOfArg[argNo]];
+            for (CallInst *callI : info.CallSites) {
+                if (this->LiveSet[this->InstNumbers[callI]]) {
+                    this->markValueLive(callI->getArgOperand(argNo - info.FirstArg));
+                }
+            }
+        }
+
+        while (!this->ReturnWorkList.empty()) {
+            unsigned funcNo = this->ReturnWorkList.back();
+            this->ReturnWorkList.pop_back();
+
+            for (ReturnInst *retI : this->Functions[funcNo].Returns) {
+                if (this->LiveSet[this->InstNumbers[retI]] && retI->getReturnValue() != NULL) {
+                    this->markValueLive(retI->getReturnValue());
+                }
+            }
+        }
+
+        while (!this->WorkList.empty()) {
+            unsigned instNo = this->WorkList.back();
+            this->WorkList.pop_back();
+
+            Instruction *I = this->Insts[instNo];
+            FunctionInfo *calleeInfo = NULL;
+            FunctionInfo &parentInfo = this->Functions[this->FunctionOfInst[instNo]];
+
+            if (CallInst *callI = dyn_cast<CallInst>(I)) {
+                Function *callee = callI->getCalledFunction();
+                if (callee != NULL && !callee->isDeclaration() &&
+                    this->Functions[this->FunctionNumbers[callee]].Rewritable) {
+                    calleeInfo = &this->Functions[this->FunctionNumbers[callee]];
+                }
+            }
+
+            for (unsigned opIdx = 0; opIdx != I->getNumOperands(); opIdx += 1){
+                if (calleeInfo != NULL && opIdx < cast<CallInst>(I)->arg_size() &&
+                    !this->LiveArgs[calleeInfo->FirstArg + opIdx]) {
+                    continue;
+                }
+                if (isa<ReturnInst>(I) && parentInfo.Rewritable && !parentInfo.ReturnLive) {
+                    continue;
+                }
+                this->markValueLive(I->getOperand(opIdx));
+            }
+        }
+    }
+}
+
+
+void InterproceduralDCE::markLive(unsigned InstNo){
+    // markLive()
+    //  if I is not in LiveSet
+    //    insert I in LiveSet
+    //    append I at the end of WorkList
+
+    if(!this->LiveSet[InstNo]){
+        this->LiveSet.set(InstNo);
+        this->WorkList.push_back(InstNo);
+    }
+}
+
+
+void InterproceduralDCE::markValueLive(Value *V){
+    // an instruction, an argument or a constant used by a live instruction.
+    // a call of a rewritable function used this way makes its returned
+    // value live
+
+    if (Instruction *I = dyn_cast<Instruction>(V)) {
+        this->markLive(this->InstNumbers[I]);
+
+        CallInst *callI = dyn_cast<CallInst>(I);
+        Function *callee = (callI != NULL) ? callI->getCalledFunction() : NULL;
+        if (callee != NULL && !callee->isDeclaration() &&
+            this->Functions[this->FunctionNumbers[callee]].Rewritable) {
+            this->markReturnLive(this->FunctionNumbers[callee]);
+        }
+    } else if (Argument *A = dyn_cast<Argument>(V)) {
+        FunctionInfo &info = this->Functions[this->FunctionNumbers[A->getParent()]];
+        if (info.Rewritable) {
+            this->markArgLive(info.FirstArg + A->getArgNo());
+        }
+    } else if (Constant *C = dyn_cast<Constant>(V)) {
+        this->markConstantLive(C);
+    }
+}
+
+
+void InterproceduralDCE::markArgLive(unsigned ArgNo){
+    if (!this->LiveArgs[ArgNo]) {
+        this->LiveArgs.set(ArgNo);
+        this->ArgWorkList.push_back(ArgNo);
+    }
+}
+
+
+void InterproceduralDCE::markReturnLive(unsigned FuncNo){
+    if (!this->Functions[FuncNo].ReturnLive) {
+        this->Functions[FuncNo].ReturnLive = true;
+        this->ReturnWorkList.push_back(FuncNo);
+    }
+}
+
+
+void InterproceduralDCE::markGlobalLive(GlobalValue *GV){
+    if (this->LiveGlobals.insert(GV).second) {
+        this->GlobalWorkList.push_back(GV);
+    }
+}
+
+
+void InterproceduralDCE::markConstantLive(Constant *C){
+    // the globals a constant refers to, possibly through constant
+    // expressions, aggregates or block addresses
+
+    if (GlobalValue *GV = dyn_cast<GlobalValue>(C)) {
+        this->markGlobalLive(GV);
+        return;
+    }
+
+    if (!this->VisitedConstants.insert(C).second) {
+        return;
+    }
+
+    for (unsigned opIdx = 0; opIdx != C->getNumOperands(); opIdx += 1) {
+        if (Constant *operandC = dyn_cast<Constant>(C->getOperand(opIdx))) {
+            this->markConstantLive(operandC);
+        }
+    }
+}
+
+
+void InterproceduralDCE::rewriteFunction(FunctionInfo &Info){
+    // 1. the new signature keeps the live arguments, and the returned value
+    // if it is live. the attributes of what is kept are kept, except
+    // 'returned' on an argument once nothing is returned
+
+    Function &F = *Info.F;
+    LLVMContext &context = F.getContext();
+    const AttributeList &funcAttrs = F.getAttributes();
+    bool keepReturn = Info.ReturnLive || F.getReturnType()->isVoidTy();
+
+    std::vector<Type*> newParamTys;
+    std::vector<AttributeSet> newParamAttrs;
+    for (Argument &A : F.args()) {
+        if (this->LiveArgs[Info.FirstArg + A.getArgNo()]) {
+            newParamTys.push_back(A.getType());
+            AttributeSet paramAttrs = funcAttrs.getParamAttrs(A.getArgNo());
+            if (!keepReturn) {
+                paramAttrs = paramAttrs.removeAttribute(context, Attribute::Returned);
+            }
+            newParamAttrs.push_back(paramAttrs);
+        }
+    }
+
+    FunctionType *newFuncTy = FunctionType::get(keepReturn ? F.getReturnType() : Type::getVoidTy(context),
+                                                newParamTys, /*isVarArg=*/false);
+    Function *newF = Function::Create(newFuncTy, F.getLinkage(), F.getAddressSpace());
+    newF->copyAttributesFrom(&F);
+    newF->setAttributes(AttributeList::get(context, funcAttrs.getFnAttrs(),
+                                           keepReturn ? funcAttrs.getRetAttrs() : AttributeSet(),
+                                           newParamAttrs));
+    newF->copyMetadata(&F, /*Offset=*/0);
+    F.getParent()->getFunctionList().insert(F.getIterator(), newF);
+    newF->takeName(&F);
+
+    // 2. every call passes the live arguments only. the result of a call
+    // whose returned value is dropped is only used by dead instructions
+
+    for (CallInst *callI : Info.CallSites) {
+        const AttributeList &callAttrs = callI->getAttributes();
+        std::vector<Value*> newArgs;
+        std::vector<AttributeSet> newArgAttrs;
+
+        for (unsigned argIdx = 0; argIdx != callI->arg_size(); argIdx += 1) {
+            if (this->LiveArgs[Info.FirstArg + argIdx]) {
+                newArgs.push_back(callI->getArgOperand(argIdx));
+                AttributeSet argAttrs = callAttrs.getParamAttrs(argIdx);
+                if (!keepReturn) {
+                    argAttrs = argAttrs.removeAttribute(context, Attribute::Returned);
+                }
+                newArgAttrs.push_back(argAttrs);
+            }
+        }
+
+        CallInst *newCallI = CallInst::Create(newFuncTy, newF, newArgs, "", callI);
+        newCallI->setCallingConv(callI->getCallingConv());
+        newCallI->setTailCallKind(callI->getTailCallKind());
+        newCallI->setAttributes(AttributeList::get(context, callAttrs.getFnAttrs(),
+                                                   keepReturn ? callAttrs.getRetAttrs() : AttributeSet(),
+                                                   newArgAttrs));
+        newCallI->setDebugLoc(callI->getDebugLoc());
+
+        if (keepReturn) {
+            callI->replaceAllUsesWith(newCallI);
+            newCallI->takeName(callI);
+        } else if (!callI->use_empty()) {
+            callI->replaceAllUsesWith(UndefValue::get(callI->getType()));
+        }
+        callI->eraseFromParent();
+    }
+
+    // 3. move the body. a dead argument is only used by dead instructions,
+    // a dropped returned value makes every return a plain one
+
+    newF->getBasicBlockList().splice(newF->begin(), F.getBasicBlockList());
+
+    Function::arg_iterator newArgIter = newF->arg_begin();
+    for (Argument &A : F.args()) {
+        if (this->LiveArgs[Info.FirstArg + A.getArgNo()]) {
+            A.replaceAllUsesWith(&*newArgIter);
+            newArgIter->takeName(&A);
+            ++newArgIter;
+        } else {
+            A.replaceAllUsesWith(UndefValue::get(A.getType()));
+        }
+    }
+
+    if (!keepReturn) {
+        for (ReturnInst *retI : Info.Returns) {
+            ReturnInst::Create(context, NULL, retI);
+            retI->eraseFromParent();
+        }
+    }
+
+    F.eraseFromParent();
+}
@@ -0,0 +1,120 @@
+; the following tests the control-dependence mode together with the
+; cfg-cleanup mode (see the Makefile). a dead branch jumps straight to
+; its nearest live post-dominator, the blocks it bypassed are deleted, and
+; the blocks left with a single predecessor are merged into it. the
+; results of every function but main are checked by the output of main
+;
+; run the test with: make bypassedBlocksTest-exec bypassedBlocksTest-opt-exec
+; look at the result with: make bypassedBlocksTest-opt.ll
+
+@fmt = private constant [4 x i8] c"%d\0A\00"
+declare i32 @printf(i8* nocapture readonly, ...)
+
+; a nested diamond whose phi is unused: the entry jumps to the join, the
+; four blocks in between are deleted and the join is merged into the
+; entry, so the function is a single block
+define internal i32 @deaddiamond(i32 %a) {
+entry:
+  %c = icmp sgt i32 %a, 3
+  br i1 %c, label %t, label %f
+t:
+  %x = mul i32 %a, 7
+  %c2 = icmp eq i32 %x, 21
+  br i1 %c2, label %tt, label %join
+tt:
+  %y = add i32 %x, 1
+  br label %join
+f:
+  %z = sub i32 %a, 2
+  br label %join
+join:
+  %p = phi i32 [%x, %t], [%y, %tt], [%z, %f]
+  %r = add i32 %a, 1
+  ret i32 %r
+}
+
+; a dead if inside a live loop: the body jumps to the latch and the then
+; block is deleted. the body is then left with its phi and a jump, so it
+; is bypassed and the latch takes the phi
+define internal i32 @deadif(i32 %n) {
+entry:
+  br label %body
+body:
+  %i = phi i32 [0, %entry], [%i2, %latch]
+  %odd = and i32 %i, 1
+  %c = icmp eq i32 %odd, 1
+  br i1 %c, label %then, label %latch
+then:
+  %dead = mul i32 %i, %i
+  br label %latch
+latch:
+  %i2 = add i32 %i, 1
+  %cmp = icmp slt i32 %i2, %n
+  br i1 %cmp, label %body, label %exit
+exit:
+  ret i32 %i2
+}
+
+; a switch whose cases only compute dead values: it jumps to the default
+; destination, where the cases meet, and the cases are deleted
+define internal i32 @deadswitch(i32 %a) {
+entry:
+  switch i32 %a, label %out [ i32 1, label %one
+                              i32 2, label %two ]
+one:
+  %x = add i32 %a, 11
+  br label %out
+two:
+  %y = add i32 %a, 22
+  br label %out
+out:
+  %p = phi i32 [%x, %one], [%y, %two], [0, %entry]
+  %r = mul i32 %a, 3
+  ret i32 %r
+}
+
+; the phi of the join is live, so the branch choosing its value is live
+; and no block goes away
+define internal i32 @livephi(i32 %a) {
+entry:
+  %c = icmp slt i32 %a, 0
+  br i1 %c, label %neg, label %join
+neg:
+  %m = sub i32 0, %a
+  br label %join
+join:
+  %p = phi i32 [%m, %neg], [%a, %entry]
+  ret i32 %p
+}
+
+; a block that is never reached and jumps into the live join: it is
+; deleted and the phi loses its incoming value
+define internal i32 @orphan(i32 %a) {
+entry:
+  %c = icmp eq i32 %a, 0
+  br i1 %c, label %zero, label %join
+zero:
+  br label %join
+never:
+  br label %join
+join:
+  %p = phi i32 [1, %zero], [%a, %entry], [99, %never]
+  ret i32 %p
+}
+
+define i32 @main() {
+entry:
+  %a = call i32 @deaddiamond(i32 5)
+  %b = call i32 @deadif(i32 7)
+  %c = call i32 @deadswitch(i32 2)
+  %d = call i32 @livephi(i32 -8)
+  %e = call i32 @orphan(i32 0)
+  %f = call i32 @orphan(i32 6)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %a)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %b)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %c)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %d)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %e)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %f)
+  ret i32 0
+}
@@ -0,0 +1,119 @@
+; the following tests the cfg-cleanup mode (see the Makefile)
+; once the dead instructions are removed, the blocks no path from the
+; entry reaches are deleted, and the blocks that only jump are merged into
+; their predecessor or bypassed. the results of every function but main
+; are checked by the output of main
+;
+; run the test with: make cfgCleanupTest-exec cfgCleanupTest-opt-exec
+; look at the result with: make cfgCleanupTest-opt.ll
+
+@fmt = private constant [4 x i8] c"%d\0A\00"
+declare i32 @printf(i8* nocapture readonly, ...)
+
+; two blocks that are never reached, the second one with an edge into the
+; phi of the join: both are deleted and the phi loses that incoming value
+define internal i32 @neverreached(i32 %a) {
+entry:
+  %c = icmp sgt i32 %a, 0
+  br i1 %c, label %pos, label %join
+pos:
+  %x = add i32 %a, 10
+  br label %join
+orphan:
+  %y = mul i32 %a, 3
+  br label %orphan2
+orphan2:
+  %z = add i32 %y, 1
+  br label %join
+join:
+  %p = phi i32 [%x, %pos], [%a, %entry], [%z, %orphan2]
+  ret i32 %p
+}
+
+; the arms of the diamond only compute the dead phi, so they are left with
+; a jump alone and are bypassed. the branch then goes twice to the join,
+; and the join is merged into the entry. the compare is left, dead, for a
+; later pass
+define internal i32 @emptyarms(i32 %a) {
+entry:
+  %c = icmp slt i32 %a, 5
+  br i1 %c, label %t, label %f
+t:
+  %x = mul i32 %a, 7
+  br label %join
+f:
+  %y = sub i32 %a, 7
+  br label %join
+join:
+  %p = phi i32 [%x, %t], [%y, %f]
+  %r = add i32 %a, 1
+  ret i32 %r
+}
+
+; a chain of blocks, each the only successor of the one before: they all
+; end up in the entry
+define internal i32 @chain(i32 %a) {
+entry:
+  %x = add i32 %a, 1
+  br label %b1
+b1:
+  %dead = mul i32 %x, 5
+  br label %b2
+b2:
+  %y = mul i32 %x, 2
+  br label %b3
+b3:
+  ret i32 %y
+}
+
+; the arm of the diamond only computes a dead value, so it is left with a
+; jump alone. it is kept: the live phi of the join takes another value
+; through it than from the entry
+define internal i32 @livephi(i32 %a) {
+entry:
+  %c = icmp eq i32 %a, 2
+  br i1 %c, label %t, label %join
+t:
+  %dead = shl i32 %a, 3
+  br label %join
+join:
+  %p = phi i32 [100, %t], [%a, %entry]
+  ret i32 %p
+}
+
+; the body of the loop only updates a dead sum, so it is left with a jump
+; alone. it is bypassed and the header jumps to itself
+define internal i32 @emptybody(i32 %n) {
+entry:
+  br label %header
+header:
+  %i = phi i32 [0, %entry], [%i2, %body]
+  %s = phi i32 [0, %entry], [%s2, %body]
+  %i2 = add i32 %i, 1
+  %cmp = icmp slt i32 %i2, %n
+  br i1 %cmp, label %body, label %exit
+body:
+  %s2 = add i32 %s, %i
+  br label %header
+exit:
+  ret i32 %i2
+}
+
+define i32 @main() {
+entry:
+  %a = call i32 @neverreached(i32 4)
+  %b = call i32 @neverreached(i32 -4)
+  %c = call i32 @emptyarms(i32 3)
+  %d = call i32 @chain(i32 6)
+  %e = call i32 @livephi(i32 2)
+  %f = call i32 @livephi(i32 3)
+  %g = call i32 @emptybody(i32 10)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %a)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %b)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %c)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %d)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %e)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %f)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %g)
+  ret i32 0
+}
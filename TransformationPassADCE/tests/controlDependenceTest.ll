@@ -0,0 +1,200 @@
+; the following tests the control-dependence mode (see the Makefile)
+; a branch is only live if a live instruction is control dependent on it
+; or if it picks the incoming value of a live phi. the results of every
+; function but main are checked by the output of main
+;
+; run the test with: make controlDependenceTest-exec controlDependenceTest-opt-exec
+; look at the result with: make controlDependenceTest-opt.ll
+
+@fmt = private constant [4 x i8] c"%d\0A\00"
+declare i32 @printf(i8* nocapture readonly, ...)
+
+; a nested if/else diamond whose phi is unused: every branch is dead and
+; the entry jumps straight to the join
+define internal i32 @deaddiamond(i32 %a) {
+entry:
+  %c = icmp sgt i32 %a, 3
+  br i1 %c, label %t, label %f
+t:
+  %x = mul i32 %a, 7
+  %c2 = icmp eq i32 %x, 21
+  br i1 %c2, label %tt, label %join
+tt:
+  %y = add i32 %x, 1
+  br label %join
+f:
+  %z = sub i32 %a, 2
+  br label %join
+join:
+  %p = phi i32 [%x, %t], [%y, %tt], [%z, %f]
+  %r = add i32 %a, 1
+  ret i32 %r
+}
+
+; the first diamond picks the value of a live phi, so its branch stays.
+; the second one guards a dead add only
+define internal i32 @livephi(i32 %a) {
+entry:
+  %c = icmp sgt i32 %a, 3
+  br i1 %c, label %t, label %f
+t:
+  %dead = mul i32 %a, 9
+  br label %join
+f:
+  br label %join
+join:
+  %p = phi i32 [1, %t], [2, %f]
+  %c3 = icmp eq i32 %a, 100
+  br i1 %c3, label %x1, label %x2
+x1:
+  %q = add i32 %a, 5
+  br label %x2
+x2:
+  ret i32 %p
+}
+
+; a switch whose targets only compute the unused phi
+define internal i32 @sw(i32 %a) {
+entry:
+  switch i32 %a, label %d [ i32 1, label %one
+                            i32 2, label %two
+                            i32 3, label %two ]
+one:
+  %o = add i32 %a, 1
+  br label %end
+two:
+  %tw = add i32 %a, 2
+  br label %end
+d:
+  br label %end
+end:
+  %pp = phi i32 [%o, %one], [%tw, %two], [0, %d]
+  ret i32 %a
+}
+
+; a loop with a dead if/else in its body. the back edge is kept, the
+; branch of the if/else is not
+define internal i32 @loop(i32 %n) {
+entry:
+  br label %h
+h:
+  %i = phi i32 [0, %entry], [%i2, %latch]
+  %c = icmp slt i32 %i, %n
+  br i1 %c, label %body, label %exit
+body:
+  %j = mul i32 %i, 3
+  %odd = and i32 %i, 1
+  %co = icmp eq i32 %odd, 0
+  br i1 %co, label %even, label %latch
+even:
+  %k = add i32 %j, 1
+  br label %latch
+latch:
+  %i2 = add i32 %i, 1
+  br label %h
+exit:
+  ret i32 %i
+}
+
+; two returns: a branch between two live blocks stays
+define internal i32 @tworet(i32 %a) {
+entry:
+  %c = icmp sgt i32 %a, 3
+  br i1 %c, label %r1, label %r2
+r1:
+  ret i32 1
+r2:
+  ret i32 2
+}
+
+; an unreachable block is live, the branch to it stays. the next one only
+; guards a dead add
+define internal i32 @unr(i32 %a) {
+entry:
+  %c = icmp sgt i32 %a, 300
+  br i1 %c, label %bad, label %ok
+bad:
+  unreachable
+ok:
+  %c2 = icmp sgt i32 %a, 10
+  br i1 %c2, label %m, label %n
+m:
+  %u = add i32 %a, 1
+  br label %n
+n:
+  ret i32 %a
+}
+
+; a store is live, so the branch that guards it stays
+define internal void @store(i32* %p, i32 %a) {
+entry:
+  %c = icmp sgt i32 %a, 3
+  br i1 %c, label %s, label %e
+s:
+  store i32 %a, i32* %p
+  br label %e
+e:
+  ret void
+}
+
+; an infinite loop with nothing live in it. it must not be removed, even
+; though it is not entered at run time
+define internal i32 @spin(i32 %a) {
+entry:
+  %c = icmp sgt i32 %a, 100
+  br i1 %c, label %forever, label %out
+forever:
+  %x = phi i32 [0, %entry], [%x2, %forever]
+  %x2 = add i32 %x, 1
+  br label %forever
+out:
+  ret i32 %a
+}
+
+; an irreducible cycle with two entries and nothing live in it. it is
+; kept as well
+define internal i32 @irr(i32 %a) {
+entry:
+  %c = icmp sgt i32 %a, 1
+  br i1 %c, label %p, label %q
+p:
+  %i = phi i32 [0, %entry], [%j2, %q]
+  %i2 = add i32 %i, 1
+  %cp = icmp slt i32 %i2, 5
+  br i1 %cp, label %q, label %done
+q:
+  %j = phi i32 [0, %entry], [%i2, %p]
+  %j2 = add i32 %j, 1
+  %cq = icmp slt i32 %j2, 5
+  br i1 %cq, label %p, label %done
+done:
+  ret i32 %a
+}
+
+define i32 @main() {
+entry:
+  %slot = alloca i32
+  store i32 0, i32* %slot
+  %a = call i32 @deaddiamond(i32 5)
+  %b = call i32 @livephi(i32 5)
+  %b2 = call i32 @livephi(i32 1)
+  %c = call i32 @sw(i32 3)
+  %d = call i32 @loop(i32 10)
+  %e = call i32 @tworet(i32 1)
+  %f = call i32 @unr(i32 50)
+  call void @store(i32* %slot, i32 9)
+  %g = load i32, i32* %slot
+  %h = call i32 @spin(i32 3)
+  %i = call i32 @irr(i32 3)
+  %s1 = add i32 %a, %b
+  %s2 = add i32 %s1, %b2
+  %s3 = add i32 %s2, %c
+  %s4 = add i32 %s3, %d
+  %s5 = add i32 %s4, %e
+  %s6 = add i32 %s5, %f
+  %s7 = add i32 %s6, %g
+  %s8 = add i32 %s7, %h
+  %s9 = add i32 %s8, %i
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %s9)
+  ret i32 0
+}
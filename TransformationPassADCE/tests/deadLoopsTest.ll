@@ -0,0 +1,113 @@
+; the following tests the dead-loops mode, with the control-dependence
+; and the cfg-cleanup modes (see the Makefile). a loop scalar evolution
+; can bound and that computes nothing live is removed, its preheader
+; jumps to its exit. the results of every function but main are checked
+; by the output of main
+;
+; run the test with: make deadLoopsTest-exec deadLoopsTest-opt-exec
+; look at the result with: make deadLoopsTest-opt.ll
+
+@fmt = private constant [4 x i8] c"%d\0A\00"
+@g = global i32 0
+declare i32 @printf(i8* nocapture readonly, ...)
+
+; a counted loop whose sum is unused: removed, the function only returns
+define internal i32 @deadloop(i32 %a) {
+entry:
+  br label %h
+h:
+  %i = phi i32 [0, %entry], [%i2, %h]
+  %acc = phi i32 [0, %entry], [%acc2, %h]
+  %acc2 = add i32 %acc, %i
+  %i2 = add nsw i32 %i, 1
+  %c = icmp slt i32 %i2, 1000
+  br i1 %c, label %h, label %exit
+exit:
+  ret i32 %a
+}
+
+; two nested counted loops computing nothing live: both are removed
+define internal i32 @nested(i32 %n) {
+entry:
+  br label %oh
+oh:
+  %i = phi i32 [0, %entry], [%i2, %olatch]
+  br label %ih
+ih:
+  %j = phi i32 [0, %oh], [%j2, %ih]
+  %x = mul i32 %i, %j
+  %j2 = add nsw i32 %j, 1
+  %cj = icmp slt i32 %j2, 50
+  br i1 %cj, label %ih, label %olatch
+olatch:
+  %i2 = add nsw i32 %i, 1
+  %ci = icmp slt i32 %i2, 50
+  br i1 %ci, label %oh, label %exit
+exit:
+  ret i32 %n
+}
+
+; the loop stores to a global, so it stays
+define internal i32 @storeloop(i32 %n) {
+entry:
+  br label %h
+h:
+  %i = phi i32 [0, %entry], [%i2, %h]
+  store i32 %i, i32* @g
+  %i2 = add nsw i32 %i, 1
+  %c = icmp slt i32 %i2, %n
+  br i1 %c, label %h, label %exit
+exit:
+  ret i32 %n
+}
+
+; the loop computes nothing live, but scalar evolution can't bound it
+; (it is not known to end for every n), so it stays
+define internal i32 @collatz(i32 %n) {
+entry:
+  br label %h
+h:
+  %x = phi i32 [%n, %entry], [%x2, %h]
+  %odd = and i32 %x, 1
+  %isodd = icmp eq i32 %odd, 1
+  %t = mul i32 %x, 3
+  %t1 = add i32 %t, 1
+  %hf = lshr i32 %x, 1
+  %x2 = select i1 %isodd, i32 %t1, i32 %hf
+  %c = icmp ne i32 %x2, 1
+  br i1 %c, label %h, label %exit
+exit:
+  ret i32 %n
+}
+
+; the sum of the loop is returned, so it stays
+define internal i32 @liveloop(i32 %n) {
+entry:
+  br label %h
+h:
+  %i = phi i32 [0, %entry], [%i2, %h]
+  %acc = phi i32 [0, %entry], [%acc2, %h]
+  %acc2 = add i32 %acc, %i
+  %i2 = add nsw i32 %i, 1
+  %c = icmp slt i32 %i2, %n
+  br i1 %c, label %h, label %exit
+exit:
+  ret i32 %acc2
+}
+
+define i32 @main() {
+entry:
+  %a = call i32 @deadloop(i32 1)
+  %b = call i32 @nested(i32 2)
+  %c = call i32 @storeloop(i32 5)
+  %d = call i32 @collatz(i32 27)
+  %e = call i32 @liveloop(i32 10)
+  %g = load i32, i32* @g
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %a)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %b)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %c)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %d)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %e)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %g)
+  ret i32 0
+}
@@ -0,0 +1,132 @@
+; the following tests the dead-stores mode (see the Makefile)
+; the stores into a local alloca are only live if a live load may read the
+; bytes they write, and an alloca without live loads goes away with its
+; stores and lifetime markers. the results of every function but main are
+; checked by the output of main
+;
+; run the test with: make deadStoresTest-exec deadStoresTest-opt-exec
+; look at the result with: make deadStoresTest-opt.ll
+
+@fmt = private constant [4 x i8] c"%d\0A\00"
+declare i32 @printf(i8* nocapture readonly, ...)
+declare void @llvm.lifetime.start.p0i8(i64, i8* nocapture)
+declare void @llvm.lifetime.end.p0i8(i64, i8* nocapture)
+
+; the i32 store through the bitcast writes bytes 0-3 of the i64, which no
+; load reads, so it is removed. the load of bytes 4-7 keeps the i64 store
+define internal i32 @partial(i64 %a) {
+entry:
+  %w = alloca i64
+  store i64 %a, i64* %w
+  %lo = bitcast i64* %w to i32*
+  store i32 -1, i32* %lo
+  %hi = getelementptr i32, i32* %lo, i32 1
+  %v = load i32, i32* %hi
+  ret i32 %v
+}
+
+; the i16 load at byte 3 straddles the first two elements, so it keeps both
+; of their stores. the store to the third element is removed
+define internal i32 @straddle() {
+entry:
+  %arr = alloca [3 x i32]
+  %e0 = getelementptr [3 x i32], [3 x i32]* %arr, i32 0, i32 0
+  %e1 = getelementptr [3 x i32], [3 x i32]* %arr, i32 0, i32 1
+  %e2 = getelementptr [3 x i32], [3 x i32]* %arr, i32 0, i32 2
+  store i32 33554432, i32* %e0
+  store i32 3, i32* %e1
+  store i32 7, i32* %e2
+  %b = bitcast [3 x i32]* %arr to i8*
+  %b3 = getelementptr i8, i8* %b, i32 3
+  %h = bitcast i8* %b3 to i16*
+  %v = load i16, i16* %h
+  %r = zext i16 %v to i32
+  ret i32 %r
+}
+
+; a load with a variable index may read any element, so every store stays
+define internal i32 @varload(i32 %k) {
+entry:
+  %arr = alloca [4 x i32]
+  %e0 = getelementptr [4 x i32], [4 x i32]* %arr, i32 0, i32 0
+  %e1 = getelementptr [4 x i32], [4 x i32]* %arr, i32 0, i32 1
+  %e2 = getelementptr [4 x i32], [4 x i32]* %arr, i32 0, i32 2
+  %e3 = getelementptr [4 x i32], [4 x i32]* %arr, i32 0, i32 3
+  store i32 10, i32* %e0
+  store i32 11, i32* %e1
+  store i32 12, i32* %e2
+  store i32 13, i32* %e3
+  %ek = getelementptr [4 x i32], [4 x i32]* %arr, i32 0, i32 %k
+  %v = load i32, i32* %ek
+  ret i32 %v
+}
+
+; a store with a variable index may write any element, so it stays for the
+; load of element 1. the store to element 0 is removed
+define internal i32 @varstore(i32 %k) {
+entry:
+  %arr = alloca [4 x i32]
+  %e0 = getelementptr [4 x i32], [4 x i32]* %arr, i32 0, i32 0
+  %e1 = getelementptr [4 x i32], [4 x i32]* %arr, i32 0, i32 1
+  store i32 20, i32* %e0
+  store i32 21, i32* %e1
+  %ek = getelementptr [4 x i32], [4 x i32]* %arr, i32 0, i32 %k
+  store i32 50, i32* %ek
+  %v = load i32, i32* %e1
+  ret i32 %v
+}
+
+; the only load of the struct feeds a store back into it, so nothing live
+; reads it: the alloca goes away with its stores, its load and its
+; lifetime markers
+define internal i32 @lifetimes(i32 %a) {
+entry:
+  %s = alloca { i32, i32 }
+  %c = bitcast { i32, i32 }* %s to i8*
+  call void @llvm.lifetime.start.p0i8(i64 8, i8* %c)
+  %x = getelementptr { i32, i32 }, { i32, i32 }* %s, i32 0, i32 0
+  %y = getelementptr { i32, i32 }, { i32, i32 }* %s, i32 0, i32 1
+  store i32 %a, i32* %x
+  %v = load i32, i32* %x
+  %v2 = add i32 %v, 1
+  store i32 %v2, i32* %y
+  call void @llvm.lifetime.end.p0i8(i64 8, i8* %c)
+  %r = mul i32 %a, 2
+  ret i32 %r
+}
+
+; the address is passed to a call, so the alloca isn't local and its store
+; stays, even though the function never loads from it
+define internal i32 @escape(i32 %a) {
+entry:
+  %e = alloca i32
+  store i32 %a, i32* %e
+  call void @show(i32* %e)
+  ret i32 0
+}
+
+define internal void @show(i32* %p) {
+entry:
+  %v = load i32, i32* %p
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %v)
+  ret void
+}
+
+define i32 @main() {
+entry:
+  %a = call i32 @partial(i64 81604378625)
+  %b = call i32 @straddle()
+  %c = call i32 @varload(i32 2)
+  %d = call i32 @varstore(i32 1)
+  %e = call i32 @varstore(i32 3)
+  %f = call i32 @lifetimes(i32 8)
+  %g = call i32 @escape(i32 77)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %a)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %b)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %c)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %d)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %e)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %f)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %g)
+  ret i32 0
+}
@@ -0,0 +1,107 @@
+; the following tests the function attribute inference together with the
+; pure-call mode (see the Makefile). the unused calls of the functions
+; inferred readnone/readonly, nounwind and willreturn are removed, the
+; others stay. the output of main checks that the writer still runs
+;
+; run the test with: make functionAttrsTest-exec functionAttrsTest-opt-exec
+; look at the result with: make functionAttrsTest-opt.ll
+
+@fmt = private constant [4 x i8] c"%d\0A\00"
+@gv = global i32 5
+@counter = global i32 0
+declare i32 @printf(i8* nocapture readonly, ...)
+
+; the library functions only have the attributes they are declared with
+declare double @sqrt(double) readnone nounwind willreturn
+declare i32 @abs(i32)
+
+; only its own alloca is loaded and stored, so it is readnone
+define internal i32 @square(i32 %x) {
+entry:
+  %t = alloca i32
+  store i32 %x, i32* %t
+  %v = load i32, i32* %t
+  %r = mul i32 %v, %v
+  ret i32 %r
+}
+
+; it reads a global and calls a readnone function, so it is readonly
+define internal i32 @getter() {
+entry:
+  %v = load i32, i32* @gv
+  %r = call i32 @square(i32 %v)
+  ret i32 %r
+}
+
+; it writes a global, so its unused calls stay
+define internal i32 @bump() {
+entry:
+  %v = load i32, i32* @counter
+  %v2 = add i32 %v, 1
+  store i32 %v2, i32* @counter
+  ret i32 %v2
+}
+
+; readnone, but it has a loop, so it may not return and its calls stay
+define internal i32 @loops(i32 %n) {
+entry:
+  br label %h
+h:
+  %i = phi i32 [0, %entry], [%i2, %h]
+  %i2 = add i32 %i, 1
+  %c = icmp slt i32 %i2, %n
+  br i1 %c, label %h, label %e
+e:
+  ret i32 %i2
+}
+
+; readnone, but it calls itself, so it may not return either
+define internal i32 @rec(i32 %n) {
+entry:
+  %c = icmp sgt i32 %n, 0
+  br i1 %c, label %r, label %z
+r:
+  %m = sub i32 %n, 1
+  %v = call i32 @rec(i32 %m)
+  ret i32 %v
+z:
+  ret i32 0
+}
+
+; it calls the readonly getter and the readnone sqrt, so it is readonly.
+; the unused call of sqrt inside it is removed too
+define internal i32 @hash(i32 %x) {
+entry:
+  %a = call i32 @getter()
+  %b = xor i32 %a, %x
+  %d = call double @sqrt(double 4.0)
+  ret i32 %b
+}
+
+; abs is declared without attributes, so nothing is known about it and
+; this function isn't pure: its calls stay
+define internal i32 @absdiff(i32 %x, i32 %y) {
+entry:
+  %d = sub i32 %x, %y
+  %r = call i32 @abs(i32 %d)
+  ret i32 %r
+}
+
+define i32 @main() {
+entry:
+  %u1 = call i32 @square(i32 3)
+  %u2 = call i32 @getter()
+  %u3 = call i32 @bump()
+  %u4 = call i32 @loops(i32 3)
+  %u5 = call i32 @rec(i32 3)
+  %u6 = call i32 @hash(i32 3)
+  %u7 = call i32 @absdiff(i32 2, i32 9)
+  %u8 = call double @sqrt(double 9.0)
+  %u9 = call i32 @bump()
+  %h = call i32 @hash(i32 1)
+  %c = load i32, i32* @counter
+  %s = add i32 %c, %h
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %c)
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %s)
+  ret i32 0
+}
@@ -0,0 +1,24 @@
+#!/bin/sh
+# generate a large function to time the pass on: a chain of N add/mul/xor
+# steps where every step feeds the next one, so nearly all of the 3 * N
+# instructions are live. a dead add every 1000 steps
+# usage: sh genLiveChainTest.sh 130000 > liveChainTest.ll
+
+N=${1:-130000}
+
+awk -v n=$N 'BEGIN {
+	print "define i32 @f(i32 %a, i32 %b) {"
+	print "entry:"
+	live = "%a"
+	for (i = 0; i < n; ++i) {
+		printf "  %%l%d = add i32 %s, %d\n", i, live, i
+		printf "  %%d%d = mul i32 %%l%d, %%b\n", i, i
+		printf "  %%e%d = xor i32 %%d%d, %s\n", i, i, live
+		live = sprintf("%%e%d", i)
+		if (i % 1000 == 0) {
+			printf "  %%x%d = add i32 %%a, %d\n", i, i
+		}
+	}
+	printf "  ret i32 %s\n", live
+	print "}"
+}'
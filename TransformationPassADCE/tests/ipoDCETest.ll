@@ -0,0 +1,142 @@
+; the following tests the module pass mp5-ipo-adce (see the Makefile)
+; the internal functions lose their dead arguments and their ignored
+; returned values, layer by layer, and the internal functions and globals
+; nothing live refers to are deleted. main prints a sum that depends on
+; every live result
+;
+; run the test with: make ipoDCETest-exec ipoDCETest-opt-exec
+; look at the result with: make ipoDCETest-opt.ll
+
+@fmt = private constant [4 x i8] c"%d\0A\00"
+declare i32 @printf(i8* nocapture readonly, ...)
+
+; only reached from the dead function @deadfn, so deleted with it
+@unused = internal global [4 x i32] [i32 1, i32 2, i32 3, i32 4]
+@table = internal global i32* getelementptr ([4 x i32], [4 x i32]* @unused, i32 0, i32 1)
+
+; a dead cycle of globals, both are deleted
+@cycA = internal global i8* bitcast (i8** @cycB to i8*)
+@cycB = internal global i8* bitcast (i8** @cycA to i8*)
+
+; live: loaded by main, through a function pointer and through an alias
+@kept = internal global i32 7
+@fp = internal global i32 (i32, i32)* @taken
+@aliased = internal global i32 5
+@al = internal alias i32, i32* @aliased
+
+; layered dead arguments: %c of @leaf is unused, and %c of @mid is only
+; passed to @leaf, so it is dead too
+define internal i32 @leaf(i32 %a, i32 %b, i32 %c) {
+  %x = mul i32 %a, 3
+  %z = add i32 %x, %b
+  ret i32 %z
+}
+
+define internal i32 @mid(i32 %a, i32 %b, i32 %c) {
+  %r = call i32 @leaf(i32 %a, i32 %b, i32 %c)
+  %s = add i32 %r, %b
+  ret i32 %s
+}
+
+; %dead is never used, the store keeps the function live
+define internal void @side(i32 %a, i32 %dead) {
+  %v = load i32, i32* @kept
+  %w = add i32 %v, %a
+  store i32 %w, i32* @kept
+  ret void
+}
+
+; recursion: %junk is only passed to itself, so it is dead
+define internal i32 @rec(i32 %n, i32 %acc, i32 %junk) {
+entry:
+  %c = icmp eq i32 %n, 0
+  br i1 %c, label %done, label %more
+more:
+  %n1 = sub i32 %n, 1
+  %a1 = add i32 %acc, %n
+  %j1 = mul i32 %junk, %n
+  %r = call i32 @rec(i32 %n1, i32 %a1, i32 %j1)
+  ret i32 %r
+done:
+  ret i32 %acc
+}
+
+; mutual recursion: %x is dead in both
+define internal i32 @even(i32 %n, i32 %x) {
+entry:
+  %c = icmp eq i32 %n, 0
+  br i1 %c, label %z, label %nz
+z:
+  ret i32 1
+nz:
+  %m = sub i32 %n, 1
+  %r = call i32 @odd(i32 %m, i32 %x)
+  ret i32 %r
+}
+
+define internal i32 @odd(i32 %n, i32 %x) {
+entry:
+  %c = icmp eq i32 %n, 0
+  br i1 %c, label %z, label %nz
+z:
+  ret i32 0
+nz:
+  %m = sub i32 %n, 1
+  %r = call i32 @even(i32 %m, i32 %x)
+  ret i32 %r
+}
+
+; the returned value is ignored by main, so it becomes void
+define internal i32 @ignored(i32 %a) {
+  call void @side(i32 %a, i32 %a)
+  ret i32 %a
+}
+
+; a 'returned' argument stays live, but the attribute goes away with the
+; ignored returned value
+define internal i32 @passthrough(i32 returned %x, i32 %y) {
+  call void @side(i32 %x, i32 %y)
+  ret i32 %x
+}
+
+; its address is taken, so its signature stays
+define internal i32 @taken(i32 %a, i32 %b) {
+  ret i32 %a
+}
+
+; dead: nothing live calls them
+define internal i32 @deadfn(i32 %a) {
+  %p = load i32*, i32** @table
+  %v = load i32, i32* %p
+  %r = add i32 %v, %a
+  ret i32 %r
+}
+
+define internal i32 @dcycle(i32 %n) {
+  %r = call i32 @dcycle2(i32 %n)
+  ret i32 %r
+}
+
+define internal i32 @dcycle2(i32 %n) {
+  %r = call i32 @dcycle(i32 %n)
+  ret i32 %r
+}
+
+define i32 @main() {
+  %m = call i32 @mid(i32 2, i32 9, i32 11)
+  call void @side(i32 %m, i32 100)
+  %i = call i32 @ignored(i32 1)
+  %p = call i32 @passthrough(i32 returned 3, i32 4)
+  %q = call i32 @rec(i32 10, i32 0, i32 3)
+  %f = load i32 (i32, i32)*, i32 (i32, i32)** @fp
+  %t = call i32 %f(i32 3, i32 4)
+  %e = call i32 @even(i32 7, i32 %t)
+  %k = load i32, i32* @kept
+  %v = load i32, i32* @al
+  %s1 = add i32 %k, %q
+  %s2 = add i32 %s1, %t
+  %s3 = add i32 %s2, %e
+  %s4 = add i32 %s3, %v
+  call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @fmt, i32 0, i32 0), i32 %s4)
+  ret i32 0
+}
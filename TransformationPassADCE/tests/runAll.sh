@@ -0,0 +1,25 @@
+run_test()
+{
+	NAME=$1
+	make $NAME-exec
+	make $NAME-opt-exec
+	echo ""
+	echo ""
+	echo "-------------$NAME Diff Result-------------"
+	diff $NAME-exec.out $NAME-opt-exec.out
+	echo ""
+	echo ""
+	make clean
+}
+
+for entry in $PWD/*Test.ll
+do
+	testName=$(basename $entry .ll)
+
+	# the generated benchmark has no main, it is only timed
+	if [ "$testName" = "liveChainTest" ]; then
+		continue
+	fi
+
+	run_test $testName
+done
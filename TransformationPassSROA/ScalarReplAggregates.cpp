@@ -27,26 +27,58 @@
 #include "llvm/Pass.h"
 
 #include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/CaptureTracking.h"
+#include "llvm/Analysis/MemoryBuiltins.h"
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
 
 #include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
 #include "llvm/Transforms/Utils/PromoteMemToReg.h"
+#include "llvm/Transforms/Utils/SSAUpdater.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
 
 #include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/DIBuilder.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/GetElementPtrTypeIterator.h"
+#include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/InstrTypes.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
 #include "llvm/IR/Type.h"
+#include "llvm/IR/ValueHandle.h"
 
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/ArrayRef.h"
-
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/STLExtras.h"
+
+#include <algorithm>
+#include <map>
+#include <numeric>
 #include <vector>
 
 using namespace llvm;
@@ -60,29 +92,200 @@ using std::to_string;
 
 
 STATISTIC(NumReplaced,  "Number of aggregate allocas broken up");
+STATISTIC(NumArraysReplaced, "Number of array allocas broken up");
 STATISTIC(NumPromoted,  "Number of scalar allocas promoted to register");
+STATISTIC(NumVectorized, "Number of aggregate allocas turned into vector allocas");
+STATISTIC(NumMemIntrinsicsSplit, "Number of memcpy/memset split into fields");
+STATISTIC(NumDynamicAccesses, "Number of variable-index array accesses turned into selects");
+STATISTIC(NumFieldsSkipped, "Number of never-accessed fields not given an alloca");
+STATISTIC(NumEscapeCopies, "Number of calls given a temporary copy of an aggregate");
+STATISTIC(NumStructArraysSplit, "Number of arrays of structs turned into one array per field");
+STATISTIC(NumPhisInserted, "Number of phi nodes placed by the promotion");
+STATISTIC(NumHeapToStack, "Number of heap allocations turned into allocas");
+STATISTIC(NumPartiallyPromoted, "Number of scalar allocas promoted between their escapes");
+STATISTIC(NumFieldLifetimes, "Number of field allocas given their own lifetime markers");
+
+
+// only small arrays are broken up, each element becomes its own alloca
+static cl::opt<unsigned> MaxArrayElements(
+    "scalarrepl-ziangw2-max-array-elements", cl::init(32), cl::Hidden,
+    cl::desc("Largest number of elements of an array alloca that is broken up"));
+
+// vector-promotion mode: an aggregate of same-typed scalars that fits in a
+// target vector register becomes one vector alloca instead of many scalars
+static cl::opt<bool> PromoteToVector(
+    "scalarrepl-ziangw2-vectorize", cl::init(false), cl::Hidden,
+    cl::desc("Turn small homogeneous aggregates into vector allocas"));
+
+// dynamic-index mode: a small array of scalars indexed by a variable is
+// still broken up, each access selects among all the elements
+static cl::opt<unsigned> MaxDynamicIndexElements(
+    "scalarrepl-ziangw2-dynamic-index-max", cl::init(0), cl::Hidden,
+    cl::desc("Largest array indexed by a variable that is broken up (0 = never)"));
+
+// the cost model of the dynamic-index mode: the most select/icmp
+// instructions the accesses by a variable index of one array may turn into
+static cl::opt<unsigned> DynamicIndexBudget(
+    "scalarrepl-ziangw2-dynamic-index-budget", cl::init(64), cl::Hidden,
+    cl::desc("Largest number of selects the variable-index accesses of an "
+             "array may be lowered to"));
+
+// partial-escape mode: an aggregate passed to calls that don't capture it
+// is still broken up, a temporary copy is made around each such call
+static cl::opt<bool> PartialEscape(
+    "scalarrepl-ziangw2-partial-escape", cl::init(false), cl::Hidden,
+    cl::desc("Break up aggregates passed to nocapture call arguments"));
+
+// pruned-SSA mode: the promotion is done by the pass itself instead of
+// PromoteMemToReg, with phis placed only where the alloca is live
+static cl::opt<bool> PrunedSSA(
+    "scalarrepl-ziangw2-pruned-ssa", cl::init(false), cl::Hidden,
+    cl::desc("Promote allocas with the liveness-pruned SSA construction of the pass"));
+
+// partial-promotion mode: a scalar alloca with at most N uses that can't be
+// promoted (e.g. passed to a nocapture call) lives in a register between
+// them, it is only stored before and reloaded after each of them
+static cl::opt<unsigned> PartialPromoteMax(
+    "scalarrepl-ziangw2-partial-promote-max", cl::init(0), cl::Hidden,
+    cl::desc("Largest number of escaping uses of a scalar alloca promoted "
+             "between them (0 = never)"));
+
+// field-lifetime mode: a field alloca left in memory gets lifetime markers
+// around its own uses, so that the stack slots of fields used in different
+// parts of the function can be overlapped by the backend
+static cl::opt<bool> FieldLifetimes(
+    "scalarrepl-ziangw2-field-lifetimes", cl::init(false), cl::Hidden,
+    cl::desc("Mark the lifetime of each field alloca left in memory"));
+
+// heap-to-stack mode: a malloc/calloc/new of at most N bytes whose pointer
+// doesn't escape and which is freed on every path becomes an alloca
+static cl::opt<unsigned> HeapToStackMaxSize(
+    "scalarrepl-ziangw2-heap-to-stack-max", cl::init(0), cl::Hidden,
+    cl::desc("Largest heap allocation in bytes turned into an alloca (0 = never)"));
+
+// struct-of-arrays mode: an array of structs that can't be broken up
+// becomes one array per field, so that a loop over one field is unit-stride
+static cl::opt<bool> ArrayOfStructsToSoA(
+    "scalarrepl-ziangw2-soa", cl::init(false), cl::Hidden,
+    cl::desc("Turn arrays of structs into one array per field"));
 
 
 namespace {
   struct SROA : public FunctionPass {
     static char ID; // Pass identification
-    SROA() : FunctionPass(ID) { }
+    SROA() : FunctionPass(ID), DomTreeOfFunc(NULL), AsspCacheOfFunc(NULL),
+             TLIOfFunc(NULL), VectorRegBitWidth(0) { }
 
     // Entry point for the overall scalar-replacement pass
     bool runOnFunction(Function &F);
 
     // getAnalysisUsage - List passes required by this pass.  We also know it
     // will not alter the CFG, so say so.
+    // mem2reg needs the dominator tree and the assumption cache. Since the
+    // CFG is never touched, the copies owned by the pass manager stay valid
+    // for all the iterations on a function.
+    // the vector-promotion mode asks the target for its vector width.
+    // the heap-to-stack mode recognizes the allocation functions with the
+    // target library info.
+    // the field-lifetime mode ends a lifetime where the uses are post-dominated.
     virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.addRequired<DominatorTreeWrapperPass>();
+      AU.addRequired<AssumptionCacheTracker>();
+      if (PromoteToVector) {
+        AU.addRequired<TargetTransformInfoWrapperPass>();
+      }
+      if (HeapToStackMaxSize > 0) {
+        AU.addRequired<TargetLibraryInfoWrapperPass>();
+      }
+      if (FieldLifetimes) {
+        AU.addRequired<PostDominatorTreeWrapperPass>();
+      }
       AU.setPreservesCFG();
     }
 
+    // return whether every use of Ptr, a pointer to the aggregate AggrTy,
+    // is of type U1, U2, U3, U4 or U5, so that the aggregate can be split
+    // into its fields. With OnlyFieldUses, only U1 and U2 are accepted.
+    // static, so the module passes don't need an SROA object
+    // used by canBeEliminatedStructAlloca() and by the module passes
+    static bool isSplittableAggregatePointer(const Value *Ptr, Type *AggrTy,
+                                             bool OnlyFieldUses);
+
   private:
 
+    // analyses of the function being transformed, fetched once per function
+    DominatorTree *DomTreeOfFunc;
+    AssumptionCache *AsspCacheOfFunc;
+    TargetLibraryInfo *TLIOfFunc;
+
+    // width in bits of a vector register of the target, 0 unless the
+    // vector-promotion mode is on
+    unsigned VectorRegBitWidth;
+
+    //-- the incremental worklist engine --//
+
+    // allocas whose use-lists changed since they were last examined.
+    // weak handles, because an alloca may be erased while it is still queued
+    vector<WeakTrackingVH> AllocaWorkList;
+
+    // allocas that step 2 decided not to eliminate in the current iteration
+    // they are checked for promotability by step 1
+    vector<WeakTrackingVH> PromotionCandidates;
+
+    // cached verdicts of canBeEliminatedStructAlloca() and isAllocaPromotable()
+    // an entry is dropped only when one of the users of the alloca is rewritten
+    DenseMap<const AllocaInst *, bool> EliminatableVerdicts;
+    DenseMap<const AllocaInst *, bool> PromotableVerdicts;
+    DenseMap<const AllocaInst *, bool> VectorizableVerdicts;
+
+    // the temporary aggregates made around calls in the partial-escape mode.
+    // they are passed to the same calls, so they are never broken up again
+    SmallPtrSet<const AllocaInst *, 8> EscapeTemporaries;
+
+    // drop the cached verdicts of an alloca and queue it for another look
+    void invalidateAlloca(AllocaInst *AI);
+
+    // drop the cached verdicts of an alloca that is about to be erased
+    void forgetAlloca(const AllocaInst *AI);
+
+    // canBeEliminatedStructAlloca(), isAllocaPromotable() and
+    // canBeVectorPromotedAlloca() behind the cache
+    bool isEliminatableCached(const AllocaInst *AI);
+    bool isPromotableCached(const AllocaInst *AI);
+    bool isVectorizableCached(const AllocaInst *AI);
+
+    //-- step 0: Turn small heap allocations into allocas --//
+
+    // the malloc/calloc/new calls of the function not turned into allocas yet
+    // weak handles, because a call may be erased as dead code by step 2
+    vector<WeakTrackingVH> HeapAllocCandidates;
+
+    // turn the heap allocations among HeapAllocCandidates that can live on
+    // the stack into allocas, queue them and return how many were turned
+    // the candidates that can't are kept, promoting the local that holds
+    // their pointer may make them convertible in a later iteration
+    size_t promoteHeapAllocationsToStack(Function &F);
+
+    // return whether CI allocates a fixed number of bytes, at most
+    // HeapToStackMaxSize, and is freed on all paths without escaping
+    // a helper function used in promoteHeapAllocationsToStack()
+    bool canBeStackAllocated(CallInst *CI, uint64_t &Size);
+
+    // return whether every path from CI to a return of the function, or
+    // back to CI, goes through a free of the pointer returned by CI
+    // a helper function used in canBeStackAllocated()
+    bool isFreedOnAllPaths(CallInst *CI);
+
+    // replace the heap allocation CI of Size bytes with an alloca in the
+    // entry block, drop its frees and fold its compares with null
+    // a helper function used in promoteHeapAllocationsToStack()
+    AllocaInst *convertHeapAllocationToAlloca(CallInst *CI, uint64_t Size,
+                                              Function &F);
+
     //-- step 1: Promote some scalar allocas to virtual registers --//
 
-    // promote some scalar allocas to virtual registers and 
-    // return the number of alloca instructions promoted
+    // promote the promotable allocas among PromotionCandidates to virtual
+    // registers and return the number of alloca instructions promoted
     // the first step of the iterative algorithm
     size_t promoteScalarAllocasToVirtualReg(Function &F);
 
@@ -90,9 +293,61 @@ namespace {
     // a helper function used in promoteScalarAllocasToVirtualReg()
     bool isAllocaPromotable(const AllocaInst *AI);
 
+    // the dominance frontier of every reachable block, computed once per
+    // function in the pruned-SSA mode. the CFG is never touched, so it stays
+    // valid for all the iterations on a function
+    DenseMap<BasicBlock *, SmallVector<BasicBlock *, 4>> DomFrontierOfFunc;
+
+    // whether DomFrontierOfFunc is filled. it is only done once an alloca
+    // needs the rename, it may be left empty by a function without joins
+    bool DomFrontierComputed;
+
+    // fill DomFrontierOfFunc from DomTreeOfFunc
+    // a helper function used in promoteAllocasPrunedSSA()
+    void computeDominanceFrontiers(Function &F);
+
+    // promote an alloca stored once, by a store dominating all its loads,
+    // without placing phis or renaming
+    // a helper function used in promoteAllocasPrunedSSA()
+    bool promoteSingleStoreAlloca(AllocaInst *AI, DIBuilder &DIB);
+
+    // promote all the given allocas in one sweep: phis are placed only at
+    // the iterated dominance frontier blocks where the alloca is live-in,
+    // then one walk of the dominator tree renames every alloca at once
+    // a helper function used in promoteScalarAllocasToVirtualReg()
+    size_t promoteAllocasPrunedSSA(ArrayRef<AllocaInst *> Allocas, Function &F);
+
+    // collect the blocks on entry to which the value of AI may still be read
+    // a helper function used in promoteAllocasPrunedSSA()
+    void computeLiveInBlocks(AllocaInst *AI,
+                             const SmallPtrSetImpl<BasicBlock *> &DefBlocks,
+                             const SmallPtrSetImpl<BasicBlock *> &UseBlocks,
+                             SmallPtrSetImpl<BasicBlock *> &LiveInBlocks);
+
+    // the uses of a partially promoted alloca that need it in memory, each
+    // with whether the use may write to it
+    typedef SmallVector<std::pair<Instruction *, bool>, 4> EscapePointList;
+
+    // the allocas already partially promoted. their loads and stores are
+    // now the spills and reloads, so they are never looked at again
+    SmallPtrSet<const AllocaInst *, 8> PartiallyPromoted;
+
+    // return whether AI is a scalar alloca with at most PartialPromoteMax
+    // uses that need it in memory, collected in EscapePoints, and at least
+    // one load that can be forwarded
+    // a helper function used in promoteScalarAllocasToVirtualReg()
+    bool canBePartiallyPromoted(AllocaInst *AI, EscapePointList &EscapePoints);
+
+    // promote AI to a virtual register everywhere except at EscapePoints:
+    // the current value is stored before each of them and loaded back
+    // after the ones that may write it
+    // a helper function used in promoteScalarAllocasToVirtualReg()
+    void partiallyPromoteAlloca(AllocaInst *AI, EscapePointList &EscapePoints);
+
     //-- step 2: Replace allocas with allocas of individual fields --//
 
-    // replace some struct/array allocas with allocas of individual fields
+    // drain AllocaWorkList: replace the eliminatable struct/array allocas
+    // with allocas of individual fields and hand the rest to step 1
     // return the number of alloca instructions replaced
     // the second step of the iterative algorithm
     size_t replaceStructAllocsWithIndividualFields(Function &F);
@@ -107,22 +362,76 @@ namespace {
     // It is of the form: getelementptr ptr, 0, constant[, ... constant].
     // The result of the getelementptr is only used in instructions of type U1 or U2,
     // or as the pointer argument of a load or store instruction
+    // (the getelementptr of a global may also be a constant expression)
     // a helper function used in canBeEliminatedStructAlloca()
-    bool isU1TypeGetElementPtr(const GetElementPtrInst *GEPI, const User *Val);
+    static bool isU1TypeGetElementPtr(const GEPOperator *GEPI, const Value *Val);
+
+    // return true if the given user of FieldPtr, a pointer to a field of type
+    // FieldTy, is one of: U1, U2, U3 (if the field is an aggregate), or a load
+    // or store instruction that uses FieldPtr as its pointer argument
+    // a helper function used in isU1TypeGetElementPtr() and isU3TypeBitCast()
+    static bool isU1TypeUser(const User *U, const Value *FieldPtr, Type *FieldTy);
 
     // return true if the given comparison instruction satisfy the following:
     // In a ’eq’ or ’ne’ comparison instruction,
     // where the other operand is the NULL pointer value
     // a helper function used in canBeEliminatedStructAlloca()
-    bool isU2TypeEqOrNe(const CmpInst *CI, const User *Val);
+    static bool isU2TypeEqOrNe(const CmpInst *CI, const Value *Val);
+
+    // return true if the given bitcast instruction satisfy the following:
+    // It casts Val, a pointer to the aggregate AggrTy, to another pointer.
+    // Each user of the result is one of: the destination of a non-volatile
+    // memset that writes the whole aggregate with a constant byte, one side
+    // of a non-volatile memcpy of the whole aggregate from/to another object,
+    // a lifetime marker of the whole aggregate, or, if the bitcast is to a
+    // pointer to the leading field (at offset 0), a U1 type user of it
+    // a helper function used in canBeEliminatedStructAlloca()
+    static bool isU3TypeBitCast(const BitCastInst *BCI, const Value *Val,
+                                Type *AggrTy);
+
+    // return true if the given instruction satisfy the following:
+    // It is a non-volatile, non-atomic load of the whole aggregate from Val,
+    // or a non-volatile, non-atomic store of a whole aggregate value to Val
+    // a helper function used in canBeEliminatedStructAlloca()
+    static bool isU4TypeLoadOrStore(const Instruction *I, const Value *Val);
+
+    // return true if the given call instruction satisfy the following:
+    // In the partial-escape mode, it passes Val, a pointer to the whole
+    // aggregate, only as arguments that are marked nocapture
+    // a helper function used in canBeEliminatedStructAlloca()
+    static bool isU5TypeCallArgument(const CallInst *CI, const Value *Val);
+
+    // return true if the given intrinsic is a lifetime.start/end that covers
+    // all AggrSize bytes of the object
+    // a helper function used in isU3TypeBitCast()
+    static bool isWholeObjectLifetimeMarker(const IntrinsicInst *II, uint64_t AggrSize);
+
+    // return how many leading fields (field 0 of field 0 of ...) one has to
+    // step into to go from AggrTy to LeadTy, or 0 if LeadTy isn't one of them
+    // a helper function used in isU3TypeBitCast() and replaceU3TypeBitCast()
+    static unsigned getLeadingFieldDepth(Type *AggrTy, Type *LeadTy);
+
+    // return the constant of type Ty whose every byte is Byte, which is
+    // what a memset of Byte leaves in an object of type Ty
+    // return NULL if there is no such constant
+    // a helper function used in isU3TypeBitCast()
+    static Constant *getMemSetValueOfType(Type *Ty, ConstantInt *Byte);
 
     //-- step 2.2 : eliminate the aggregate alloca --//
 
     // actually eliminate the struct alloca
     // replace it with allocas of individual fields
-    // return a vector of sub-aggregate types
+    // the new field allocas are appended to NewAllocas
     // a helper function used in replaceStructAllocsWithIndividualFields()
-    vector<AllocaInst *> * eliminateStructAlloca(AllocaInst *AI, Function &F);
+    void eliminateStructAlloca(AllocaInst *AI,
+                               Function &F,
+                               vector<AllocaInst *> &NewAllocas);
+
+    // mark the fields of the given alloca that are ever read or have their
+    // address taken. the other fields are at most written as part of the
+    // whole aggregate, so they don't need an alloca
+    // a helper function used in eliminateStructAlloca()
+    void markAccessedFields(const AllocaInst *AI, vector<bool> &FieldIsAccessed);
 
     // when eliminating an alloca, the U1 type getelementptr use should be
     // modified apropriately
@@ -137,6 +446,121 @@ namespace {
     void replaceU2TypeEqOrNe(CmpInst *CI,
                              Function &F,
                              vector<AllocaInst *> &NewAllocs);
+
+    // when eliminating an alloca, the U3 type bitcast use should be
+    // modified apropriately: the memcpy/memset are split into one load/store
+    // (scalar field) or one smaller memcpy/memset (aggregate field, split
+    // again in a later round) per field, the lifetime markers are copied to
+    // every field, and the remaining users are moved to the leading field
+    // a helper function used in eliminateStructAlloca()
+    void replaceU3TypeBitCast(BitCastInst *BCI,
+                              Function &F,
+                              vector<AllocaInst *> &NewAllocs);
+
+    // when eliminating an alloca, the U4 type load/store use should be
+    // modified apropriately: a load becomes one load per field combined
+    // with insertvalue, a store becomes extractvalue and one store per field
+    // a helper function used in eliminateStructAlloca()
+    void replaceU4TypeLoadOrStore(Instruction *I,
+                                  Function &F,
+                                  vector<AllocaInst *> &NewAllocs);
+
+    // when eliminating an alloca, the U5 type call use should be
+    // modified apropriately: the fields are stored to TempAggr before the
+    // call, the call is given TempAggr instead, and unless the arguments
+    // are readonly the fields are loaded back after the call
+    // a helper function used in eliminateStructAlloca()
+    void replaceU5TypeCallArgument(CallInst *CI,
+                                   AllocaInst *AI,
+                                   AllocaInst *TempAggr,
+                                   Function &F,
+                                   vector<AllocaInst *> &NewAllocs);
+
+    // when eliminating an alloca, its llvm.dbg.declare should be replaced
+    // by one llvm.dbg.declare of the matching fragment per new field alloca
+    // a helper function used in eliminateStructAlloca()
+    void splitDbgDeclares(AllocaInst *AI,
+                          Function &F,
+                          vector<AllocaInst *> &NewAllocs);
+
+    //-- step 2.3 : promote the aggregate alloca to a vector alloca --//
+
+    // return whether the given alloca instruction can become a single
+    // vector alloca: every element has the same int/fp type, the whole
+    // aggregate fits in a vector register and every element is only
+    // loaded or stored through a getelementptr of the form ptr, 0, constant
+    // a helper function used in replaceStructAllocsWithIndividualFields()
+    bool canBeVectorPromotedAlloca(const AllocaInst *AI);
+
+    // replace the aggregate alloca with one vector alloca, the element
+    // loads and stores become extractelement and insertelement
+    // the new vector alloca is appended to NewAllocas
+    // a helper function used in replaceStructAllocsWithIndividualFields()
+    void vectorPromoteAlloca(AllocaInst *AI,
+                             Function &F,
+                             vector<AllocaInst *> &NewAllocas);
+
+    //-- step 2.4 : arrays indexed by a variable --//
+
+    // return the cost (number of icmp/select) of the given getelementptr
+    // instruction, or 0 if it isn't of the following form:
+    // getelementptr ptr, 0, variable, into Val, a small array of scalars,
+    // only used as the pointer argument of non-volatile loads and stores
+    // a helper function used in canBeEliminatedStructAlloca()
+    static unsigned getDynamicIndexCost(const GetElementPtrInst *GEPI, const Value *Val);
+
+    // when eliminating an alloca, the getelementptr with a variable index
+    // should be modified apropriately: a load selects the loaded element
+    // among all of them, a store updates every element with a select
+    // a helper function used in eliminateStructAlloca()
+    void replaceDynamicIndexGetElementPtr(GetElementPtrInst *GEPI,
+                                          Function &F,
+                                          vector<AllocaInst *> &NewAllocs);
+
+    //-- step 2.5 : arrays of structs to arrays of fields --//
+
+    // return whether the given alloca instruction is an array of structs
+    // whose elements are only reached through their fields, the index of
+    // the element may be a variable. Each user is one of:
+    // getelementptr ptr, 0, index, constant[, ...], getelementptr ptr, 0,
+    // index only used by getelementptr elem, 0, constant[, ...], or a
+    // bitcast only used by lifetime markers and memsets of the whole array
+    // a helper function used in replaceStructAllocsWithIndividualFields()
+    bool canBeSplitArrayOfStructs(const AllocaInst *AI);
+
+    // replace the array of structs with one array per field
+    // the new field arrays are appended to NewAllocas
+    // a helper function used in replaceStructAllocsWithIndividualFields()
+    void splitArrayOfStructs(AllocaInst *AI,
+                             Function &F,
+                             vector<AllocaInst *> &NewAllocas);
+
+    // when splitting an array of structs, a getelementptr to a field of an
+    // element should index the array of the field instead:
+    // getelementptr ..., index, field, a, ... -> getelementptr array, 0, index, a, ...
+    // a helper function used in splitArrayOfStructs()
+    void replaceArrayOfStructsGetElementPtr(GetElementPtrInst *GEPI,
+                                            Value *Index,
+                                            unsigned FieldOperandNo,
+                                            bool InBounds,
+                                            vector<AllocaInst *> &FieldArrays);
+
+    //-- after the iterations: lifetime markers of the field allocas --//
+
+    // the field allocas made by step 2 in the field-lifetime mode. weak
+    // handles, because a field may be broken up or promoted afterwards
+    vector<WeakTrackingVH> SplitFieldAllocas;
+
+    // give every field alloca still in memory, whose address isn't captured
+    // and which has no lifetime markers yet, lifetime markers around its
+    // uses. return the number of field allocas marked
+    size_t markFieldLifetimes(Function &F);
+
+    // return the instructions using the memory of AI, i.e. its users through
+    // bitcasts and getelementptrs, or false if one of them is a phi or a
+    // select or a lifetime marker, whose range can't be told
+    // a helper function used in markFieldLifetimes()
+    bool collectMemoryUses(AllocaInst *AI, SmallPtrSetImpl<Instruction *> &Uses);
   };  // end of struct SROA
 }
 
@@ -173,6 +597,53 @@ bool SROA::runOnFunction(Function &F) {
   // the top-level of my pass iteratively performs the two steps until no more changes
   // 1. prmote some scalar allocas to virtual registers (mem2reg)
   // 2. replace some struct/array allocas with allocas of individual fields
+  // in the heap-to-stack mode, step 0 first turns the heap allocations
+  // that can live on the stack into allocas for step 2
+  //
+  // the function is scanned for allocas only once, here. Afterwards both
+  // steps only look at the allocas on the worklist: the ones created by
+  // step 2 and the ones whose users were rewritten by step 1 or step 2.
+  // so the total work is linear in the number of rewrites.
+
+  AllocaWorkList.clear();
+  PromotionCandidates.clear();
+  HeapAllocCandidates.clear();
+  PartiallyPromoted.clear();
+  SplitFieldAllocas.clear();
+  EliminatableVerdicts.clear();
+  PromotableVerdicts.clear();
+  VectorizableVerdicts.clear();
+  EscapeTemporaries.clear();
+
+  DomTreeOfFunc = &getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+  AsspCacheOfFunc = &getAnalysis<AssumptionCacheTracker>().getAssumptionCache(F);
+
+  VectorRegBitWidth = 0;
+  if (PromoteToVector) {
+    const TargetTransformInfo &TTI =
+      getAnalysis<TargetTransformInfoWrapperPass>().getTTI(F);
+    VectorRegBitWidth = TTI.getRegisterBitWidth(
+                        TargetTransformInfo::RGK_FixedWidthVector).getFixedSize();
+  }
+
+  DomFrontierOfFunc.clear();
+  DomFrontierComputed = false;
+
+  TLIOfFunc = NULL;
+  if (HeapToStackMaxSize > 0) {
+    TLIOfFunc = &getAnalysis<TargetLibraryInfoWrapperPass>().getTLI(F);
+  }
+
+  for (BasicBlock &BB : F) {
+    for (Instruction &I : BB) {
+      if (AllocaInst *AI = dyn_cast<AllocaInst>(&I)) {
+        AllocaWorkList.push_back(AI);
+      } else if (TLIOfFunc != NULL && isa<CallInst>(&I) &&
+                 isMallocOrCallocLikeFn(/*V=*/&I, /*TLI=*/TLIOfFunc)) {
+        HeapAllocCandidates.push_back(&I);
+      }
+    }
+  }
 
   bool Changed = false;
   bool ChangedOneIteration = false;
@@ -182,592 +653,5006 @@ bool SROA::runOnFunction(Function &F) {
     errs() << "One iteration on function\n";
     #endif
 
+    size_t HeapCount = promoteHeapAllocationsToStack(F);
     size_t ReplacementCount = replaceStructAllocsWithIndividualFields(F);
     size_t PromoteCount = promoteScalarAllocasToVirtualReg(F);
 
-    ChangedOneIteration = (ReplacementCount > 0) || (PromoteCount > 0);
+    ChangedOneIteration = (HeapCount > 0) || (ReplacementCount > 0) ||
+                          (PromoteCount > 0);
     Changed = Changed || ChangedOneIteration;
   } while (ChangedOneIteration);
 
+  // the fields left in memory only need their stack slots around their uses
+
+  if (FieldLifetimes && markFieldLifetimes(/*F=*/F) > 0) {
+    Changed = true;
+  }
+
+  // the verdicts and the analyses are only valid for this function
+
+  EliminatableVerdicts.clear();
+  PromotableVerdicts.clear();
+  VectorizableVerdicts.clear();
+  EscapeTemporaries.clear();
+  DomFrontierOfFunc.clear();
+  HeapAllocCandidates.clear();
+  PartiallyPromoted.clear();
+  SplitFieldAllocas.clear();
+  DomTreeOfFunc = NULL;
+  AsspCacheOfFunc = NULL;
+  TLIOfFunc = NULL;
+
   return Changed;
 }
 
 
 //===----------------------------------------------------------------------===//
-//        step 1: prmote some scalar allocas to virtual registers
+//                      the incremental worklist engine
 //===----------------------------------------------------------------------===//
-// 
-
+//
 
-// promote some scalar allocas to virtual registers and 
-// return the number of alloca instructions promoted
-// the first step of the iterative algorithm
-size_t SROA::promoteScalarAllocasToVirtualReg(Function &F) {
 
-  // iterate over every instruction in the function
-  // find all the promotable allocas instructions and store them in PromAllocaOfFunc
+// drop the cached verdicts of an alloca and queue it for another look
+// it is called whenever one of the users of the alloca is rewritten
+void SROA::invalidateAlloca(AllocaInst *AI) {
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "invalidateAlloca: [" << *AI << "]\n";
+  #endif
 
-  vector<AllocaInst *> VecPromAllocaOfFunc;
+  forgetAlloca(/*AI=*/AI);
+  AllocaWorkList.push_back(AI);
+}
 
-  for (BasicBlock &BB : F) {
-    for (Instruction &I : BB) {
 
-      // only alloca instructions are promotable
-      if (AllocaInst *AI = dyn_cast<AllocaInst>(&I)) {
-        if (SROA::isAllocaPromotable(/*AI=*/AI)) {
+// drop the cached verdicts of an alloca that is about to be erased
+// otherwise a new alloca allocated at the same address would inherit them
+void SROA::forgetAlloca(const AllocaInst *AI) {
+  EliminatableVerdicts.erase(AI);
+  PromotableVerdicts.erase(AI);
+  VectorizableVerdicts.erase(AI);
+}
 
-          #ifdef _SROA_ZIANG_DEBUG
-          errs() << "Promotable: [" << *AI << "]\n";
-          #endif
 
-          // safety check against the llvm isAllocaPromotable
-          // make sure that my algorithm is as strict as the llvm one
+// canBeEliminatedStructAlloca() behind the verdict cache
+bool SROA::isEliminatableCached(const AllocaInst *AI) {
+  auto It = EliminatableVerdicts.find(AI);
+  if (It != EliminatableVerdicts.end()) {
+    return It->second;
+  }
 
-          assert(llvm::isAllocaPromotable(/*AI=*/AI) &&
-                 "SROA::isAllocaPromotable wrong result.");
+  bool Verdict = canBeEliminatedStructAlloca(/*AI=*/AI);
+  EliminatableVerdicts[AI] = Verdict;
+  return Verdict;
+}
 
-          VecPromAllocaOfFunc.push_back(AI);
-        }
-      }
 
-    }
+// isAllocaPromotable() behind the verdict cache
+bool SROA::isPromotableCached(const AllocaInst *AI) {
+  auto It = PromotableVerdicts.find(AI);
+  if (It != PromotableVerdicts.end()) {
+    return It->second;
   }
 
-  size_t NumAllocToProm = VecPromAllocaOfFunc.size();
-
-  // do the mem2reg pass only if the vector isn't empty
-
-  if (NumAllocToProm > 0) {
-    DominatorTree DomTreeOfFunc(F);
-    AssumptionCache AsspCacheOfFunc(F);
-    ArrayRef<AllocaInst *> ArrayRefPromAllocaOfFunc(VecPromAllocaOfFunc);
+  bool Verdict = isAllocaPromotable(/*AI=*/AI);
+  PromotableVerdicts[AI] = Verdict;
+  return Verdict;
+}
 
-    PromoteMemToReg(/*Allocas=*/ArrayRefPromAllocaOfFunc,
-                    /*DT=*/DomTreeOfFunc, /*AC=*/&AsspCacheOfFunc);
 
-    // update the llvm STATISTIC
-    NumPromoted += NumAllocToProm;
+// canBeVectorPromotedAlloca() behind the verdict cache
+bool SROA::isVectorizableCached(const AllocaInst *AI) {
+  auto It = VectorizableVerdicts.find(AI);
+  if (It != VectorizableVerdicts.end()) {
+    return It->second;
   }
 
-  return NumAllocToProm;
+  bool Verdict = canBeVectorPromotedAlloca(/*AI=*/AI);
+  VectorizableVerdicts[AI] = Verdict;
+  return Verdict;
 }
 
 
-// it will return true if the alloca instruction can be promoted or false otherwise
-// a helper function used in promoteScalarAllocasToVirtualReg()
-bool SROA::isAllocaPromotable(const AllocaInst *AI) {
+//===----------------------------------------------------------------------===//
+//           step 0: turn small heap allocations into allocas
+//===----------------------------------------------------------------------===//
+//
 
-  #ifdef _SROA_ZIANG_DEBUG
-  errs() << "isAllocaPromotable: [" << *AI << "]\n";
-  #endif
 
-  // an alloca instruction is promotable to live in a register
-  // if the alloca satisfies all these requirements:
-  // (P1) The alloca is a “first-class” type, which you can approximate conservatively with
-  // isFPOrFPVectorTy() || isIntOrIntVectorTy() || isPtrOrPtrVectorTy.
-  
-  Type *AllocType = AI->getAllocatedType();
-  bool IsFirstClsType = AllocType->isFPOrFPVectorTy() ||
-                        AllocType->isIntOrIntVectorTy() ||
-                        AllocType->isPtrOrPtrVectorTy();
+// the alignment malloc guarantees on the usual 64-bit targets. code may cast
+// the pointer to any type, so the alloca is aligned at least as much
+static const unsigned MallocAlignment = 16;
 
-  if (!IsFirstClsType) {
-    return false;
-  }
 
-  // (P2) The alloca is only used in a load or store instruction and
-  // the instruction satisfies !isVolatile().
-  // important clarification: alloca must be used as the pointer argument of the load or store.
+// turn the heap allocations among HeapAllocCandidates that can live on
+// the stack into allocas, queue them and return how many were turned
+// step 0 of the iterative algorithm, only in the heap-to-stack mode
+size_t SROA::promoteHeapAllocationsToStack(Function &F) {
 
-  for (const User *U : AI->users()) {
-    if (const LoadInst *LI = dyn_cast<LoadInst>(U)) {
-      if (LI->isVolatile() || LI->getOperand(0) != AI) {
-        return false;
-      }
-    } else if (const StoreInst *SI = dyn_cast<StoreInst>(U)) {
-      if (SI->isVolatile() || SI->getOperand(1) != AI) {
-        return false;
-      }
-    } else {
-      return false;
+  // the candidates that can't be turned yet are looked at again in the
+  // next iteration, e.g. at -O0 the pointer is first stored to a local
+  // and only becomes a plain SSA value once step 1 has promoted it
+
+  size_t HeapCount = 0;
+  vector<WeakTrackingVH> CandidatesLeft;
+
+  for (WeakTrackingVH &CandidateVH : HeapAllocCandidates) {
+    CallInst *CI = dyn_cast_or_null<CallInst>(CandidateVH);
+    if (CI == NULL) {
+      continue;
+    }
+
+    uint64_t Size = 0;
+    if (!canBeStackAllocated(/*CI=*/CI, /*Size=*/Size)) {
+      CandidatesLeft.push_back(CI);
+      continue;
     }
+
+    #ifdef _SROA_ZIANG_DEBUG
+    errs() << "Heap allocation to alloca: [" << *CI << "]\n";
+    #endif
+
+    AllocaInst *NewAlloca = convertHeapAllocationToAlloca(/*CI=*/CI,
+                                                          /*Size=*/Size, /*F=*/F);
+    AllocaWorkList.push_back(NewAlloca);
+    ++HeapCount;
   }
 
-  return true;
+  HeapAllocCandidates.swap(CandidatesLeft);
+
+  // update the llvm STATISTIC
+  NumHeapToStack += HeapCount;
+
+  return HeapCount;
 }
 
 
-//===----------------------------------------------------------------------===//
-//            step 2: replace some struct/array allocas
-//                    with allocas of individual fields
-//===----------------------------------------------------------------------===//
-// 
+// return whether CI allocates a fixed number of bytes, at most
+// HeapToStackMaxSize, and is freed on all paths without escaping.
+// the pointer, or a bitcast / getelementptr of it, may only be:
+// the pointer operand of a load or store, the destination or source of a
+// memset/memcpy/memmove, an argument of a lifetime marker, the argument of
+// a free, or compared with null
+// a helper function used in promoteHeapAllocationsToStack()
+bool SROA::canBeStackAllocated(CallInst *CI, uint64_t &Size) {
 
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "canBeStackAllocated: [" << *CI << "]\n";
+  #endif
 
-// replace some struct/array allocas with allocas of individual fields
-// the second step of the iterative algorithm
-size_t SROA::replaceStructAllocsWithIndividualFields(Function &F) {
+  const DataLayout &DL = CI->getModule()->getDataLayout();
 
-  // iterate over the function to identify the first set of allocas to 
-  // be eliminated
+  if (!isAllocRemovable(/*V=*/CI, /*TLI=*/TLIOfFunc) ||
+      !getObjectSize(/*Ptr=*/CI, /*Size=*/Size, /*DL=*/DL, /*TLI=*/TLIOfFunc) ||
+      Size == 0 || Size > HeapToStackMaxSize) {
+    return false;
+  }
 
-  vector<AllocaInst *> VecElimatableStructAlloca;
+  // aligned_alloc: the alignment has to be known to align the alloca
 
-  for (BasicBlock &BB : F) {
-    for (Instruction &I : BB) {
-      if (AllocaInst *AI = dyn_cast<AllocaInst>(&I)) {
-        if (canBeEliminatedStructAlloca(/*AI=*/AI)) {
-          VecElimatableStructAlloca.push_back(AI);
-        }
-      }
+  Value *AlignArg = getAllocAlignment(/*V=*/CI, /*TLI=*/TLIOfFunc);
+  if (AlignArg != NULL) {
+    ConstantInt *AlignConstInt = dyn_cast<ConstantInt>(AlignArg);
+    if (AlignConstInt == NULL || !isPowerOf2_64(AlignConstInt->getZExtValue())) {
+      return false;
     }
   }
 
-  // then, use a worklist-style algorithm to eliminate allocas
-  // notice, only newly generated allocas can be eliminatable
+  vector<Value *> PtrWorkList;
+  PtrWorkList.push_back(CI);
 
-  size_t ReplacementCount = 0;
+  while (!PtrWorkList.empty()) {
+    Value *Ptr = PtrWorkList.back();
+    PtrWorkList.pop_back();
+
+    for (User *U : Ptr->users()) {
+      if (isa<BitCastInst>(U) || isa<GetElementPtrInst>(U)) {
+        PtrWorkList.push_back(U);
+      } else if (LoadInst *LI = dyn_cast<LoadInst>(U)) {
+        if (LI->isVolatile()) {
+          return false;
+        }
+      } else if (StoreInst *SI = dyn_cast<StoreInst>(U)) {
 
-  while (VecElimatableStructAlloca.size() > 0) {
-    AllocaInst *AIToBeEliminated = VecElimatableStructAlloca.back();
-    VecElimatableStructAlloca.pop_back();
+        // storing the pointer itself is an escape
 
-    vector<AllocaInst *> *SubAggrAllocas = eliminateStructAlloca(
-                                           /*AI=*/AIToBeEliminated,
-                                           /*F=*/F);
-    ReplacementCount += 1;
+        if (SI->isVolatile() || SI->getPointerOperand() != Ptr) {
+          return false;
+        }
+      } else if (ICmpInst *ICI = dyn_cast<ICmpInst>(U)) {
 
-    // append eligible sub aggregate allocas to the worklist
+        // only the pointer returned by the call is known to be non-null
 
-    if (SubAggrAllocas != NULL) {
-      for (AllocaInst *SubAggrAlloca : *SubAggrAllocas) {
-        if (canBeEliminatedStructAlloca(/*AI=*/SubAggrAlloca)) {
-          VecElimatableStructAlloca.push_back(SubAggrAlloca);
+        Value *Other = ICI->getOperand(0) == Ptr ? ICI->getOperand(1) :
+                                                   ICI->getOperand(0);
+        if (!ICI->isEquality() || !isa<ConstantPointerNull>(Other) ||
+            Ptr->stripPointerCasts() != CI) {
+          return false;
+        }
+      } else if (MemIntrinsic *MI = dyn_cast<MemIntrinsic>(U)) {
+        if (MI->isVolatile()) {
+          return false;
+        }
+      } else if (IntrinsicInst *II = dyn_cast<IntrinsicInst>(U)) {
+        if (!II->isLifetimeStartOrEnd()) {
+          return false;
+        }
+      } else if (CallInst *FreeCI = isFreeCall(/*I=*/U, /*TLI=*/TLIOfFunc)) {
+        if (FreeCI->getArgOperand(0)->stripPointerCasts() != CI) {
+          return false;
         }
+      } else {
+        return false;
       }
     }
-
-    free(SubAggrAllocas);
   }
 
-  // update LLVM STATISTIC NumReplaced
-  NumReplaced += ReplacementCount;
-
-  return ReplacementCount;
+  return isFreedOnAllPaths(/*CI=*/CI);
 }
 
 
-//===----------------------------------------------------------------------===//
-//         step 2.1: determine whether an alloca is eliminatable or not
-//===----------------------------------------------------------------------===//
-//
-
-
-// return whether the given alloca instruction can be eliminated or not
-// a helper function used in replaceStructAllocsWithIndividualFields()
-bool SROA::canBeEliminatedStructAlloca(const AllocaInst *AI) {
-  #ifdef _SROA_ZIANG_DEBUG
-  errs() << "canBeEliminatedStructAlloca: [" << *AI << "]\n";
-  #endif
+// return whether every path from CI to a return of the function, or
+// back to CI, goes through a free of the pointer returned by CI.
+// the alloca lives in the entry block, so in a loop the object of one
+// iteration has to be dead before the next one allocates it again.
+// a path into a branch on the pointer being null only follows the
+// non-null edge, since free(NULL) is often skipped that way
+// a helper function used in canBeStackAllocated()
+bool SROA::isFreedOnAllPaths(CallInst *CI) {
 
-  // type check
+  SmallPtrSet<BasicBlock *, 32> VisitedBlocks;
+  vector<Instruction *> PathWorkList;
+  PathWorkList.push_back(CI->getNextNode());
 
-  if (!AI->getAllocatedType()->isStructTy()) {
-    return false;
-  }
+  while (!PathWorkList.empty()) {
+    Instruction *First = PathWorkList.back();
+    PathWorkList.pop_back();
 
-  // the resulting pointer is used only in two ways: U1 and U2
+    bool Freed = false;
+    BasicBlock::iterator It(First);
+    BasicBlock *BB = First->getParent();
 
-  for (const User *U : AI->users()) {
-    if (const GetElementPtrInst *GEPI = dyn_cast<GetElementPtrInst>(U)) {
-      if (!isU1TypeGetElementPtr(/*GEPI=*/GEPI, /*Val=*/AI)) {
-        #ifdef _SROA_ZIANG_DEBUG
-        errs() << "Not U1: [" << *U << "]\n";
-        #endif
+    for (; &*It != BB->getTerminator(); ++It) {
+      if (&*It == CI) {
         return false;
       }
-    } else if (const CmpInst *CI = dyn_cast<CmpInst>(U)) {
-      if (!isU2TypeEqOrNe(/*CI=*/CI, /*Val=*/AI)) {
-        #ifdef _SROA_ZIANG_DEBUG
-        errs() << "Not U2: [" << *U << "]\n";
-        #endif
-        return false;
+      CallInst *FreeCI = isFreeCall(/*I=*/&*It, /*TLI=*/TLIOfFunc);
+      if (FreeCI != NULL && FreeCI->getArgOperand(0)->stripPointerCasts() == CI) {
+        Freed = true;
+        break;
       }
-    } else {
-      #ifdef _SROA_ZIANG_DEBUG
-      errs() << "Not U1 or U2: [" << *U << "]\n";
-      #endif
+    }
+
+    if (Freed) {
+      continue;
+    }
+
+    Instruction *Term = BB->getTerminator();
+    if (isa<ReturnInst>(Term) || isa<ResumeInst>(Term)) {
       return false;
     }
+
+    SmallVector<BasicBlock *, 4> Succs(successors(BB));
+
+    BranchInst *BI = dyn_cast<BranchInst>(Term);
+    if (BI != NULL && BI->isConditional()) {
+      ICmpInst *ICI = dyn_cast<ICmpInst>(BI->getCondition());
+      if (ICI != NULL && ICI->isEquality() &&
+          isa<ConstantPointerNull>(ICI->getOperand(1)) &&
+          ICI->getOperand(0)->stripPointerCasts() == CI) {
+        Succs.clear();
+        Succs.push_back(BI->getSuccessor(
+                        ICI->getPredicate() == ICmpInst::ICMP_EQ ? 1 : 0));
+      }
+    }
+
+    for (BasicBlock *Succ : Succs) {
+      if (VisitedBlocks.insert(Succ).second) {
+        PathWorkList.push_back(&Succ->front());
+      }
+    }
   }
 
-  #ifdef _SROA_ZIANG_DEBUG
-  errs() << "Eliminatable Struct Alloca: [" << *AI << "]\n";
-  #endif
   return true;
 }
 
 
-// return true if the given getelementptr instruction satisfy the following:
-// 1. It is of the form: getelementptr ptr, 0, constant[, ... constant].
-// 2. The result of the getelementptr is only used in instructions of type U1 or U2,
-// or as the pointer argument of a load or store instruction
-// a helper function used in canBeEliminatedStructAlloca()
-bool SROA::isU1TypeGetElementPtr(const GetElementPtrInst *GEPI, const User *Val) {
-  #ifdef _SROA_ZIANG_DEBUG
-  errs() << "isU1TypeGetElementPtr: [" << *GEPI << "]\n";
-  #endif
+// replace the heap allocation CI of Size bytes with an alloca in the
+// entry block, drop its frees and fold its compares with null.
+// the alloca gets the struct type the pointer is cast to if it has the
+// same size, so that step 2 can break it up, and a byte array otherwise
+// a helper function used in promoteHeapAllocationsToStack()
+AllocaInst *SROA::convertHeapAllocationToAlloca(CallInst *CI, uint64_t Size,
+                                                Function &F) {
 
-  // 1. check its operands are ptr, 0, constant [, ... constant]
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  LLVMContext &Context = F.getContext();
 
-  unsigned NumOperands = GEPI->getNumOperands();
-  if (NumOperands < 3) {
-    return false;
+  Type *AllocaTy = NULL;
+  for (User *U : CI->users()) {
+    BitCastInst *BCI = dyn_cast<BitCastInst>(U);
+    if (BCI == NULL) {
+      continue;
+    }
+    Type *PointeeTy = BCI->getType()->getPointerElementType();
+    if (PointeeTy->isSized() && DL.getTypeAllocSize(PointeeTy) == Size) {
+      AllocaTy = PointeeTy;
+      break;
+    }
+  }
+  if (AllocaTy == NULL) {
+    AllocaTy = ArrayType::get(Type::getInt8Ty(Context), Size);
   }
 
-  if (GEPI->getOperand(0) != Val) {
-    return false;
+  Align AllocaAlign = std::max(DL.getPrefTypeAlign(AllocaTy), Align(MallocAlignment));
+  if (ConstantInt *AlignConstInt = dyn_cast_or_null<ConstantInt>(
+                                   getAllocAlignment(/*V=*/CI, /*TLI=*/TLIOfFunc))) {
+    AllocaAlign = std::max(AllocaAlign, Align(AlignConstInt->getZExtValue()));
   }
 
-  ConstantInt *GEPIOperand1ConstInt = dyn_cast<ConstantInt>(GEPI->getOperand(1));
-  if (GEPIOperand1ConstInt == NULL || !GEPIOperand1ConstInt->isZero()) {
-    return false;
+  BasicBlock &EntryBB = F.getEntryBlock();
+  AllocaInst *NewAlloca = new AllocaInst(/*Ty=*/AllocaTy,
+                                         /*AddrSpace=*/DL.getAllocaAddrSpace(),
+                                         /*ArraySize=*/NULL,
+                                         /*Align=*/AllocaAlign,
+                                         /*Name=*/CI->getName() + ".stack",
+                                         /*InsertBefore=*/&*EntryBB.getFirstInsertionPt());
+
+  // calloc: clear the object where it used to be allocated
+
+  Constant *InitVal = getInitialValueOfAllocation(/*Alloc=*/CI, /*TLI=*/TLIOfFunc,
+                                                  /*Ty=*/Type::getInt8Ty(Context));
+  if (InitVal != NULL && !isa<UndefValue>(InitVal)) {
+    IRBuilder<> Builder(CI);
+    Builder.CreateMemSet(/*Ptr=*/NewAlloca, /*Val=*/InitVal, /*Size=*/Size,
+                         /*Align=*/MaybeAlign(AllocaAlign));
   }
 
-  for (unsigned i = 2; i < NumOperands; ++i) {
-    if (!isa<Constant>(GEPI->getOperand(i))) {
-      return false;
+  // the frees are dropped and the object is never null, then the casts to
+  // the alloca type become the alloca itself
+
+  vector<Value *> PtrWorkList;
+  vector<Instruction *> InstsToErase;
+  PtrWorkList.push_back(CI);
+
+  while (!PtrWorkList.empty()) {
+    Value *Ptr = PtrWorkList.back();
+    PtrWorkList.pop_back();
+
+    for (User *U : Ptr->users()) {
+      if (isa<BitCastInst>(U) || isa<GetElementPtrInst>(U)) {
+        PtrWorkList.push_back(U);
+      } else if (ICmpInst *ICI = dyn_cast<ICmpInst>(U)) {
+        ICI->replaceAllUsesWith(ConstantInt::get(ICI->getType(),
+                                ICI->getPredicate() == ICmpInst::ICMP_NE));
+        InstsToErase.push_back(ICI);
+      } else if (isFreeCall(/*I=*/U, /*TLI=*/TLIOfFunc) != NULL) {
+        InstsToErase.push_back(cast<Instruction>(U));
+      }
     }
   }
 
-  // 2. check that the result is only used in U1, U2, load, store (not of but into)
-
-  for (const User *U : GEPI->users()) {
-    if (const GetElementPtrInst *UGEPI = dyn_cast<GetElementPtrInst>(U)) {
-      if (!isU1TypeGetElementPtr(/*GEPI=*/UGEPI, /*Val=*/GEPI)) {
-        return false;
-      }
-    } else if (const CmpInst *CI = dyn_cast<CmpInst>(U)) {
-      if (!isU2TypeEqOrNe(/*CI=*/CI, /*Val=*/GEPI)) {
-        return false;
-      }
-    } else if (const LoadInst *LI = dyn_cast<LoadInst>(U)) {
+  for (Instruction *I : InstsToErase) {
+    I->eraseFromParent();
+  }
 
-      // need to ensure that GEPI actually is the pointer argument of the load
+  for (User *U : make_early_inc_range(CI->users())) {
+    BitCastInst *BCI = dyn_cast<BitCastInst>(U);
+    if (BCI != NULL && BCI->getType() == NewAlloca->getType()) {
+      BCI->replaceAllUsesWith(NewAlloca);
+      BCI->eraseFromParent();
+    }
+  }
+
+  if (!CI->use_empty()) {
+    BitCastInst *NewBCI = new BitCastInst(/*S=*/NewAlloca, /*Ty=*/CI->getType(),
+                                          /*NameStr=*/CI->getName() + ".cast",
+                                          /*InsertBefore=*/NewAlloca->getNextNode());
+    CI->replaceAllUsesWith(NewBCI);
+  }
+
+  CI->eraseFromParent();
+
+  return NewAlloca;
+}
+
+
+//===----------------------------------------------------------------------===//
+//        step 1: prmote some scalar allocas to virtual registers
+//===----------------------------------------------------------------------===//
+// 
+
+
+// return the number of phi nodes in F
+static size_t countPhiNodes(Function &F) {
+  size_t Count = 0;
+  for (BasicBlock &BB : F) {
+    Count += std::distance(BB.phis().begin(), BB.phis().end());
+  }
+  return Count;
+}
+
+
+// promote the promotable allocas among PromotionCandidates to virtual
+// registers and return the number of alloca instructions promoted
+// the first step of the iterative algorithm
+size_t SROA::promoteScalarAllocasToVirtualReg(Function &F) {
+
+  // only the candidates handed over by step 2 need to be looked at
+  // find all the promotable allocas instructions and store them in PromAllocaOfFunc
+  // the same alloca may have been queued twice, so filter duplicates
+
+  vector<AllocaInst *> VecPromAllocaOfFunc;
+  SmallPtrSet<AllocaInst *, 16> SeenCandidates;
+
+  // in the partial-promotion mode, the scalar allocas that are not
+  // promotable only because of a few uses are promoted between them
+
+  vector<AllocaInst *> VecPartialAllocaOfFunc;
+  vector<EscapePointList> VecEscapePoints;
+
+  for (WeakTrackingVH &CandidateVH : PromotionCandidates) {
+
+    // the candidate may have been erased after it was queued
+    AllocaInst *AI = dyn_cast_or_null<AllocaInst>(CandidateVH);
+    if (AI == NULL || !SeenCandidates.insert(AI).second) {
+      continue;
+    }
+
+    if (isPromotableCached(/*AI=*/AI)) {
+
+      #ifdef _SROA_ZIANG_DEBUG
+      errs() << "Promotable: [" << *AI << "]\n";
+      #endif
+
+      // safety check against the llvm isAllocaPromotable
+      // make sure that my algorithm is as strict as the llvm one
+
+      assert(llvm::isAllocaPromotable(/*AI=*/AI) &&
+             "SROA::isAllocaPromotable wrong result.");
+
+      VecPromAllocaOfFunc.push_back(AI);
+    } else if (PartialPromoteMax > 0 && PartiallyPromoted.count(AI) == 0) {
+      EscapePointList EscapePoints;
+      if (canBePartiallyPromoted(/*AI=*/AI, /*EscapePoints=*/EscapePoints)) {
 
-      if (LI->getOperand(0) != GEPI) {
         #ifdef _SROA_ZIANG_DEBUG
-        errs() << "isU1TypeGetElementPtr: invalid load [" << *LI << "]\n";
+        errs() << "Partially promotable: [" << *AI << "]\n";
         #endif
+
+        VecPartialAllocaOfFunc.push_back(AI);
+        VecEscapePoints.push_back(EscapePoints);
+      }
+    }
+  }
+
+  PromotionCandidates.clear();
+
+  size_t NumAllocToProm = VecPromAllocaOfFunc.size();
+  size_t NumAllocToPartial = VecPartialAllocaOfFunc.size();
+
+  // do the mem2reg pass only if the vector isn't empty
+
+  if (NumAllocToProm > 0 || NumAllocToPartial > 0) {
+
+    // mem2reg replaces every load of a promoted alloca with the stored value.
+    // if that value points into another alloca, the users of that alloca
+    // are rewritten, so its verdicts have to be recomputed afterwards.
+
+    vector<AllocaInst *> AllocasWithRewrittenUsers;
+    SmallPtrSet<AllocaInst *, 16> PromotedAllocas(VecPromAllocaOfFunc.begin(),
+                                                  VecPromAllocaOfFunc.end());
+    PromotedAllocas.insert(VecPartialAllocaOfFunc.begin(),
+                           VecPartialAllocaOfFunc.end());
+
+    vector<AllocaInst *> AllocasToRewrite(VecPromAllocaOfFunc);
+    AllocasToRewrite.insert(AllocasToRewrite.end(), VecPartialAllocaOfFunc.begin(),
+                            VecPartialAllocaOfFunc.end());
+
+    for (AllocaInst *AI : AllocasToRewrite) {
+      for (User *U : AI->users()) {
+        if (StoreInst *SI = dyn_cast<StoreInst>(U)) {
+          Value *StoredVal = SI->getValueOperand();
+          if (!StoredVal->getType()->isPointerTy()) {
+            continue;
+          }
+
+          AllocaInst *StoredAlloca = dyn_cast<AllocaInst>(
+                                     getUnderlyingObject(/*V=*/StoredVal));
+          if (StoredAlloca != NULL && PromotedAllocas.count(StoredAlloca) == 0) {
+            AllocasWithRewrittenUsers.push_back(StoredAlloca);
+          }
+        }
+      }
+
+      forgetAlloca(/*AI=*/AI);
+    }
+
+    // step 2 has already drained the worklist, i.e. done the full transitive
+    // splitting, so this is the only mem2reg call of this iteration.
+    // the analyses come from the pass manager and are reused, not rebuilt
+
+    ArrayRef<AllocaInst *> ArrayRefPromAllocaOfFunc(VecPromAllocaOfFunc);
+
+    if (NumAllocToProm > 0 && PrunedSSA) {
+      promoteAllocasPrunedSSA(/*Allocas=*/ArrayRefPromAllocaOfFunc, /*F=*/F);
+    } else if (NumAllocToProm > 0) {
+
+      // PromoteMemToReg doesn't report the phis it places, so count them
+      // around the call, only when they are going to be printed
+
+      size_t PhisBefore = AreStatisticsEnabled() ? countPhiNodes(/*F=*/F) : 0;
+
+      PromoteMemToReg(/*Allocas=*/ArrayRefPromAllocaOfFunc,
+                      /*DT=*/*DomTreeOfFunc, /*AC=*/AsspCacheOfFunc);
+
+      if (AreStatisticsEnabled()) {
+        NumPhisInserted += countPhiNodes(/*F=*/F) - PhisBefore;
+      }
+    }
+
+    // the partial promotions come last: PromoteMemToReg may have
+    // rewritten the values they store, but never their escape points
+
+    for (size_t PartialNo = 0; PartialNo < NumAllocToPartial; ++PartialNo) {
+      partiallyPromoteAlloca(/*AI=*/VecPartialAllocaOfFunc[PartialNo],
+                             /*EscapePoints=*/VecEscapePoints[PartialNo]);
+      PartiallyPromoted.insert(VecPartialAllocaOfFunc[PartialNo]);
+    }
+
+    for (AllocaInst *AI : AllocasWithRewrittenUsers) {
+      invalidateAlloca(/*AI=*/AI);
+    }
+
+    // update the llvm STATISTIC
+    NumPromoted += NumAllocToProm;
+    NumPartiallyPromoted += NumAllocToPartial;
+  }
+
+  return NumAllocToProm + NumAllocToPartial;
+}
+
+
+// it will return true if the alloca instruction can be promoted or false otherwise
+// a helper function used in promoteScalarAllocasToVirtualReg()
+bool SROA::isAllocaPromotable(const AllocaInst *AI) {
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "isAllocaPromotable: [" << *AI << "]\n";
+  #endif
+
+  // an alloca instruction is promotable to live in a register
+  // if the alloca satisfies all these requirements:
+  // (P1) The alloca is a “first-class” type, which you can approximate conservatively with
+  // isFPOrFPVectorTy() || isIntOrIntVectorTy() || isPtrOrPtrVectorTy.
+  
+  Type *AllocType = AI->getAllocatedType();
+  bool IsFirstClsType = AllocType->isFPOrFPVectorTy() ||
+                        AllocType->isIntOrIntVectorTy() ||
+                        AllocType->isPtrOrPtrVectorTy();
+
+  if (!IsFirstClsType) {
+    return false;
+  }
+
+  // (P2) The alloca is only used in a load or store instruction and
+  // the instruction satisfies !isVolatile().
+  // important clarification: alloca must be used as the pointer argument of the load or store.
+
+  for (const User *U : AI->users()) {
+    if (const LoadInst *LI = dyn_cast<LoadInst>(U)) {
+      if (LI->isVolatile() || LI->getOperand(0) != AI) {
         return false;
       }
     } else if (const StoreInst *SI = dyn_cast<StoreInst>(U)) {
+      if (SI->isVolatile() || SI->getOperand(1) != AI) {
+        return false;
+      }
+    } else if (const IntrinsicInst *II = dyn_cast<IntrinsicInst>(U)) {
+
+      // (P3) lifetime markers are dropped by the promotion, either directly
+      // on the alloca or through a bitcast / zero getelementptr of it
+
+      if (!II->isLifetimeStartOrEnd()) {
+        return false;
+      }
+    } else if (const BitCastInst *BCI = dyn_cast<BitCastInst>(U)) {
+      if (!onlyUsedByLifetimeMarkers(/*V=*/BCI)) {
+        return false;
+      }
+    } else if (const GetElementPtrInst *GEPI = dyn_cast<GetElementPtrInst>(U)) {
+      if (!GEPI->hasAllZeroIndices() || !onlyUsedByLifetimeMarkers(/*V=*/GEPI)) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+// fill DomFrontierOfFunc from DomTreeOfFunc
+// a block B is in the dominance frontier of every block on the dominator
+// tree path from a predecessor of B up to (excluding) the idom of B, so
+// only the join blocks have to be looked at (Cooper, Harvey and Kennedy)
+// a helper function used in promoteAllocasPrunedSSA()
+void SROA::computeDominanceFrontiers(Function &F) {
+  for (BasicBlock &BB : F) {
+    DomTreeNode *BBNode = DomTreeOfFunc->getNode(&BB);
+    if (BBNode == NULL || pred_size(&BB) < 2) {
+      continue;
+    }
+
+    DomTreeNode *IDomNode = BBNode->getIDom();
+
+    for (BasicBlock *Pred : predecessors(&BB)) {
+      DomTreeNode *Runner = DomTreeOfFunc->getNode(Pred);
+
+      // an unreachable predecessor has no node and no frontier
+
+      while (Runner != NULL && Runner != IDomNode) {
+        SmallVector<BasicBlock *, 4> &Frontier = DomFrontierOfFunc[Runner->getBlock()];
+
+        // BB is the last block added to the frontier if it is in there at all
+        if (!Frontier.empty() && Frontier.back() == &BB) {
+          break;
+        }
+        Frontier.push_back(&BB);
+        Runner = Runner->getIDom();
+      }
+    }
+  }
+}
+
+
+// collect the blocks on entry to which the value of AI may still be read:
+// the blocks loading AI before storing to it, and all the blocks from which
+// such a block is reached without passing a store to AI
+// a helper function used in promoteAllocasPrunedSSA()
+void SROA::computeLiveInBlocks(AllocaInst *AI,
+                               const SmallPtrSetImpl<BasicBlock *> &DefBlocks,
+                               const SmallPtrSetImpl<BasicBlock *> &UseBlocks,
+                               SmallPtrSetImpl<BasicBlock *> &LiveInBlocks) {
+
+  vector<BasicBlock *> LiveInWorkList;
+
+  for (BasicBlock *BB : UseBlocks) {
+
+    // a block that also stores to AI is live-in only if a load comes first
+
+    if (DefBlocks.count(BB) != 0) {
+      bool LoadFirst = false;
+      for (Instruction &I : *BB) {
+        if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+          if (SI->getPointerOperand() == AI) {
+            break;
+          }
+        } else if (LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+          if (LI->getPointerOperand() == AI) {
+            LoadFirst = true;
+            break;
+          }
+        }
+      }
+      if (!LoadFirst) {
+        continue;
+      }
+    }
+
+    if (LiveInBlocks.insert(BB).second) {
+      LiveInWorkList.push_back(BB);
+    }
+  }
+
+  // the value is live out of every predecessor of a live-in block, and
+  // live into it unless the predecessor stores to AI
+
+  while (!LiveInWorkList.empty()) {
+    BasicBlock *BB = LiveInWorkList.back();
+    LiveInWorkList.pop_back();
+
+    for (BasicBlock *Pred : predecessors(BB)) {
+      if (DefBlocks.count(Pred) != 0) {
+        continue;
+      }
+      if (LiveInBlocks.insert(Pred).second) {
+        LiveInWorkList.push_back(Pred);
+      }
+    }
+  }
+}
+
+
+// promote AI and return true if it is stored exactly once, in a reachable
+// block, and the store dominates all its loads. the loads then take the
+// stored value, as in PromoteMemToReg, and no phi is needed. the rename
+// would walk the dominator tree from the store down to every load
+// a helper function used in promoteAllocasPrunedSSA()
+bool SROA::promoteSingleStoreAlloca(AllocaInst *AI, DIBuilder &DIB) {
+
+  StoreInst *OnlyStore = NULL;
+  for (User *U : AI->users()) {
+    if (StoreInst *SI = dyn_cast<StoreInst>(U)) {
+      if (OnlyStore != NULL) {
+        return false;
+      }
+      OnlyStore = SI;
+    }
+  }
+  if (OnlyStore == NULL ||
+      !DomTreeOfFunc->isReachableFromEntry(OnlyStore->getParent())) {
+    return false;
+  }
+
+  Value *StoredVal = OnlyStore->getValueOperand();
+  for (User *U : AI->users()) {
+    LoadInst *LI = dyn_cast<LoadInst>(U);
+    if (LI != NULL && (LI->getType() != StoredVal->getType() ||
+                       !DomTreeOfFunc->dominates(OnlyStore, LI))) {
+      return false;
+    }
+  }
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "promoteSingleStoreAlloca: [" << *AI << "]\n";
+  #endif
+
+  for (DbgDeclareInst *DDI : FindDbgDeclareUses(/*V=*/AI)) {
+    ConvertDebugDeclareToDebugValue(DDI, OnlyStore, DIB);
+    DDI->eraseFromParent();
+  }
+
+  // the other users are the lifetime markers, direct or through a bitcast /
+  // zero getelementptr
+
+  for (User *U : make_early_inc_range(AI->users())) {
+    if (LoadInst *LI = dyn_cast<LoadInst>(U)) {
+      LI->replaceAllUsesWith(StoredVal);
+      LI->eraseFromParent();
+    } else if (isa<StoreInst>(U)) {
+      cast<Instruction>(U)->eraseFromParent();
+    } else {
+      Instruction *UserInst = cast<Instruction>(U);
+      for (User *MarkerU : make_early_inc_range(UserInst->users())) {
+        cast<Instruction>(MarkerU)->eraseFromParent();
+      }
+      UserInst->eraseFromParent();
+    }
+  }
+  AI->eraseFromParent();
+
+  return true;
+}
+
+
+// promote all the given allocas in one sweep and return the number of phis
+// placed. phis of an alloca are placed at the iterated dominance frontier
+// of its stores, but only in the blocks where it is live-in, then a single
+// walk of the dominator tree renames the loads of all the allocas together
+// a helper function used in promoteScalarAllocasToVirtualReg()
+size_t SROA::promoteAllocasPrunedSSA(ArrayRef<AllocaInst *> Allocas, Function &F) {
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "promoteAllocasPrunedSSA: [" << Allocas.size() << " allocas]\n";
+  #endif
+
+  DIBuilder DIB(/*M=*/*F.getParent(), /*AllowUnresolved=*/false);
+
+  // an alloca stored once, e.g. in the entry block, is done without the
+  // rename. if all the allocas are, the frontiers are not even computed
+
+  vector<AllocaInst *> RenamedAllocas;
+  for (AllocaInst *AI : Allocas) {
+    if (!promoteSingleStoreAlloca(/*AI=*/AI, /*DIB=*/DIB)) {
+      RenamedAllocas.push_back(AI);
+    }
+  }
+  if (RenamedAllocas.empty()) {
+    return 0;
+  }
+  Allocas = RenamedAllocas;
+
+  if (!DomFrontierComputed) {
+    computeDominanceFrontiers(/*F=*/F);
+    DomFrontierComputed = true;
+  }
+
+  DenseMap<AllocaInst *, unsigned> AllocaIdx;
+  vector<TinyPtrVector<DbgDeclareInst *>> DbgDeclares(Allocas.size());
+  vector<PHINode *> PlacedPhis;
+
+  // the placed phis of each block with the index of their alloca, so that
+  // the rename never has to look a phi up
+  DenseMap<BasicBlock *, SmallVector<std::pair<PHINode *, unsigned>, 4>> PhisOfBlock;
+
+  // the blocks the rename has to visit: the ones loading or storing one of
+  // the allocas and the predecessors of the ones with a placed phi
+  vector<BasicBlock *> AccessBlocks;
+
+  for (unsigned Idx = 0; Idx < Allocas.size(); ++Idx) {
+    AllocaInst *AI = Allocas[Idx];
+    AllocaIdx[AI] = Idx;
+    DbgDeclares[Idx] = FindDbgDeclareUses(/*V=*/AI);
+
+    // the blocks storing to AI, kept in the order of the first store so
+    // that the phis are placed in a deterministic order. the lifetime
+    // markers, direct or through a bitcast / zero getelementptr, mean
+    // nothing once the alloca is gone
+
+    SmallPtrSet<BasicBlock *, 32> DefBlocks;
+    SmallPtrSet<BasicBlock *, 32> UseBlocks;
+    vector<BasicBlock *> PhiWorkList;
+
+    for (User *U : make_early_inc_range(AI->users())) {
+      if (StoreInst *SI = dyn_cast<StoreInst>(U)) {
+        if (DefBlocks.insert(SI->getParent()).second) {
+          PhiWorkList.push_back(SI->getParent());
+          AccessBlocks.push_back(SI->getParent());
+        }
+      } else if (LoadInst *LI = dyn_cast<LoadInst>(U)) {
+        if (UseBlocks.insert(LI->getParent()).second) {
+          AccessBlocks.push_back(LI->getParent());
+        }
+      } else {
+        Instruction *UserInst = cast<Instruction>(U);
+        for (User *MarkerU : make_early_inc_range(UserInst->users())) {
+          cast<Instruction>(MarkerU)->eraseFromParent();
+        }
+        UserInst->eraseFromParent();
+      }
+    }
+
+    // no phi is needed if no block storing to AI has a dominance frontier,
+    // e.g. for a single store in the entry block. the liveness is then not
+    // computed at all, it is the costly part on a large function
+
+    bool MayNeedPhis = false;
+    for (BasicBlock *BB : PhiWorkList) {
+      if (DomFrontierOfFunc.count(BB) != 0) {
+        MayNeedPhis = true;
+        break;
+      }
+    }
+    if (!MayNeedPhis) {
+      continue;
+    }
+
+    SmallPtrSet<BasicBlock *, 32> LiveInBlocks;
+    computeLiveInBlocks(/*AI=*/AI, /*DefBlocks=*/DefBlocks,
+                        /*UseBlocks=*/UseBlocks, /*LiveInBlocks=*/LiveInBlocks);
+
+    // a phi is itself a store to AI, so the frontier of its block is visited
+    // too. a block where AI is dead gets no phi, and neither does its
+    // frontier through it: no load can see a value flowing across it
+
+    SmallPtrSet<BasicBlock *, 32> PhiBlocks;
+
+    while (!PhiWorkList.empty()) {
+      BasicBlock *BB = PhiWorkList.back();
+      PhiWorkList.pop_back();
+
+      auto FrontierIt = DomFrontierOfFunc.find(BB);
+      if (FrontierIt == DomFrontierOfFunc.end()) {
+        continue;
+      }
+
+      for (BasicBlock *FrontierBB : FrontierIt->second) {
+        if (LiveInBlocks.count(FrontierBB) == 0 ||
+            !PhiBlocks.insert(FrontierBB).second) {
+          continue;
+        }
+
+        PHINode *PN = PHINode::Create(/*Ty=*/AI->getAllocatedType(),
+                                      /*NumReservedValues=*/pred_size(FrontierBB),
+                                      /*NameStr=*/AI->getName() + ".phi",
+                                      /*InsertBefore=*/&FrontierBB->front());
+        PhisOfBlock[FrontierBB].push_back(std::make_pair(PN, Idx));
+        PlacedPhis.push_back(PN);
+        AccessBlocks.insert(AccessBlocks.end(), pred_begin(FrontierBB),
+                            pred_end(FrontierBB));
+
+        if (DefBlocks.count(FrontierBB) == 0) {
+          PhiWorkList.push_back(FrontierBB);
+        }
+      }
+    }
+  }
+
+  // rename: walk the dominator tree once, carrying the current value of
+  // every alloca. a block starts with the values of its idom, since the
+  // values reaching a block through other paths are merged by its phis.
+  // only the subtrees holding a block to visit are walked, so promoting a
+  // few allocas of a large function doesn't cost a walk of all its blocks
+
+  SmallPtrSet<DomTreeNode *, 32> RenameNodes;
+  for (BasicBlock *BB : AccessBlocks) {
+    DomTreeNode *Node = DomTreeOfFunc->getNode(BB);
+    while (Node != NULL && RenameNodes.insert(Node).second) {
+      Node = Node->getIDom();
+    }
+  }
+
+  typedef std::pair<DomTreeNode *, vector<Value *>> RenameItem;
+  vector<RenameItem> RenameWorkList;
+
+  vector<Value *> EntryVals;
+  for (AllocaInst *AI : Allocas) {
+    EntryVals.push_back(UndefValue::get(AI->getAllocatedType()));
+  }
+  RenameWorkList.emplace_back(DomTreeOfFunc->getRootNode(), std::move(EntryVals));
+
+  while (!RenameWorkList.empty()) {
+    DomTreeNode *Node = RenameWorkList.back().first;
+    vector<Value *> IncomingVals = std::move(RenameWorkList.back().second);
+    RenameWorkList.pop_back();
+
+    BasicBlock *BB = Node->getBlock();
+
+    auto BlockPhisIt = PhisOfBlock.find(BB);
+    if (BlockPhisIt != PhisOfBlock.end()) {
+      for (std::pair<PHINode *, unsigned> &PhiAndIdx : BlockPhisIt->second) {
+        IncomingVals[PhiAndIdx.second] = PhiAndIdx.first;
+        for (DbgDeclareInst *DDI : DbgDeclares[PhiAndIdx.second]) {
+          ConvertDebugDeclareToDebugValue(DDI, PhiAndIdx.first, DIB);
+        }
+      }
+    }
+
+    for (Instruction &I : make_early_inc_range(*BB)) {
+      if (LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+        AllocaInst *AI = dyn_cast<AllocaInst>(LI->getPointerOperand());
+        auto AllocaIt = AllocaIdx.find(AI);
+        if (AI != NULL && AllocaIt != AllocaIdx.end()) {
+          LI->replaceAllUsesWith(IncomingVals[AllocaIt->second]);
+          LI->eraseFromParent();
+        }
+      } else if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+        AllocaInst *AI = dyn_cast<AllocaInst>(SI->getPointerOperand());
+        auto AllocaIt = AllocaIdx.find(AI);
+        if (AI != NULL && AllocaIt != AllocaIdx.end()) {
+          IncomingVals[AllocaIt->second] = SI->getValueOperand();
+          for (DbgDeclareInst *DDI : DbgDeclares[AllocaIt->second]) {
+            ConvertDebugDeclareToDebugValue(DDI, SI, DIB);
+          }
+          SI->eraseFromParent();
+        }
+      }
+    }
+
+    // one incoming value per edge, so a successor reached twice by a switch
+    // gets two
+
+    for (BasicBlock *Succ : successors(BB)) {
+      auto SuccPhisIt = PhisOfBlock.find(Succ);
+      if (SuccPhisIt == PhisOfBlock.end()) {
+        continue;
+      }
+      for (std::pair<PHINode *, unsigned> &PhiAndIdx : SuccPhisIt->second) {
+        PhiAndIdx.first->addIncoming(IncomingVals[PhiAndIdx.second], BB);
+      }
+    }
+
+    // the last child takes the values over instead of copying them
+
+    SmallVector<DomTreeNode *, 4> Children;
+    for (DomTreeNode *Child : *Node) {
+      if (RenameNodes.count(Child) != 0) {
+        Children.push_back(Child);
+      }
+    }
+
+    for (size_t ChildNo = 0; ChildNo < Children.size(); ++ChildNo) {
+      if (ChildNo + 1 == Children.size()) {
+        RenameWorkList.emplace_back(Children[ChildNo], std::move(IncomingVals));
+      } else {
+        RenameWorkList.emplace_back(Children[ChildNo], IncomingVals);
+      }
+    }
+  }
+
+  // the loads and stores left are in unreachable blocks, and an edge from
+  // an unreachable block into a phi carries nothing
+
+  for (AllocaInst *AI : Allocas) {
+    for (User *U : make_early_inc_range(AI->users())) {
+      if (LoadInst *LI = dyn_cast<LoadInst>(U)) {
+        LI->replaceAllUsesWith(UndefValue::get(LI->getType()));
+      }
+      cast<Instruction>(U)->eraseFromParent();
+    }
+  }
+
+  for (PHINode *PN : PlacedPhis) {
+    for (BasicBlock *Pred : predecessors(PN->getParent())) {
+      if (!DomTreeOfFunc->isReachableFromEntry(Pred)) {
+        PN->addIncoming(UndefValue::get(PN->getType()), Pred);
+      }
+    }
+  }
+
+  // a phi merging one value along every edge (or itself, around a loop)
+  // is that value, and dropping it may make another phi such a phi
+
+  size_t NumPhis = PlacedPhis.size();
+  bool ChangedPhis = true;
+
+  while (ChangedPhis) {
+    ChangedPhis = false;
+    for (PHINode *&PN : PlacedPhis) {
+      if (PN == NULL) {
+        continue;
+      }
+      if (Value *SameVal = PN->hasConstantValue()) {
+        PN->replaceAllUsesWith(SameVal);
+        PN->eraseFromParent();
+        PN = NULL;
+        --NumPhis;
+        ChangedPhis = true;
+      }
+    }
+  }
+
+  for (unsigned Idx = 0; Idx < Allocas.size(); ++Idx) {
+    for (DbgDeclareInst *DDI : DbgDeclares[Idx]) {
+      DDI->eraseFromParent();
+    }
+    Allocas[Idx]->eraseFromParent();
+  }
+
+  // update the llvm STATISTIC
+  NumPhisInserted += NumPhis;
+
+  return NumPhis;
+}
+
+
+// return whether AI is a scalar alloca with at most PartialPromoteMax
+// uses that need it in memory, collected in EscapePoints, and at least
+// one load that can be forwarded. the alloca, or a bitcast / getelementptr
+// of it, may be used by:
+// a load or store of AI itself, forwarded in the promotion
+// a volatile load or store, a load or store of another type, a memory
+// intrinsic, or a nocapture argument of a call: an escape point
+// a lifetime marker, left as it is
+// a helper function used in promoteScalarAllocasToVirtualReg()
+bool SROA::canBePartiallyPromoted(AllocaInst *AI, EscapePointList &EscapePoints) {
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "canBePartiallyPromoted: [" << *AI << "]\n";
+  #endif
+
+  Type *AllocType = AI->getAllocatedType();
+  bool IsFirstClsType = AllocType->isFPOrFPVectorTy() ||
+                        AllocType->isIntOrIntVectorTy() ||
+                        AllocType->isPtrOrPtrVectorTy();
+
+  if (!IsFirstClsType || AI->isArrayAllocation()) {
+    return false;
+  }
+
+  // the same instruction may use the alloca more than once, e.g. a memcpy
+  // within it, so it may write it if any of its uses may
+
+  auto addEscapePoint = [&EscapePoints](Instruction *I, bool MayWrite) {
+    for (std::pair<Instruction *, bool> &EscapePoint : EscapePoints) {
+      if (EscapePoint.first == I) {
+        EscapePoint.second = EscapePoint.second || MayWrite;
+        return;
+      }
+    }
+    EscapePoints.push_back(std::make_pair(I, MayWrite));
+  };
+
+  bool HasForwardedLoad = false;
+  vector<Value *> PtrWorkList;
+  PtrWorkList.push_back(AI);
+
+  while (!PtrWorkList.empty()) {
+    Value *Ptr = PtrWorkList.back();
+    PtrWorkList.pop_back();
+
+    for (Use &U : Ptr->uses()) {
+      User *UserOfPtr = U.getUser();
+
+      if (LoadInst *LI = dyn_cast<LoadInst>(UserOfPtr)) {
+        if (Ptr == AI && !LI->isVolatile()) {
+          HasForwardedLoad = true;
+        } else {
+          addEscapePoint(LI, /*MayWrite=*/false);
+        }
+      } else if (StoreInst *SI = dyn_cast<StoreInst>(UserOfPtr)) {
+
+        // storing the pointer itself is a capture
+
+        if (SI->getValueOperand() == Ptr) {
+          return false;
+        }
+        if (Ptr != AI || SI->isVolatile()) {
+          addEscapePoint(SI, /*MayWrite=*/true);
+        }
+      } else if (isa<BitCastInst>(UserOfPtr) || isa<GetElementPtrInst>(UserOfPtr)) {
+        PtrWorkList.push_back(UserOfPtr);
+      } else if (MemIntrinsic *MI = dyn_cast<MemIntrinsic>(UserOfPtr)) {
+        addEscapePoint(MI, /*MayWrite=*/MI->getRawDest() == Ptr);
+      } else if (IntrinsicInst *II = dyn_cast<IntrinsicInst>(UserOfPtr)) {
+        if (!II->isLifetimeStartOrEnd()) {
+          return false;
+        }
+      } else if (CallInst *CI = dyn_cast<CallInst>(UserOfPtr)) {
+
+        // the callee must not keep the pointer, the value it sees in
+        // memory is only kept up to date around the call
+
+        if (!CI->isArgOperand(&U) ||
+            !CI->doesNotCapture(/*OpNo=*/CI->getArgOperandNo(&U))) {
+          return false;
+        }
+        addEscapePoint(CI, /*MayWrite=*/
+                       !CI->onlyReadsMemory(/*OpNo=*/CI->getArgOperandNo(&U)));
+      } else {
+        return false;
+      }
+
+      if (EscapePoints.size() > PartialPromoteMax) {
+        return false;
+      }
+    }
+  }
+
+  return HasForwardedLoad && !EscapePoints.empty();
+}
+
+
+namespace {
+  // the LoadAndStorePromoter of a partially promoted alloca. it looks its
+  // instructions up in a set instead of the list, and moves the debug info
+  // of the alloca to the stores it deletes
+  class PartialAllocaPromoter : public LoadAndStorePromoter {
+  public:
+    PartialAllocaPromoter(ArrayRef<const Instruction *> Insts, SSAUpdater &S,
+                          StringRef Name, DIBuilder &DIB,
+                          TinyPtrVector<DbgDeclareInst *> &DbgDeclares)
+      : LoadAndStorePromoter(Insts, S, Name), DIB(DIB),
+        DbgDeclares(DbgDeclares), InstSet(Insts.begin(), Insts.end()) { }
+
+    virtual bool isInstInList(Instruction *I,
+                              const SmallVectorImpl<Instruction *> &Insts) const {
+      return InstSet.count(I) != 0;
+    }
+
+    virtual void updateDebugInfo(Instruction *I) const {
+      if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+        for (DbgDeclareInst *DDI : DbgDeclares) {
+          ConvertDebugDeclareToDebugValue(DDI, SI, DIB);
+        }
+      }
+    }
+
+  private:
+    DIBuilder &DIB;
+    TinyPtrVector<DbgDeclareInst *> &DbgDeclares;
+    SmallPtrSet<const Instruction *, 16> InstSet;
+  };
+}
+
+
+// promote AI to a virtual register everywhere except at EscapePoints:
+// the current value is stored before each of them and loaded back
+// after the ones that may write it.
+// before an escape point, a load of AI is inserted and stored back: the
+// load is promoted with the others, i.e. replaced by the current value,
+// so the store becomes the spill. after it, a load of AI that is not
+// promoted is stored to AI: that store is promoted with the others, so
+// the reloaded value becomes the current value
+// a helper function used in promoteScalarAllocasToVirtualReg()
+void SROA::partiallyPromoteAlloca(AllocaInst *AI, EscapePointList &EscapePoints) {
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "partiallyPromoteAlloca: [" << *AI << "]\n";
+  #endif
+
+  Type *AllocType = AI->getAllocatedType();
+  Align AllocaAlign = AI->getAlign();
+
+  SmallVector<Instruction *, 32> Insts;
+  for (User *U : AI->users()) {
+    if (LoadInst *LI = dyn_cast<LoadInst>(U)) {
+      if (!LI->isVolatile()) {
+        Insts.push_back(LI);
+      }
+    } else if (StoreInst *SI = dyn_cast<StoreInst>(U)) {
+      if (!SI->isVolatile()) {
+        Insts.push_back(SI);
+      }
+    }
+  }
+
+  for (std::pair<Instruction *, bool> &EscapePoint : EscapePoints) {
+    Instruction *EscapeInst = EscapePoint.first;
+
+    LoadInst *SpillVal = new LoadInst(/*Ty=*/AllocType, /*Ptr=*/AI,
+                                      /*NameStr=*/AI->getName() + ".spill",
+                                      /*isVolatile=*/false, /*Align=*/AllocaAlign,
+                                      /*InsertBefore=*/EscapeInst);
+    new StoreInst(/*Val=*/SpillVal, /*Ptr=*/AI, /*isVolatile=*/false,
+                  /*Align=*/AllocaAlign, /*InsertBefore=*/EscapeInst);
+    Insts.push_back(SpillVal);
+
+    if (EscapePoint.second) {
+      LoadInst *ReloadVal = new LoadInst(/*Ty=*/AllocType, /*Ptr=*/AI,
+                                         /*NameStr=*/AI->getName() + ".reload",
+                                         /*isVolatile=*/false, /*Align=*/AllocaAlign,
+                                         /*InsertBefore=*/EscapeInst->getNextNode());
+      StoreInst *ReloadDef = new StoreInst(/*Val=*/ReloadVal, /*Ptr=*/AI,
+                                           /*isVolatile=*/false, /*Align=*/AllocaAlign,
+                                           /*InsertBefore=*/ReloadVal->getNextNode());
+      Insts.push_back(ReloadDef);
+    }
+  }
+
+  // the variable now lives in the promoted values, the memory is only up
+  // to date at the escape points
+
+  DIBuilder DIB(/*M=*/*AI->getModule(), /*AllowUnresolved=*/false);
+  TinyPtrVector<DbgDeclareInst *> DbgDeclares = FindDbgDeclareUses(/*V=*/AI);
+
+  SSAUpdater SSA;
+  PartialAllocaPromoter Promoter(/*Insts=*/Insts, /*S=*/SSA,
+                                 /*Name=*/AI->getName(), /*DIB=*/DIB,
+                                 /*DbgDeclares=*/DbgDeclares);
+  Promoter.run(/*Insts=*/Insts);
+
+  for (DbgDeclareInst *DDI : DbgDeclares) {
+    DDI->eraseFromParent();
+  }
+}
+
+
+//===----------------------------------------------------------------------===//
+//            step 2: replace some struct/array allocas
+//                    with allocas of individual fields
+//===----------------------------------------------------------------------===//
+// 
+
+
+// drain AllocaWorkList: replace the eliminatable struct/array allocas
+// with allocas of individual fields and hand the rest to step 1
+// the second step of the iterative algorithm
+size_t SROA::replaceStructAllocsWithIndividualFields(Function &F) {
+
+  // use a worklist-style algorithm to eliminate allocas
+  // notice, only queued allocas can be eliminatable: the ones that were
+  // never examined, newly generated ones and the ones with rewritten users
+
+  size_t ReplacementCount = 0;
+
+  while (!AllocaWorkList.empty()) {
+    WeakTrackingVH QueuedVH = AllocaWorkList.back();
+    AllocaWorkList.pop_back();
+
+    // the alloca may have been erased after it was queued
+    AllocaInst *AI = dyn_cast_or_null<AllocaInst>(QueuedVH);
+    if (AI == NULL) {
+      continue;
+    }
+
+    if (!isEliminatableCached(/*AI=*/AI)) {
+
+      // in the struct-of-arrays mode, an array of structs that can't be
+      // broken up may still become one array per field
+
+      if (ArrayOfStructsToSoA && canBeSplitArrayOfStructs(/*AI=*/AI)) {
+        vector<AllocaInst *> FieldArrays;
+        splitArrayOfStructs(/*AI=*/AI, /*F=*/F, /*NewAllocas=*/FieldArrays);
+        ReplacementCount += 1;
+
+        for (AllocaInst *FieldArray : FieldArrays) {
+          AllocaWorkList.push_back(FieldArray);
+          if (FieldLifetimes) {
+            SplitFieldAllocas.push_back(FieldArray);
+          }
+        }
+        continue;
+      }
+
+      PromotionCandidates.push_back(AI);
+      continue;
+    }
+
+    // in the vector-promotion mode, an aggregate that fits in a vector
+    // register becomes a vector alloca instead of scalar field allocas
+
+    vector<AllocaInst *> NewAllocas;
+    if (PromoteToVector && isVectorizableCached(/*AI=*/AI)) {
+      vectorPromoteAlloca(/*AI=*/AI, /*F=*/F, /*NewAllocas=*/NewAllocas);
+    } else {
+      eliminateStructAlloca(/*AI=*/AI, /*F=*/F, /*NewAllocas=*/NewAllocas);
+      if (FieldLifetimes) {
+        SplitFieldAllocas.insert(SplitFieldAllocas.end(), NewAllocas.begin(),
+                                 NewAllocas.end());
+      }
+    }
+    ReplacementCount += 1;
+
+    // every new field alloca may be eliminatable or promotable
+
+    for (AllocaInst *NewAlloca : NewAllocas) {
+      AllocaWorkList.push_back(NewAlloca);
+    }
+  }
+
+  // update LLVM STATISTIC NumReplaced
+  NumReplaced += ReplacementCount;
+
+  return ReplacementCount;
+}
+
+
+//===----------------------------------------------------------------------===//
+//         step 2.1: determine whether an alloca is eliminatable or not
+//===----------------------------------------------------------------------===//
+//
+
+
+// return whether the given alloca instruction can be eliminated or not
+// a helper function used in replaceStructAllocsWithIndividualFields()
+bool SROA::canBeEliminatedStructAlloca(const AllocaInst *AI) {
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "canBeEliminatedStructAlloca: [" << *AI << "]\n";
+  #endif
+
+  // type check: a single struct, or a small array whose elements can be
+  // told apart by the constant indices of the getelementptr users
+
+  if (AI->isArrayAllocation()) {
+    return false;
+  }
+
+  // the temporary copies made for calls keep their aggregate type
+
+  if (EscapeTemporaries.count(AI) > 0) {
+    return false;
+  }
+
+  Type *AllocType = AI->getAllocatedType();
+  if (ArrayType *AllocArrayTy = dyn_cast<ArrayType>(AllocType)) {
+    uint64_t NumElements = AllocArrayTy->getNumElements();
+    if (NumElements == 0 || NumElements > MaxArrayElements) {
+      return false;
+    }
+  } else if (!AllocType->isStructTy()) {
+    return false;
+  }
+
+  // the resulting pointer is used only in five ways: U1, U2, U3, U4 and U5
+
+  if (!isSplittableAggregatePointer(/*Ptr=*/AI, /*AggrTy=*/AllocType,
+                                    /*OnlyFieldUses=*/false)) {
+    return false;
+  }
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "Eliminatable Struct Alloca: [" << *AI << "]\n";
+  #endif
+  return true;
+}
+
+
+// return whether every use of Ptr, a pointer to the aggregate AggrTy,
+// is of type U1, U2, U3, U4 or U5, so that the aggregate can be split
+// into its fields. With OnlyFieldUses, only U1 and U2 are accepted
+// used by canBeEliminatedStructAlloca() and by the module passes
+bool SROA::isSplittableAggregatePointer(const Value *Ptr, Type *AggrTy,
+                                        bool OnlyFieldUses) {
+
+  // in the dynamic-index mode, a getelementptr may also index an array
+  // with a variable, as long as all of them together stay in the budget.
+  // the getelementptr of a global may also be a constant expression
+
+  unsigned DynamicIndexCost = 0;
+
+  for (const User *U : Ptr->users()) {
+    if (const GEPOperator *GEPO = dyn_cast<GEPOperator>(U)) {
+      const GetElementPtrInst *GEPI = dyn_cast<GetElementPtrInst>(U);
+      unsigned GEPICost = (GEPI != NULL && !OnlyFieldUses) ?
+                          getDynamicIndexCost(/*GEPI=*/GEPI, /*Val=*/Ptr) : 0;
+      if (GEPICost > 0) {
+        DynamicIndexCost += GEPICost;
+        if (DynamicIndexCost > DynamicIndexBudget) {
+          #ifdef _SROA_ZIANG_DEBUG
+          errs() << "Over the dynamic index budget: [" << *U << "]\n";
+          #endif
+          return false;
+        }
+      } else if (!isU1TypeGetElementPtr(/*GEPI=*/GEPO, /*Val=*/Ptr)) {
+        #ifdef _SROA_ZIANG_DEBUG
+        errs() << "Not U1: [" << *U << "]\n";
+        #endif
+        return false;
+      }
+    } else if (const CmpInst *CI = dyn_cast<CmpInst>(U)) {
+      if (!isU2TypeEqOrNe(/*CI=*/CI, /*Val=*/Ptr)) {
+        #ifdef _SROA_ZIANG_DEBUG
+        errs() << "Not U2: [" << *U << "]\n";
+        #endif
+        return false;
+      }
+    } else if (OnlyFieldUses) {
+      #ifdef _SROA_ZIANG_DEBUG
+      errs() << "Not U1 or U2: [" << *U << "]\n";
+      #endif
+      return false;
+    } else if (const BitCastInst *BCI = dyn_cast<BitCastInst>(U)) {
+      if (!isU3TypeBitCast(/*BCI=*/BCI, /*Val=*/Ptr, /*AggrTy=*/AggrTy)) {
+        #ifdef _SROA_ZIANG_DEBUG
+        errs() << "Not U3: [" << *U << "]\n";
+        #endif
+        return false;
+      }
+    } else if (isa<LoadInst>(U) || isa<StoreInst>(U)) {
+      if (!isU4TypeLoadOrStore(/*I=*/cast<Instruction>(U), /*Val=*/Ptr)) {
+        #ifdef _SROA_ZIANG_DEBUG
+        errs() << "Not U4: [" << *U << "]\n";
+        #endif
+        return false;
+      }
+    } else if (const CallInst *CI = dyn_cast<CallInst>(U)) {
+      if (!isU5TypeCallArgument(/*CI=*/CI, /*Val=*/Ptr)) {
+        #ifdef _SROA_ZIANG_DEBUG
+        errs() << "Not U5: [" << *U << "]\n";
+        #endif
+        return false;
+      }
+    } else {
+      #ifdef _SROA_ZIANG_DEBUG
+      errs() << "Not U1, U2, U3, U4 or U5: [" << *U << "]\n";
+      #endif
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+// return true if the given getelementptr instruction satisfy the following:
+// 1. It is of the form: getelementptr ptr, 0, constant[, ... constant].
+// If the first constant indexes an array, it must be inside the array.
+// 2. The result of the getelementptr is only used in instructions of type U1, U2
+// or U3 (if it points to an aggregate), or as the pointer argument of a load
+// or store instruction
+// a helper function used in canBeEliminatedStructAlloca()
+bool SROA::isU1TypeGetElementPtr(const GEPOperator *GEPI, const Value *Val) {
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "isU1TypeGetElementPtr: [" << *GEPI << "]\n";
+  #endif
+
+  // 1. check its operands are ptr, 0, constant [, ... constant]
+
+  unsigned NumOperands = GEPI->getNumOperands();
+  if (NumOperands < 3) {
+    return false;
+  }
+
+  if (GEPI->getOperand(0) != Val) {
+    return false;
+  }
+
+  ConstantInt *GEPIOperand1ConstInt = dyn_cast<ConstantInt>(GEPI->getOperand(1));
+  if (GEPIOperand1ConstInt == NULL || !GEPIOperand1ConstInt->isZero()) {
+    return false;
+  }
+
+  for (unsigned i = 2; i < NumOperands; ++i) {
+    if (!isa<ConstantInt>(GEPI->getOperand(i))) {
+      return false;
+    }
+  }
+
+  // the first constant selects the new alloca of the field, so for an array
+  // it has to be a valid element. deeper indices are checked the same way
+  // once their sub-aggregate is broken up.
+
+  if (ArrayType *SourceArrayTy = dyn_cast<ArrayType>(GEPI->getSourceElementType())) {
+    ConstantInt *ElementConstInt = cast<ConstantInt>(GEPI->getOperand(2));
+    if (ElementConstInt->isNegative() ||
+        ElementConstInt->getZExtValue() >= SourceArrayTy->getNumElements()) {
+      return false;
+    }
+  }
+
+  // 2. check that the result is only used in U1, U2, U3, load, store (not of but into)
+
+  for (const User *U : GEPI->users()) {
+    if (!isU1TypeUser(/*U=*/U, /*FieldPtr=*/GEPI,
+                      /*FieldTy=*/GEPI->getResultElementType())) {
+      return false;
+    }
+  }
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "U1: [" << *GEPI << "]\n";
+  #endif
+  return true;
+}
+
+
+// return true if the given user of FieldPtr, a pointer to a field of type
+// FieldTy, is one of: U1, U2, U3 (if the field is an aggregate), or a load
+// or store instruction that uses FieldPtr as its pointer argument
+// a helper function used in isU1TypeGetElementPtr() and isU3TypeBitCast()
+bool SROA::isU1TypeUser(const User *U, const Value *FieldPtr, Type *FieldTy) {
+  if (const GEPOperator *UGEPI = dyn_cast<GEPOperator>(U)) {
+    if (!isU1TypeGetElementPtr(/*GEPI=*/UGEPI, /*Val=*/FieldPtr)) {
+      return false;
+    }
+  } else if (const CmpInst *CI = dyn_cast<CmpInst>(U)) {
+    if (!isU2TypeEqOrNe(/*CI=*/CI, /*Val=*/FieldPtr)) {
+      return false;
+    }
+  } else if (const BitCastInst *BCI = dyn_cast<BitCastInst>(U)) {
+
+    // the bitcast is rewritten once the field it casts is broken up,
+    // so it has to cast a whole aggregate field
+
+    if (!FieldTy->isAggregateType() ||
+        !isU3TypeBitCast(/*BCI=*/BCI, /*Val=*/FieldPtr, /*AggrTy=*/FieldTy)) {
+      return false;
+    }
+  } else if (const LoadInst *LI = dyn_cast<LoadInst>(U)) {
+
+    // need to ensure that FieldPtr actually is the pointer argument of the load
+
+    if (LI->getOperand(0) != FieldPtr) {
+      #ifdef _SROA_ZIANG_DEBUG
+      errs() << "isU1TypeUser: invalid load [" << *LI << "]\n";
+      #endif
+      return false;
+    }
+  } else if (const StoreInst *SI = dyn_cast<StoreInst>(U)) {
+
+    // need to ensure that FieldPtr actually is the pointer argument of the store
+
+    if (SI->getOperand(1) != FieldPtr) {
+      #ifdef _SROA_ZIANG_DEBUG
+      errs() << "isU1TypeUser: invalid store [" << *SI << "]\n";
+      #endif
+      return false;
+    }
+  } else {
+    #ifdef _SROA_ZIANG_DEBUG
+    errs() << "isU1TypeUser: invalid use [" << *U << "]\n";
+    #endif
+    return false;
+  }
+
+  return true;
+}
+
+
+// return true if the given comparison instruction satisfy the following:
+// In a ’eq’ or ’ne’ comparison instruction,
+// where the other operand is the NULL pointer value
+// a helper function used in replaceStructAllocsWithIndividualFields()
+bool SROA::isU2TypeEqOrNe(const CmpInst *CI, const Value *Val) {
+
+  // 1. check that it is a 'eq' or 'ne' comparison
+  // Ziang: it seems that Ptr==NULL is actually ICMP_EQ and ICMP_NEQ
+  // I tested it using llvm-dis and clang
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "isU2TypeEqOrNe: [" << *CI << "]\n";
+  #endif
+
+  CmpInst::Predicate CIPredicate = CI->getPredicate();
+  bool IsNeOrEq = (CIPredicate == CmpInst::ICMP_EQ) || (CIPredicate == CmpInst::ICMP_NE);
+  if (!IsNeOrEq) {
+    return false;
+  }
+
+  // 2. check that one operand is Val and the other is Null
+
+  unsigned NumOperands = CI->getNumOperands();
+  if (NumOperands != 2) {
+    return false;
+  }
+
+  Value *CIOperand0 = CI->getOperand(0);
+  Value *CIOperand1 = CI->getOperand(1);
+
+  if (CIOperand0 == Val) {
+    if (!isa<ConstantPointerNull>(CIOperand1)) {
+      return false;
+    }
+  } else if (CIOperand1 == Val) {
+    if (!isa<ConstantPointerNull>(CIOperand0)) {
+      return false;
+    }
+  } else {
+
+    // not possible to reach here because one of the two operands
+    // must be Val
+
+    assert(false && "isU2TypeEqOrNe reaches unpossible place - internal error");
+    return false;
+  }
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "U2: [" << *CI << "]\n";
+  #endif
+  return true;
+}
+
+
+// return true if the given bitcast instruction satisfy the following:
+// It casts Val, a pointer to the aggregate AggrTy, to another pointer.
+// Each user of the result is one of: the destination of a non-volatile
+// memset that writes the whole aggregate with a constant byte, one side
+// of a non-volatile memcpy of the whole aggregate from/to another object,
+// a lifetime marker of the whole aggregate, or, if the bitcast is to a
+// pointer to the leading field (at offset 0), a U1 type user of it
+// a helper function used in canBeEliminatedStructAlloca()
+bool SROA::isU3TypeBitCast(const BitCastInst *BCI, const Value *Val,
+                           Type *AggrTy) {
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "isU3TypeBitCast: [" << *BCI << "]\n";
+  #endif
+
+  if (BCI->getOperand(0) != Val) {
+    return false;
+  }
+
+  const DataLayout &DL = BCI->getModule()->getDataLayout();
+  uint64_t AggrSize = DL.getTypeAllocSize(AggrTy);
+
+  // a bitcast to a pointer to the leading field is the same pointer as
+  // getelementptr ptr, 0, 0[, ... 0]
+
+  Type *CastPointeeTy = BCI->getDestTy()->getPointerElementType();
+  bool IsLeadingFieldCast = (getLeadingFieldDepth(/*AggrTy=*/AggrTy,
+                                                  /*LeadTy=*/CastPointeeTy) > 0);
+
+  for (const User *U : BCI->users()) {
+
+    // 1. a lifetime marker of the whole aggregate
+
+    if (const IntrinsicInst *II = dyn_cast<IntrinsicInst>(U)) {
+      if (II->isLifetimeStartOrEnd()) {
+        if (!isWholeObjectLifetimeMarker(/*II=*/II, /*AggrSize=*/AggrSize)) {
+          return false;
+        }
+        continue;
+      }
+    }
+
+    // 2. a non-volatile memcpy/memset (not memmove) of the whole aggregate
+
+    const MemIntrinsic *MI = dyn_cast<MemIntrinsic>(U);
+    if (MI == NULL) {
+
+      // 3. anything else must be a valid use of the leading field
+
+      if (!IsLeadingFieldCast ||
+          !isU1TypeUser(/*U=*/U, /*FieldPtr=*/BCI, /*FieldTy=*/CastPointeeTy)) {
+        return false;
+      }
+      continue;
+    }
+
+    if (MI->isVolatile()) {
+      return false;
+    }
+
+    ConstantInt *LengthConstInt = dyn_cast<ConstantInt>(MI->getLength());
+    if (LengthConstInt == NULL || LengthConstInt->getZExtValue() != AggrSize) {
+      return false;
+    }
+
+    if (const MemSetInst *MSI = dyn_cast<MemSetInst>(MI)) {
+
+      // 2.1 a memset must write a constant byte that every field can hold
+
+      if (MSI->getRawDest() != BCI) {
+        return false;
+      }
+
+      ConstantInt *ByteConstInt = dyn_cast<ConstantInt>(MSI->getValue());
+      if (ByteConstInt == NULL ||
+          getMemSetValueOfType(/*Ty=*/AggrTy, /*Byte=*/ByteConstInt) == NULL) {
+        return false;
+      }
+    } else if (const MemCpyInst *MCI = dyn_cast<MemCpyInst>(MI)) {
+
+      // 2.2 a memcpy must copy from/to another object, otherwise the two
+      // sides would be split at the same time
+
+      const Value *OtherSide = (MCI->getRawDest() == BCI) ?
+                               MCI->getRawSource() : MCI->getRawDest();
+      if (OtherSide == BCI ||
+          getUnderlyingObject(/*V=*/OtherSide) == getUnderlyingObject(/*V=*/Val)) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+  }
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "U3: [" << *BCI << "]\n";
+  #endif
+  return true;
+}
+
+
+// return true if the given instruction satisfy the following:
+// It is a non-volatile, non-atomic load of the whole aggregate from Val,
+// or a non-volatile, non-atomic store of a whole aggregate value to Val
+// a helper function used in canBeEliminatedStructAlloca()
+bool SROA::isU4TypeLoadOrStore(const Instruction *I, const Value *Val) {
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "isU4TypeLoadOrStore: [" << *I << "]\n";
+  #endif
+
+  if (const LoadInst *LI = dyn_cast<LoadInst>(I)) {
+    if (!LI->isSimple() || LI->getPointerOperand() != Val) {
+      return false;
+    }
+  } else if (const StoreInst *SI = dyn_cast<StoreInst>(I)) {
+
+    // Val must be the pointer argument of the store, not the stored value
+
+    if (!SI->isSimple() || SI->getPointerOperand() != Val ||
+        SI->getValueOperand() == Val) {
+      return false;
+    }
+  } else {
+    return false;
+  }
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "U4: [" << *I << "]\n";
+  #endif
+  return true;
+}
+
+
+// return true if the given call instruction satisfy the following:
+// In the partial-escape mode, it passes Val, a pointer to the whole
+// aggregate, only as arguments that are marked nocapture
+// a helper function used in canBeEliminatedStructAlloca()
+bool SROA::isU5TypeCallArgument(const CallInst *CI, const Value *Val) {
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "isU5TypeCallArgument: [" << *CI << "]\n";
+  #endif
+
+  // the memcpy/memset/lifetime intrinsics are handled as U3 type uses.
+  // nothing can be placed between a musttail call and the return
+
+  if (!PartialEscape || isa<IntrinsicInst>(CI) || CI->isMustTailCall()) {
+    return false;
+  }
+
+  // the callee gets a temporary copy, so it must not keep the pointer
+  // after it returns. A pointer to a single field isn't accepted because
+  // the callee may still reach the other fields from it
+
+  for (const Use &U : CI->operands()) {
+    if (U.get() != Val) {
+      continue;
+    }
+    if (!CI->isArgOperand(&U) ||
+        !CI->doesNotCapture(/*OpNo=*/CI->getArgOperandNo(&U))) {
+      return false;
+    }
+  }
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "U5: [" << *CI << "]\n";
+  #endif
+  return true;
+}
+
+
+// return true if the given intrinsic is a lifetime.start/end that covers
+// all AggrSize bytes of the object
+// a helper function used in isU3TypeBitCast()
+bool SROA::isWholeObjectLifetimeMarker(const IntrinsicInst *II, uint64_t AggrSize) {
+
+  // the size is either the size of the object or -1 (the whole object)
+
+  ConstantInt *SizeConstInt = dyn_cast<ConstantInt>(II->getArgOperand(0));
+  if (SizeConstInt == NULL) {
+    return false;
+  }
+
+  return SizeConstInt->isMinusOne() || SizeConstInt->getZExtValue() == AggrSize;
+}
+
+
+// return how many leading fields (field 0 of field 0 of ...) one has to
+// step into to go from AggrTy to LeadTy, or 0 if LeadTy isn't one of them
+// a helper function used in isU3TypeBitCast() and replaceU3TypeBitCast()
+unsigned SROA::getLeadingFieldDepth(Type *AggrTy, Type *LeadTy) {
+  unsigned Depth = 0;
+  Type *CurTy = AggrTy;
+
+  while (CurTy != LeadTy) {
+    if (StructType *CurStructTy = dyn_cast<StructType>(CurTy)) {
+      if (CurStructTy->getNumElements() == 0) {
+        return 0;
+      }
+      CurTy = CurStructTy->getElementType(0);
+    } else if (ArrayType *CurArrayTy = dyn_cast<ArrayType>(CurTy)) {
+      if (CurArrayTy->getNumElements() == 0) {
+        return 0;
+      }
+      CurTy = CurArrayTy->getElementType();
+    } else {
+      return 0;
+    }
+    Depth += 1;
+  }
+
+  return Depth;
+}
+
+
+// return the constant of type Ty whose every byte is Byte, which is
+// what a memset of Byte leaves in an object of type Ty
+// return NULL if there is no such constant
+// a helper function used in isU3TypeBitCast()
+Constant *SROA::getMemSetValueOfType(Type *Ty, ConstantInt *Byte) {
+
+  // every type can hold all zero bytes
+
+  if (Byte->isZero()) {
+    return Constant::getNullValue(Ty);
+  }
+
+  // otherwise, splat the byte over an integer of the same size and
+  // reinterpret it. pointers and odd-sized integers are not supported
+
+  if (Ty->isIntegerTy() || Ty->isFloatingPointTy()) {
+    unsigned NumBits = Ty->getPrimitiveSizeInBits();
+    if (NumBits % 8 != 0) {
+      return NULL;
+    }
+
+    APInt SplatBits = APInt::getSplat(NumBits, Byte->getValue().trunc(8));
+    Constant *SplatInt = ConstantInt::get(Ty->getContext(), SplatBits);
+    return ConstantExpr::getBitCast(SplatInt, Ty);
+  }
+
+  // an aggregate can hold it if all its elements can
+
+  if (StructType *StructTy = dyn_cast<StructType>(Ty)) {
+    vector<Constant *> Elements;
+    for (Type *ElementTy : StructTy->elements()) {
+      Constant *Element = getMemSetValueOfType(/*Ty=*/ElementTy, /*Byte=*/Byte);
+      if (Element == NULL) {
+        return NULL;
+      }
+      Elements.push_back(Element);
+    }
+    return ConstantStruct::get(StructTy, Elements);
+  }
+
+  if (ArrayType *ArrayTy = dyn_cast<ArrayType>(Ty)) {
+    Constant *Element = getMemSetValueOfType(/*Ty=*/ArrayTy->getElementType(),
+                                             /*Byte=*/Byte);
+    if (Element == NULL) {
+      return NULL;
+    }
+    vector<Constant *> Elements(ArrayTy->getNumElements(), Element);
+    return ConstantArray::get(ArrayTy, Elements);
+  }
+
+  return NULL;
+}
+
+
+//===----------------------------------------------------------------------===//
+//                      step 2.2: eliminate the aggregate alloca
+//===----------------------------------------------------------------------===//
+//
+
+
+// actually eliminate the struct alloca
+// replace it with allocas of individual fields
+// the new field allocas are appended to NewAllocas
+// a helper function used in replaceStructAllocsWithIndividualFields()
+void SROA::eliminateStructAlloca(AllocaInst *AI,
+                                 Function &F,
+                                 vector<AllocaInst *> &NewAllocas) {
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "eliminateStructAlloca: [" << *AI << "]\n";
+  #endif
+
+  // firstly, replace the entire struct alloca with individual allocs
+  // of each fields. These new allocas will be placed at the begining
+  // of the function.
+
+  BasicBlock *FirstBlockInFunc = &F.getEntryBlock();
+  Instruction *FirstInstInFunc = FirstBlockInFunc->getFirstNonPHI();
+
+  // the aggregate is either a struct or a small array
+
+  StructType *AllocaStructTy = dyn_cast<StructType>(AI->getAllocatedType());
+  ArrayType *AllocaArrayTy = dyn_cast<ArrayType>(AI->getAllocatedType());
+  if (AllocaStructTy == NULL && AllocaArrayTy == NULL) {
+
+    // since the alloca instruction passes my previous test
+    // the alloca type has to be struct or array
+
+    assert(false && "the type of the alloca instruction isn't StructType or ArrayType");
+    return;
+  }
+
+  unsigned NumElements = (AllocaStructTy != NULL) ?
+                         AllocaStructTy->getNumElements() :
+                         AllocaArrayTy->getNumElements();
+
+  // I keep a vector of new alloca instructions for fields of
+  // the old alloca instructions in order so that when I am about
+  // to replace the usage of old alloca, I know how to deal with it.
+  // NameCountForNewAllocas is used for handling getelementptr
+
+  // Also, hand every new alloca back to the caller because sub-aggregate
+  // ones may also be eliminatable and scalar ones may be promotable.
+
+  // A field that is never accessed gets no alloca: its entry is NULL and
+  // the writes of the whole aggregate (memset, memcpy, store) skip it
+
+  vector<AllocaInst *> NewAllocsForAI;
+  vector<bool> FieldIsAccessed(NumElements, false);
+  markAccessedFields(/*AI=*/AI, /*FieldIsAccessed=*/FieldIsAccessed);
+
+  // add an alloca for each accessed field of the struct or each accessed
+  // element of the array
+
+  for (unsigned i = 0; i < NumElements; ++i) {
+
+    if (!FieldIsAccessed[i]) {
+      NewAllocsForAI.push_back(NULL);
+      NumFieldsSkipped += 1;
+      continue;
+    }
+
+    Type *IthAllocaTy = (AllocaStructTy != NULL) ?
+                        AllocaStructTy->getElementType(i) :
+                        AllocaArrayTy->getElementType();
+
+    // depends on whether the first basic block in this function has 
+    // an instruction or not.
+
+    AllocaInst *IthAllocaInst;
+
+    if (FirstInstInFunc != NULL) {
+      IthAllocaInst = new AllocaInst(
+                      /*Ty=*/IthAllocaTy,
+                      /*AddrSpace=*/AI->getType()->getAddressSpace(), 
+                      /*ArraySize=*/NULL,
+                      /*Name=*/"",    // let LLVM resolves naming conflict
+                      /*InsertBefore=*/FirstInstInFunc);
+    } else {
+      IthAllocaInst = new AllocaInst(
+                      /*Ty=*/IthAllocaTy,
+                      /*AddrSpace=*/AI->getType()->getAddressSpace(), 
+                      /*ArraySize=*/NULL,
+                      /*Name=*/"",    // let LLVM resolves naming conflict
+                      /*InsertAtEnd=*/FirstBlockInFunc);
+    }
+
+    #ifdef _SROA_ZIANG_DEBUG
+    errs() << i << "th inst: [" << *IthAllocaInst << "]\n";
+    #endif
+
+    NewAllocsForAI.push_back(IthAllocaInst);
+    NewAllocas.push_back(IthAllocaInst);
+  }
+
+  // Secondly, I handle each usage of the replaced alloca.
+  // because of the previous test canBeEliminatedStructAlloca()
+  // each usage should only be U1, U2, U3, U4 or U5
+  // in various places below I've insert some asserts to check that
+
+  // maintain a vector of old usages of the old allocas to be erased later
+  // we can't erase them in the for loop because it might affect the iterator
+
+  vector<Instruction *> UserInstToBeErased;
+
+  // the calls of U5 type are given a temporary copy of the aggregate,
+  // which is created with the first such call and shared by all of them.
+  // they are retargeted in the loop, so copy the users first
+
+  AllocaInst *TempAggr = NULL;
+  vector<User *> AIUsers(AI->user_begin(), AI->user_end());
+
+  for (User *U : AIUsers) {
+    if (GetElementPtrInst *GEPI = dyn_cast<GetElementPtrInst>(U)) {
+      if (isa<ConstantInt>(GEPI->getOperand(2))) {
+        replaceU1TypeGetElementPtr(/*GEPI=*/GEPI,
+                                   /*F=*/F,
+                                   /*NewAllocas=*/NewAllocsForAI);
+      } else {
+        replaceDynamicIndexGetElementPtr(/*GEPI=*/GEPI,
+                                         /*F=*/F,
+                                         /*NewAllocas=*/NewAllocsForAI);
+      }
+      UserInstToBeErased.push_back(GEPI);
+    } else if (CmpInst *CI = dyn_cast<CmpInst>(U)) {
+      replaceU2TypeEqOrNe(/*CI=*/CI,
+                          /*F=*/F,
+                          /*NewAllocas=*/NewAllocsForAI);
+      UserInstToBeErased.push_back(CI);
+    } else if (BitCastInst *BCI = dyn_cast<BitCastInst>(U)) {
+      replaceU3TypeBitCast(/*BCI=*/BCI,
+                           /*F=*/F,
+                           /*NewAllocas=*/NewAllocsForAI);
+      UserInstToBeErased.push_back(BCI);
+    } else if (isa<LoadInst>(U) || isa<StoreInst>(U)) {
+      Instruction *LoadOrStore = cast<Instruction>(U);
+      replaceU4TypeLoadOrStore(/*I=*/LoadOrStore,
+                               /*F=*/F,
+                               /*NewAllocas=*/NewAllocsForAI);
+      UserInstToBeErased.push_back(LoadOrStore);
+    } else if (CallInst *CI = dyn_cast<CallInst>(U)) {
+
+      // a call passing the alloca twice shows up twice in the users
+
+      if (!is_contained(CI->operands(), AI)) {
+        continue;
+      }
+
+      if (TempAggr == NULL) {
+        TempAggr = new AllocaInst(
+                   /*Ty=*/AI->getAllocatedType(),
+                   /*AddrSpace=*/AI->getType()->getAddressSpace(),
+                   /*ArraySize=*/NULL,
+                   /*Align=*/AI->getAlign(),
+                   /*Name=*/"",    // let LLVM resolves naming conflict
+                   /*InsertBefore=*/&*FirstBlockInFunc->getFirstInsertionPt());
+        EscapeTemporaries.insert(TempAggr);
+      }
+
+      replaceU5TypeCallArgument(/*CI=*/CI,
+                                /*AI=*/AI,
+                                /*TempAggr=*/TempAggr,
+                                /*F=*/F,
+                                /*NewAllocas=*/NewAllocsForAI);
+    } else {
+      assert(false && "One user of the replaced alloca isn't U1, U2, U3, U4 or U5");
+    }
+  }
+
+  // Finally, eliminate all the uses of the old allocas and then
+  // erase the old alloca
+
+  for (Instruction *UserInst : UserInstToBeErased) {
+    UserInst->eraseFromParent();
+  }
+  splitDbgDeclares(/*AI=*/AI, /*F=*/F, /*NewAllocs=*/NewAllocsForAI);
+  forgetAlloca(/*AI=*/AI);
+  AI->eraseFromParent();
+
+  if (AllocaArrayTy != NULL) {
+    NumArraysReplaced += 1;
+  }
+}
+
+
+// mark the fields of the given alloca that are ever read or have their
+// address taken. the other fields are at most written as part of the
+// whole aggregate, so they don't need an alloca
+// a helper function used in eliminateStructAlloca()
+void SROA::markAccessedFields(const AllocaInst *AI, vector<bool> &FieldIsAccessed) {
+
+  for (const User *U : AI->users()) {
+    if (const GetElementPtrInst *GEPI = dyn_cast<GetElementPtrInst>(U)) {
+
+      // U1: the field selected by the first constant. a variable index
+      // may select any of them
+
+      if (ConstantInt *FieldConst = dyn_cast<ConstantInt>(GEPI->getOperand(2))) {
+        FieldIsAccessed[FieldConst->getZExtValue()] = true;
+      } else {
+        FieldIsAccessed.assign(FieldIsAccessed.size(), true);
+      }
+    } else if (const BitCastInst *BCI = dyn_cast<BitCastInst>(U)) {
+
+      // U3: a memcpy from the aggregate reads every field, a leading
+      // field user accesses field 0. memset, memcpy to the aggregate and
+      // lifetime markers only write or mark the fields
+
+      for (const User *BCIUser : BCI->users()) {
+        if (const MemCpyInst *MCI = dyn_cast<MemCpyInst>(BCIUser)) {
+          if (MCI->getRawSource() == BCI) {
+            FieldIsAccessed.assign(FieldIsAccessed.size(), true);
+          }
+        } else if (const IntrinsicInst *II = dyn_cast<IntrinsicInst>(BCIUser)) {
+          if (!isa<MemSetInst>(II) && !II->isLifetimeStartOrEnd()) {
+            FieldIsAccessed[0] = true;
+          }
+        } else {
+          FieldIsAccessed[0] = true;
+        }
+      }
+    } else if (isa<LoadInst>(U) || isa<CallInst>(U)) {
+
+      // U4 load and U5 call: every field is read
+
+      FieldIsAccessed.assign(FieldIsAccessed.size(), true);
+    }
+
+    // U2 comparisons and U4 stores don't read any field
+  }
+}
+
+
+// when eliminating an alloca, the U1 type getelementptr use should be
+// modified apropriately
+// a helper function used in eliminateStructAlloca()
+void SROA::replaceU1TypeGetElementPtr(GetElementPtrInst *GEPI,
+                                      Function &F,
+                                      vector<AllocaInst *> &NewAllocs) {
+  
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "replaceU1TypeGetElementPtr: [" << *GEPI << "]\n";
+  #endif
+
+  unsigned NumOperands = GEPI->getNumOperands();
+  if (NumOperands < 3) {
+    assert(false && "the numOperands for getelementptr can't be < 3");
+    return;
+  }
+
+  // figure out which field this getelementptr is trying to access
+
+  ConstantInt *FieldConst = dyn_cast<ConstantInt>(GEPI->getOperand(2));
+  if (FieldConst == NULL) {
+    assert(false && "the third argument of U1 Type must be a ConstantInt");
+    return;
+  }
+  int FieldConstVal = FieldConst->getSExtValue();
+
+  AllocaInst *StructFieldValue = NewAllocs[FieldConstVal];
+
+  // there are essentially two types of getelementptr to replace
+
+  if (NumOperands == 3) {
+    // 1. getelementptr %struct %1, i32 0, i32 n (where n is an integer)
+    // for this type of getelementptr, we can simply get rid of the whole GEPI
+    // and replace each use of it with the alloca of the individual field
+
+    GEPI->replaceAllUsesWith(/*V=*/StructFieldValue);
+  } else {
+    // 2. getelementptr %struct %1, i32 0, i32 n, i32 a ...
+    // for this type, it means that the new alloca is also an aggregate type
+    // in this case, create a new getelementptr inst to replace the old one
+    // with one less layer of pointer arithmetic:
+    // getelementptr %struct %1, i32 0, i32 n, i32 a ...
+    // -> getelementptr %field %2, i32 0, i32 a, ...
+
+    vector<Value *> IdxVec;
+    IdxVec.push_back(GEPI->getOperand(1));  // ConstantInt of value 0
+    for (unsigned i = 3; i < NumOperands; i++) {
+      IdxVec.push_back(GEPI->getOperand(i));
+    }
+    ArrayRef<Value *> IdxList(IdxVec);
+
+    GetElementPtrInst *NewGEPI = GetElementPtrInst::CreateInBounds(
+                                  /*PointeeType=*/StructFieldValue->getAllocatedType(),
+                                  /*Ptr=*/StructFieldValue,
+                                  /*IdxList=*/IdxList,
+                                  /*NameStr=*/"",       // let LLVM resolves naming conflicts
+                                  /*InsertBefore=*/GEPI);
+
+    #ifdef _SROA_ZIANG_DEBUG
+    errs() << "NewGEPI: " << *NewGEPI << "\n";
+    #endif
+
+    GEPI->replaceAllUsesWith(/*V=*/NewGEPI);
+  }
+}
+
+
+// when eliminating an alloca, the U2 type nq/ne use should be
+// modified apropriately
+// a helper function used in eliminateStructAlloca()
+void SROA::replaceU2TypeEqOrNe(CmpInst *CI,
+                               Function &F,
+                               vector<AllocaInst *> &NewAllocs) {
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "replaceU2TypeEqOrNe: [" << *CI << "]\n";
+  #endif
+
+  // if the alloca is used in a comparison instruction with NULL
+  // I can directly infer whether the result is true or false based on the predicate
+  // if the predicate is EQ, then the result is false.
+  // if the predicate is NE, then the result is true.
+
+  ConstantInt *ComparisonResult;
+
+  CmpInst::Predicate CIPredicate = CI->getPredicate();
+  if (CIPredicate == CmpInst::ICMP_EQ) {
+    ComparisonResult = ConstantInt::getFalse(F.getContext());
+  } else if (CIPredicate == CmpInst::ICMP_NE) {
+    ComparisonResult = ConstantInt::getTrue(F.getContext());
+  } else {
+    assert(false && "CIPredicate isn't ICMP_EQ or ICMP_NE");
+    return;
+  }
+
+  // Then, I simply propagate the comparison result
+
+  CI->replaceAllUsesWith(ComparisonResult);
+}
+
+
+// when eliminating an alloca, the U3 type memcpy/memset uses should be
+// split into one load/store (scalar field) or one smaller memcpy/memset
+// (aggregate field, split again in a later round) per field
+// a helper function used in eliminateStructAlloca()
+void SROA::replaceU3TypeBitCast(BitCastInst *BCI,
+                                Function &F,
+                                vector<AllocaInst *> &NewAllocs) {
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "replaceU3TypeBitCast: [" << *BCI << "]\n";
+  #endif
+
+  AllocaInst *AI = cast<AllocaInst>(BCI->getOperand(0));
+  Type *AggrTy = AI->getAllocatedType();
+  StructType *AggrStructTy = dyn_cast<StructType>(AggrTy);
+
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  const StructLayout *AggrStructLayout = (AggrStructTy != NULL) ?
+                                         DL.getStructLayout(AggrStructTy) : NULL;
+
+  // the intrinsics are erased while splitting them, so copy the users first
+
+  vector<Instruction *> BCIUsers;
+  for (User *U : BCI->users()) {
+    BCIUsers.push_back(cast<Instruction>(U));
+  }
+
+  for (Instruction *UserInst : BCIUsers) {
+    IRBuilder<> Builder(UserInst);
+
+    // 0. lifetime marker: mark the lifetime of every field instead
+
+    if (IntrinsicInst *II = dyn_cast<IntrinsicInst>(UserInst)) {
+      if (II->isLifetimeStartOrEnd()) {
+        for (unsigned i = 0; i < NewAllocs.size(); ++i) {
+          if (NewAllocs[i] == NULL) {
+            continue;    // a never-accessed field
+          }
+          ConstantInt *FieldSize = Builder.getInt64(
+                        DL.getTypeAllocSize(NewAllocs[i]->getAllocatedType()));
+          if (II->getIntrinsicID() == Intrinsic::lifetime_start) {
+            Builder.CreateLifetimeStart(NewAllocs[i], FieldSize);
+          } else {
+            Builder.CreateLifetimeEnd(NewAllocs[i], FieldSize);
+          }
+        }
+        II->eraseFromParent();
+        continue;
+      }
+    }
+
+    // the rest of the users that aren't memcpy/memset use the leading
+    // field, they are handled after the loop
+
+    MemIntrinsic *MI = dyn_cast<MemIntrinsic>(UserInst);
+    if (MI == NULL) {
+      continue;
+    }
+
+    if (MemSetInst *MSI = dyn_cast<MemSetInst>(MI)) {
+
+      // 1. memset: store the byte pattern into every scalar field,
+      // memset every aggregate field
+
+      ConstantInt *ByteConstInt = cast<ConstantInt>(MSI->getValue());
+
+      for (unsigned i = 0; i < NewAllocs.size(); ++i) {
+        if (NewAllocs[i] == NULL) {
+          continue;    // a never-accessed field
+        }
+        Type *FieldTy = NewAllocs[i]->getAllocatedType();
+        if (FieldTy->isAggregateType()) {
+          Builder.CreateMemSet(NewAllocs[i], ByteConstInt,
+                               DL.getTypeAllocSize(FieldTy),
+                               NewAllocs[i]->getAlign());
+        } else {
+          Builder.CreateStore(getMemSetValueOfType(/*Ty=*/FieldTy,
+                                                   /*Byte=*/ByteConstInt),
+                              NewAllocs[i]);
+        }
+      }
+
+      MSI->eraseFromParent();
+      NumMemIntrinsicsSplit += 1;
+      continue;
+    }
+
+    // 2. memcpy: copy every field from/to the same field of the other
+    // object. The other object is viewed as the same aggregate type; if
+    // it already is one (e.g. another candidate alloca), the new
+    // getelementptrs are U1 type for it.
+
+    MemCpyInst *MCI = cast<MemCpyInst>(MI);
+    bool AIIsDest = (MCI->getRawDest() == BCI);
+    Value *OtherSide = AIIsDest ? MCI->getRawSource() : MCI->getRawDest();
+    Align OtherAlign = (AIIsDest ? MCI->getSourceAlign() :
+                                   MCI->getDestAlign()).valueOrOne();
+
+    Value *OtherAggr = OtherSide->stripPointerCasts();
+    if (OtherAggr->getType() != AI->getType()) {
+      OtherAggr = Builder.CreateBitCast(OtherSide, AI->getType());
+    }
+
+    for (unsigned i = 0; i < NewAllocs.size(); ++i) {
+      if (NewAllocs[i] == NULL) {
+        continue;    // a never-accessed field
+      }
+      Type *FieldTy = NewAllocs[i]->getAllocatedType();
+      uint64_t FieldOffset = (AggrStructLayout != NULL) ?
+                             AggrStructLayout->getElementOffset(i) :
+                             i * DL.getTypeAllocSize(FieldTy);
+      Align OtherFieldAlign = commonAlignment(OtherAlign, FieldOffset);
+
+      Value *IdxList[] = {Builder.getInt32(0), Builder.getInt32(i)};
+      Value *OtherField = Builder.CreateInBoundsGEP(AggrTy, OtherAggr, IdxList);
+
+      if (FieldTy->isAggregateType()) {
+        uint64_t FieldSize = DL.getTypeAllocSize(FieldTy);
+        if (AIIsDest) {
+          Builder.CreateMemCpy(NewAllocs[i], NewAllocs[i]->getAlign(),
+                               OtherField, OtherFieldAlign, FieldSize);
+        } else {
+          Builder.CreateMemCpy(OtherField, OtherFieldAlign,
+                               NewAllocs[i], NewAllocs[i]->getAlign(), FieldSize);
+        }
+      } else if (AIIsDest) {
+        Value *FieldVal = Builder.CreateAlignedLoad(FieldTy, OtherField,
+                                                    OtherFieldAlign);
+        Builder.CreateStore(FieldVal, NewAllocs[i]);
+      } else {
+        Value *FieldVal = Builder.CreateLoad(FieldTy, NewAllocs[i]);
+        Builder.CreateAlignedStore(FieldVal, OtherField, OtherFieldAlign);
+      }
+    }
+
+    MCI->eraseFromParent();
+    NumMemIntrinsicsSplit += 1;
+
+    // the casts that fed the memcpy on the other side may be dead now
+
+    while (Instruction *OtherInst = dyn_cast<Instruction>(OtherSide)) {
+      if (!OtherInst->use_empty() ||
+          !(isa<CastInst>(OtherInst) || isa<GetElementPtrInst>(OtherInst))) {
+        break;
+      }
+      OtherSide = OtherInst->getOperand(0);
+      OtherInst->eraseFromParent();
+    }
+
+    // the users of the other object were rewritten, so look at it again
+
+    if (AllocaInst *OtherAlloca = dyn_cast<AllocaInst>(
+                                  getUnderlyingObject(/*V=*/OtherSide))) {
+      invalidateAlloca(/*AI=*/OtherAlloca);
+    }
+  }
+
+  // 3. the bitcast is to a pointer to the leading field: it is the same
+  // pointer as the alloca of field 0 (or of field 0 of field 0 ...)
+
+  if (!BCI->use_empty()) {
+    Type *CastPointeeTy = BCI->getDestTy()->getPointerElementType();
+    unsigned Depth = getLeadingFieldDepth(/*AggrTy=*/AggrTy,
+                                          /*LeadTy=*/CastPointeeTy);
+    assert(Depth > 0 && "a user of the bitcast isn't U3");
+
+    Value *LeadingField = NewAllocs[0];
+    if (Depth > 1) {
+      LeadingField = new BitCastInst(/*S=*/NewAllocs[0],
+                                     /*Ty=*/BCI->getDestTy(),
+                                     /*Name=*/"",
+                                     /*InsertBefore=*/BCI);
+    }
+    BCI->replaceAllUsesWith(LeadingField);
+  }
+}
+
+
+// when eliminating an alloca, the U4 type load/store use should be
+// modified apropriately: a load becomes one load per field combined
+// with insertvalue, a store becomes extractvalue and one store per field
+// a helper function used in eliminateStructAlloca()
+void SROA::replaceU4TypeLoadOrStore(Instruction *I,
+                                    Function &F,
+                                    vector<AllocaInst *> &NewAllocs) {
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "replaceU4TypeLoadOrStore: [" << *I << "]\n";
+  #endif
+
+  // a field that is itself an aggregate is loaded/stored whole, which is
+  // a U4 type use of its new alloca and is split again in a later round
+
+  IRBuilder<> Builder(I);
+
+  if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
+    Value *Aggr = UndefValue::get(LI->getType());
+    for (unsigned i = 0; i < NewAllocs.size(); ++i) {
+      Value *FieldVal = Builder.CreateAlignedLoad(
+                        NewAllocs[i]->getAllocatedType(),
+                        NewAllocs[i],
+                        NewAllocs[i]->getAlign());
+      Aggr = Builder.CreateInsertValue(Aggr, FieldVal, i);
+    }
+    LI->replaceAllUsesWith(/*V=*/Aggr);
+  } else {
+    StoreInst *SI = cast<StoreInst>(I);
+    for (unsigned i = 0; i < NewAllocs.size(); ++i) {
+      if (NewAllocs[i] == NULL) {
+        continue;    // a never-accessed field
+      }
+      Value *FieldVal = Builder.CreateExtractValue(SI->getValueOperand(), i);
+      Builder.CreateAlignedStore(FieldVal, NewAllocs[i], NewAllocs[i]->getAlign());
+    }
+  }
+}
+
+
+// when eliminating an alloca, the U5 type call use should be
+// modified apropriately: the fields are stored to TempAggr before the
+// call, the call is given TempAggr instead, and unless the arguments
+// are readonly the fields are loaded back after the call
+// a helper function used in eliminateStructAlloca()
+void SROA::replaceU5TypeCallArgument(CallInst *CI,
+                                     AllocaInst *AI,
+                                     AllocaInst *TempAggr,
+                                     Function &F,
+                                     vector<AllocaInst *> &NewAllocs) {
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "replaceU5TypeCallArgument: [" << *CI << "]\n";
+  #endif
+
+  Type *AggrTy = AI->getAllocatedType();
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  ConstantInt *AggrSize = ConstantInt::get(Type::getInt64Ty(F.getContext()),
+                                           DL.getTypeAllocSize(AggrTy));
+
+  // the fields only need to be loaded back if the callee may write them
+
+  bool CalleeOnlyReads = true;
+  for (const Use &U : CI->args()) {
+    if (U.get() == AI && !CI->onlyReadsMemory(/*OpNo=*/CI->getArgOperandNo(&U))) {
+      CalleeOnlyReads = false;
+    }
+  }
+
+  // 1. copy every field into the temporary before the call. an aggregate
+  // field is loaded whole, which is split again in a later round
+
+  IRBuilder<> Builder(CI);
+  Builder.CreateLifetimeStart(TempAggr, AggrSize);
+
+  vector<Value *> TempFields;
+  for (unsigned i = 0; i < NewAllocs.size(); ++i) {
+    Value *IdxList[] = {Builder.getInt32(0), Builder.getInt32(i)};
+    Value *TempField = Builder.CreateInBoundsGEP(AggrTy, TempAggr, IdxList);
+    Value *FieldVal = Builder.CreateAlignedLoad(NewAllocs[i]->getAllocatedType(),
+                                                NewAllocs[i],
+                                                NewAllocs[i]->getAlign());
+    Builder.CreateStore(FieldVal, TempField);
+    TempFields.push_back(TempField);
+  }
+
+  // 2. the call reads (and maybe writes) the temporary instead
+
+  CI->replaceUsesOfWith(/*From=*/AI, /*To=*/TempAggr);
+
+  // 3. copy the fields back after the call
+
+  Builder.SetInsertPoint(CI->getNextNode());
+  if (!CalleeOnlyReads) {
+    for (unsigned i = 0; i < NewAllocs.size(); ++i) {
+      Value *FieldVal = Builder.CreateLoad(NewAllocs[i]->getAllocatedType(),
+                                           TempFields[i]);
+      Builder.CreateAlignedStore(FieldVal, NewAllocs[i], NewAllocs[i]->getAlign());
+    }
+  }
+  Builder.CreateLifetimeEnd(TempAggr, AggrSize);
+
+  NumEscapeCopies += 1;
+}
+
+
+// when eliminating an alloca, its llvm.dbg.declare should be replaced
+// by one llvm.dbg.declare of the matching fragment per new field alloca
+// a helper function used in eliminateStructAlloca()
+void SROA::splitDbgDeclares(AllocaInst *AI,
+                            Function &F,
+                            vector<AllocaInst *> &NewAllocs) {
+
+  Type *AggrTy = AI->getAllocatedType();
+  StructType *AggrStructTy = dyn_cast<StructType>(AggrTy);
+
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  const StructLayout *AggrStructLayout = (AggrStructTy != NULL) ?
+                                         DL.getStructLayout(AggrStructTy) : NULL;
+  uint64_t AggrSizeInBits = DL.getTypeSizeInBits(AggrTy);
+
+  DIBuilder DIB(/*M=*/*F.getParent(), /*AllowUnresolved=*/false);
+
+  for (DbgVariableIntrinsic *DVI : FindDbgDeclareUses(/*V=*/AI)) {
+    DILocalVariable *Var = DVI->getVariable();
+    DIExpression *Expr = DVI->getExpression();
+
+    #ifdef _SROA_ZIANG_DEBUG
+    errs() << "splitDbgDeclares: [" << *DVI << "]\n";
+    #endif
+
+    for (unsigned i = 0; i < NewAllocs.size(); ++i) {
+      if (NewAllocs[i] == NULL) {
+        continue;    // a never-accessed field
+      }
+      Type *FieldTy = NewAllocs[i]->getAllocatedType();
+      uint64_t FieldOffsetInBits = 8 * ((AggrStructLayout != NULL) ?
+                                        AggrStructLayout->getElementOffset(i) :
+                                        i * DL.getTypeAllocSize(FieldTy));
+      uint64_t FieldSizeInBits = DL.getTypeSizeInBits(FieldTy);
+
+      // a field that covers the whole aggregate is described as is,
+      // otherwise it describes a fragment of the variable. a fragment
+      // that doesn't fit in the variable (e.g. a declare of a smaller
+      // type) is dropped, so the field simply has no location
+
+      DIExpression *FieldExpr = Expr;
+      if (FieldOffsetInBits != 0 || FieldSizeInBits != AggrSizeInBits) {
+        Optional<uint64_t> VarSizeInBits = Var->getSizeInBits();
+        if (VarSizeInBits.hasValue() &&
+            FieldOffsetInBits + FieldSizeInBits > VarSizeInBits.getValue()) {
+          continue;
+        }
+
+        Optional<DIExpression *> FragmentExpr =
+          DIExpression::createFragmentExpression(/*Expr=*/Expr,
+                                                 /*OffsetInBits=*/FieldOffsetInBits,
+                                                 /*SizeInBits=*/FieldSizeInBits);
+        if (!FragmentExpr.hasValue()) {
+          continue;
+        }
+        FieldExpr = FragmentExpr.getValue();
+      }
+
+      DIB.insertDeclare(/*Storage=*/NewAllocs[i],
+                        /*VarInfo=*/Var,
+                        /*Expr=*/FieldExpr,
+                        /*DL=*/DVI->getDebugLoc().get(),
+                        /*InsertBefore=*/DVI);
+    }
+
+    DVI->eraseFromParent();
+  }
+}
+
+
+//===----------------------------------------------------------------------===//
+//           step 2.3: promote the aggregate alloca to a vector alloca
+//===----------------------------------------------------------------------===//
+//
+
+
+// return whether the given alloca instruction can become a single
+// vector alloca: every element has the same int/fp type, the whole
+// aggregate fits in a vector register and every element is only
+// loaded or stored through a getelementptr of the form ptr, 0, constant
+// a helper function used in replaceStructAllocsWithIndividualFields()
+bool SROA::canBeVectorPromotedAlloca(const AllocaInst *AI) {
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "canBeVectorPromotedAlloca: [" << *AI << "]\n";
+  #endif
+
+  // 1. the elements must all have the same int or fp type
+
+  Type *ElementTy = NULL;
+  unsigned NumElements = 0;
+
+  if (StructType *AllocaStructTy = dyn_cast<StructType>(AI->getAllocatedType())) {
+    NumElements = AllocaStructTy->getNumElements();
+    for (unsigned i = 0; i < NumElements; ++i) {
+      Type *IthElementTy = AllocaStructTy->getElementType(i);
+      if (ElementTy != NULL && IthElementTy != ElementTy) {
+        return false;
+      }
+      ElementTy = IthElementTy;
+    }
+  } else if (ArrayType *AllocaArrayTy = dyn_cast<ArrayType>(AI->getAllocatedType())) {
+    NumElements = AllocaArrayTy->getNumElements();
+    ElementTy = AllocaArrayTy->getElementType();
+  }
+
+  if (NumElements < 2 || ElementTy == NULL ||
+      !(ElementTy->isIntegerTy() || ElementTy->isFloatingPointTy())) {
+    return false;
+  }
+
+  // 2. the whole aggregate must fit in a vector register of the target
+
+  uint64_t VectorBitWidth = NumElements * ElementTy->getPrimitiveSizeInBits();
+  if (VectorBitWidth > VectorRegBitWidth) {
+    return false;
+  }
+
+  // 3. the elements are only accessed one at a time.
+  // canBeEliminatedStructAlloca() has already checked the U1 and U2 shape,
+  // so here it is enough to look at the direct users of each getelementptr
+
+  for (const User *U : AI->users()) {
+    if (isa<CmpInst>(U)) {
+      continue;
+    }
+
+    // the lifetime markers are moved to the vector alloca as they are
+
+    if (isa<BitCastInst>(U)) {
+      if (!onlyUsedByLifetimeMarkers(/*V=*/U)) {
+        return false;
+      }
+      continue;
+    }
+
+    const GetElementPtrInst *GEPI = dyn_cast<GetElementPtrInst>(U);
+    if (GEPI == NULL || GEPI->getNumOperands() != 3) {
+      return false;
+    }
+
+    for (const User *GEPIUser : GEPI->users()) {
+      if (const LoadInst *LI = dyn_cast<LoadInst>(GEPIUser)) {
+        if (LI->isVolatile()) {
+          return false;
+        }
+      } else if (const StoreInst *SI = dyn_cast<StoreInst>(GEPIUser)) {
+        if (SI->isVolatile()) {
+          return false;
+        }
+      } else {
+        return false;
+      }
+    }
+  }
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "Vectorizable Alloca: [" << *AI << "]\n";
+  #endif
+  return true;
+}
+
+
+// replace the aggregate alloca with one vector alloca, the element
+// loads and stores become extractelement and insertelement
+// the new vector alloca is appended to NewAllocas
+// a helper function used in replaceStructAllocsWithIndividualFields()
+void SROA::vectorPromoteAlloca(AllocaInst *AI,
+                               Function &F,
+                               vector<AllocaInst *> &NewAllocas) {
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "vectorPromoteAlloca: [" << *AI << "]\n";
+  #endif
+
+  // firstly, create the vector alloca. canBeVectorPromotedAlloca() has
+  // made sure that all the elements share one type
+
+  Type *ElementTy;
+  unsigned NumElements;
+
+  if (StructType *AllocaStructTy = dyn_cast<StructType>(AI->getAllocatedType())) {
+    ElementTy = AllocaStructTy->getElementType(0);
+    NumElements = AllocaStructTy->getNumElements();
+  } else {
+    ArrayType *AllocaArrayTy = cast<ArrayType>(AI->getAllocatedType());
+    ElementTy = AllocaArrayTy->getElementType();
+    NumElements = AllocaArrayTy->getNumElements();
+  }
+
+  BasicBlock *FirstBlockInFunc = &F.getEntryBlock();
+  AllocaInst *VectorAlloca = new AllocaInst(
+                             /*Ty=*/FixedVectorType::get(ElementTy, NumElements),
+                             /*AddrSpace=*/AI->getType()->getAddressSpace(),
+                             /*ArraySize=*/NULL,
+                             /*Name=*/"",    // let LLVM resolves naming conflict
+                             /*InsertBefore=*/&*FirstBlockInFunc->getFirstInsertionPt());
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "VectorAlloca: [" << *VectorAlloca << "]\n";
+  #endif
+
+  // secondly, rewrite every element access. the vector is loaded whole,
+  // an element load becomes an extractelement and an element store
+  // becomes an insertelement followed by a store of the whole vector
+
+  vector<Instruction *> UserInstToBeErased;
+  vector<AllocaInst *> NoNewAllocs;
+
+  // the bitcasts are retargeted in the loop, so copy the users first
+
+  vector<User *> AIUsers(AI->user_begin(), AI->user_end());
+
+  for (User *U : AIUsers) {
+    if (CmpInst *CI = dyn_cast<CmpInst>(U)) {
+      replaceU2TypeEqOrNe(/*CI=*/CI, /*F=*/F, /*NewAllocas=*/NoNewAllocs);
+      UserInstToBeErased.push_back(CI);
+      continue;
+    }
+
+    if (BitCastInst *BCI = dyn_cast<BitCastInst>(U)) {
+      BCI->setOperand(0, VectorAlloca);
+      continue;
+    }
+
+    GetElementPtrInst *GEPI = cast<GetElementPtrInst>(U);
+    Value *ElementIdx = GEPI->getOperand(2);
+
+    for (User *GEPIUser : GEPI->users()) {
+      Instruction *AccessInst = cast<Instruction>(GEPIUser);
+      LoadInst *WholeVector = new LoadInst(
+                              /*Ty=*/VectorAlloca->getAllocatedType(),
+                              /*Ptr=*/VectorAlloca,
+                              /*NameStr=*/"",
+                              /*InsertBefore=*/AccessInst);
+
+      if (LoadInst *LI = dyn_cast<LoadInst>(AccessInst)) {
+        Value *Element = ExtractElementInst::Create(
+                         /*Vec=*/WholeVector,
+                         /*Idx=*/ElementIdx,
+                         /*NameStr=*/"",
+                         /*InsertBefore=*/LI);
+        LI->replaceAllUsesWith(/*V=*/Element);
+      } else {
+        StoreInst *SI = cast<StoreInst>(AccessInst);
+        Value *NewVector = InsertElementInst::Create(
+                           /*Vec=*/WholeVector,
+                           /*NewElt=*/SI->getValueOperand(),
+                           /*Idx=*/ElementIdx,
+                           /*NameStr=*/"",
+                           /*InsertBefore=*/SI);
+        new StoreInst(/*Val=*/NewVector, /*Ptr=*/VectorAlloca, /*InsertBefore=*/SI);
+      }
+
+      UserInstToBeErased.push_back(AccessInst);
+    }
+
+    UserInstToBeErased.push_back(GEPI);
+  }
+
+  // finally, erase the old accesses, the getelementptrs and the old alloca.
+  // the accesses come before their getelementptr in UserInstToBeErased
+
+  for (Instruction *UserInst : UserInstToBeErased) {
+    UserInst->eraseFromParent();
+  }
+
+  // the variable described by the old alloca now lives in the vector
+
+  for (DbgVariableIntrinsic *DVI : FindDbgDeclareUses(/*V=*/AI)) {
+    DVI->replaceVariableLocationOp(/*OldValue=*/AI, /*NewValue=*/VectorAlloca);
+  }
+
+  forgetAlloca(/*AI=*/AI);
+  AI->eraseFromParent();
+
+  // the vector alloca is only loaded and stored, so step 1 promotes it
+
+  NewAllocas.push_back(VectorAlloca);
+  NumVectorized += 1;
+}
+
+
+//===----------------------------------------------------------------------===//
+//                 step 2.4: arrays indexed by a variable
+//===----------------------------------------------------------------------===//
+//
+
+
+// return the cost (number of icmp/select) of the given getelementptr
+// instruction, or 0 if it isn't of the following form:
+// getelementptr ptr, 0, variable, into Val, a small array of scalars,
+// only used as the pointer argument of simple loads and stores. an
+// atomic access can't be split into one access per element
+// a helper function used in canBeEliminatedStructAlloca()
+unsigned SROA::getDynamicIndexCost(const GetElementPtrInst *GEPI, const Value *Val) {
+
+  if (MaxDynamicIndexElements == 0 || GEPI->getNumOperands() != 3 ||
+      GEPI->getOperand(0) != Val || isa<Constant>(GEPI->getOperand(2))) {
+    return 0;
+  }
+
+  ConstantInt *GEPIOperand1ConstInt = dyn_cast<ConstantInt>(GEPI->getOperand(1));
+  if (GEPIOperand1ConstInt == NULL || !GEPIOperand1ConstInt->isZero()) {
+    return 0;
+  }
+
+  ArrayType *SourceArrayTy = dyn_cast<ArrayType>(GEPI->getSourceElementType());
+  if (SourceArrayTy == NULL ||
+      SourceArrayTy->getNumElements() > MaxDynamicIndexElements ||
+      SourceArrayTy->getElementType()->isAggregateType()) {
+    return 0;
+  }
+
+  // once the elements are promoted, a load of N elements becomes N - 1
+  // icmp and N - 1 select, a store becomes N icmp and N select
+
+  unsigned NumElements = SourceArrayTy->getNumElements();
+  unsigned Cost = 0;
+
+  for (const User *U : GEPI->users()) {
+    if (const LoadInst *LI = dyn_cast<LoadInst>(U)) {
+      if (!LI->isSimple() || LI->getType() != SourceArrayTy->getElementType()) {
+        return 0;
+      }
+      Cost += 2 * (NumElements - 1);
+    } else if (const StoreInst *SI = dyn_cast<StoreInst>(U)) {
+      if (!SI->isSimple() || SI->getPointerOperand() != GEPI ||
+          SI->getValueOperand()->getType() != SourceArrayTy->getElementType()) {
+        return 0;
+      }
+      Cost += 2 * NumElements;
+    } else {
+      return 0;
+    }
+  }
+
+  // a getelementptr without users costs nothing but still has to be
+  // told apart from a non-candidate
+
+  return (Cost > 0) ? Cost : 1;
+}
+
+
+// when eliminating an alloca, the getelementptr with a variable index
+// should be modified apropriately: a load selects the loaded element
+// among all of them, a store updates every element with a select
+// a helper function used in eliminateStructAlloca()
+void SROA::replaceDynamicIndexGetElementPtr(GetElementPtrInst *GEPI,
+                                            Function &F,
+                                            vector<AllocaInst *> &NewAllocs) {
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "replaceDynamicIndexGetElementPtr: [" << *GEPI << "]\n";
+  #endif
+
+  Value *Index = GEPI->getOperand(2);
+  IntegerType *IndexTy = cast<IntegerType>(Index->getType());
+
+  // the loads/stores are erased while rewriting them, so copy the users first
+
+  vector<Instruction *> GEPIUsers;
+  for (User *U : GEPI->users()) {
+    GEPIUsers.push_back(cast<Instruction>(U));
+  }
+
+  for (Instruction *AccessInst : GEPIUsers) {
+    IRBuilder<> Builder(AccessInst);
+
+    if (LoadInst *LI = dyn_cast<LoadInst>(AccessInst)) {
+
+      // 1. load: Index == 0 ? e0 : (Index == 1 ? e1 : ... e(N-1)).
+      // an out-of-bounds index is undefined behavior, so it may read any
+
+      Value *Selected = NULL;
+      for (unsigned i = NewAllocs.size(); i-- > 0;) {
+        Value *Element = Builder.CreateLoad(LI->getType(), NewAllocs[i]);
+        if (Selected == NULL) {
+          Selected = Element;
+        } else {
+          Value *IsIth = Builder.CreateICmpEQ(Index, ConstantInt::get(IndexTy, i));
+          Selected = Builder.CreateSelect(IsIth, Element, Selected);
+        }
+      }
+      LI->replaceAllUsesWith(/*V=*/Selected);
+    } else {
+
+      // 2. store: ei = (Index == i) ? value : ei, for every element
+
+      StoreInst *SI = cast<StoreInst>(AccessInst);
+      for (unsigned i = 0; i < NewAllocs.size(); ++i) {
+        Value *Element = Builder.CreateLoad(SI->getValueOperand()->getType(),
+                                            NewAllocs[i]);
+        Value *IsIth = Builder.CreateICmpEQ(Index, ConstantInt::get(IndexTy, i));
+        Value *Updated = Builder.CreateSelect(IsIth, SI->getValueOperand(), Element);
+        Builder.CreateStore(Updated, NewAllocs[i]);
+      }
+    }
+
+    AccessInst->eraseFromParent();
+    NumDynamicAccesses += 1;
+  }
+}
+
+
+//===----------------------------------------------------------------------===//
+//              step 2.5: arrays of structs to arrays of fields
+//===----------------------------------------------------------------------===//
+//
+
+
+// return whether the given alloca instruction is an array of structs
+// whose elements are only reached through their fields, the index of
+// the element may be a variable. Each user is one of:
+// getelementptr ptr, 0, index, constant[, ...], getelementptr ptr, 0,
+// index only used by getelementptr elem, 0, constant[, ...], or a
+// bitcast only used by lifetime markers and memsets of the whole array.
+// The field pointers are only used in U1 type ways, so they never step
+// out of their field
+// a helper function used in replaceStructAllocsWithIndividualFields()
+bool SROA::canBeSplitArrayOfStructs(const AllocaInst *AI) {
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "canBeSplitArrayOfStructs: [" << *AI << "]\n";
+  #endif
+
+  if (AI->isArrayAllocation() || EscapeTemporaries.count(AI)) {
+    return false;
+  }
+
+  ArrayType *AllocaArrayTy = dyn_cast<ArrayType>(AI->getAllocatedType());
+  if (AllocaArrayTy == NULL || AllocaArrayTy->getNumElements() == 0) {
+    return false;
+  }
+  StructType *ElementStructTy = dyn_cast<StructType>(AllocaArrayTy->getElementType());
+  if (ElementStructTy == NULL || ElementStructTy->getNumElements() < 2) {
+    return false;
+  }
+
+  const DataLayout &DL = AI->getModule()->getDataLayout();
+  uint64_t ArraySize = DL.getTypeAllocSize(AllocaArrayTy);
+
+  for (const User *U : AI->users()) {
+    if (const GetElementPtrInst *GEPI = dyn_cast<GetElementPtrInst>(U)) {
+      ConstantInt *GEPIOperand1ConstInt = dyn_cast<ConstantInt>(GEPI->getOperand(1));
+      if (GEPI->getPointerOperand() != AI || GEPI->getNumOperands() < 3 ||
+          GEPIOperand1ConstInt == NULL || !GEPIOperand1ConstInt->isZero()) {
+        return false;
+      }
+
+      // getelementptr ptr, 0, index, field, ...
+
+      if (GEPI->getNumOperands() > 3) {
+        for (const User *FieldU : GEPI->users()) {
+          if (!isU1TypeUser(/*U=*/FieldU, /*FieldPtr=*/GEPI,
+                            /*FieldTy=*/GEPI->getResultElementType())) {
+            return false;
+          }
+        }
+        continue;
+      }
+
+      // getelementptr ptr, 0, index: the element itself is only used to
+      // reach its fields, clang emits this for pts[i].x
+
+      for (const User *ElementU : GEPI->users()) {
+        const GetElementPtrInst *FieldGEPI = dyn_cast<GetElementPtrInst>(ElementU);
+        if (FieldGEPI == NULL || FieldGEPI->getPointerOperand() != GEPI ||
+            FieldGEPI->getNumOperands() < 3) {
+          return false;
+        }
+        ConstantInt *FieldGEPIOperand1ConstInt =
+          dyn_cast<ConstantInt>(FieldGEPI->getOperand(1));
+        if (FieldGEPIOperand1ConstInt == NULL || !FieldGEPIOperand1ConstInt->isZero()) {
+          return false;
+        }
+        for (const User *FieldU : FieldGEPI->users()) {
+          if (!isU1TypeUser(/*U=*/FieldU, /*FieldPtr=*/FieldGEPI,
+                            /*FieldTy=*/FieldGEPI->getResultElementType())) {
+            return false;
+          }
+        }
+      }
+    } else if (const BitCastInst *BCI = dyn_cast<BitCastInst>(U)) {
+
+      // a memset writes the same byte everywhere, so the layout doesn't
+      // matter to it
+
+      for (const User *CastU : BCI->users()) {
+        const IntrinsicInst *II = dyn_cast<IntrinsicInst>(CastU);
+        if (II != NULL && II->isLifetimeStartOrEnd() &&
+            isWholeObjectLifetimeMarker(/*II=*/II, /*AggrSize=*/ArraySize)) {
+          continue;
+        }
+        const MemSetInst *MSI = dyn_cast<MemSetInst>(CastU);
+        if (MSI != NULL && MSI->getRawDest() == BCI && !MSI->isVolatile()) {
+          ConstantInt *LengthConstInt = dyn_cast<ConstantInt>(MSI->getLength());
+          if (LengthConstInt != NULL && LengthConstInt->getZExtValue() == ArraySize) {
+            continue;
+          }
+        }
+        return false;
+      }
+    } else {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+// replace the array of structs with one array per field
+// the new field arrays are appended to NewAllocas
+// a helper function used in replaceStructAllocsWithIndividualFields()
+void SROA::splitArrayOfStructs(AllocaInst *AI,
+                               Function &F,
+                               vector<AllocaInst *> &NewAllocas) {
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "splitArrayOfStructs: [" << *AI << "]\n";
+  #endif
+
+  ArrayType *AllocaArrayTy = cast<ArrayType>(AI->getAllocatedType());
+  StructType *ElementStructTy = cast<StructType>(AllocaArrayTy->getElementType());
+  const DataLayout &DL = F.getParent()->getDataLayout();
+
+  // firstly, an array of the same length for each field. a loop over the
+  // field array may be vectorized, so it gets the preferred alignment
+
+  vector<AllocaInst *> FieldArrays;
+  for (unsigned i = 0; i < ElementStructTy->getNumElements(); ++i) {
+    ArrayType *FieldArrayTy = ArrayType::get(ElementStructTy->getElementType(i),
+                                             AllocaArrayTy->getNumElements());
+    AllocaInst *FieldArray = new AllocaInst(
+                             /*Ty=*/FieldArrayTy,
+                             /*AddrSpace=*/AI->getType()->getAddressSpace(),
+                             /*ArraySize=*/NULL,
+                             /*Align=*/std::max(AI->getAlign(),
+                                                DL.getPrefTypeAlign(FieldArrayTy)),
+                             /*Name=*/"",    // let LLVM resolves naming conflict
+                             /*InsertBefore=*/AI);
+    FieldArrays.push_back(FieldArray);
+    NewAllocas.push_back(FieldArray);
+  }
+
+  // secondly, rewrite the users. the getelementptrs index the arrays of
+  // their fields, the lifetime markers and memsets are copied to every
+  // field array
+
+  vector<User *> AIUsers(AI->user_begin(), AI->user_end());
+  for (User *U : AIUsers) {
+    if (GetElementPtrInst *GEPI = dyn_cast<GetElementPtrInst>(U)) {
+      if (GEPI->getNumOperands() > 3) {
+        replaceArrayOfStructsGetElementPtr(/*GEPI=*/GEPI,
+                                           /*Index=*/GEPI->getOperand(2),
+                                           /*FieldOperandNo=*/3,
+                                           /*InBounds=*/GEPI->isInBounds(),
+                                           /*FieldArrays=*/FieldArrays);
+      } else {
+        vector<User *> ElementUsers(GEPI->user_begin(), GEPI->user_end());
+        for (User *ElementU : ElementUsers) {
+          GetElementPtrInst *FieldGEPI = cast<GetElementPtrInst>(ElementU);
+          replaceArrayOfStructsGetElementPtr(/*GEPI=*/FieldGEPI,
+                                             /*Index=*/GEPI->getOperand(2),
+                                             /*FieldOperandNo=*/2,
+                                             /*InBounds=*/GEPI->isInBounds() &&
+                                                          FieldGEPI->isInBounds(),
+                                             /*FieldArrays=*/FieldArrays);
+          FieldGEPI->eraseFromParent();
+        }
+      }
+      GEPI->eraseFromParent();
+    } else {
+      BitCastInst *BCI = cast<BitCastInst>(U);
+      vector<User *> CastUsers(BCI->user_begin(), BCI->user_end());
+      for (User *CastU : CastUsers) {
+        IntrinsicInst *II = cast<IntrinsicInst>(CastU);
+        IRBuilder<> Builder(II);
+        for (AllocaInst *FieldArray : FieldArrays) {
+          uint64_t FieldArraySize = DL.getTypeAllocSize(FieldArray->getAllocatedType());
+          if (MemSetInst *MSI = dyn_cast<MemSetInst>(II)) {
+            Builder.CreateMemSet(FieldArray, MSI->getValue(), FieldArraySize,
+                                 FieldArray->getAlign());
+          } else if (II->getIntrinsicID() == Intrinsic::lifetime_start) {
+            Builder.CreateLifetimeStart(FieldArray, Builder.getInt64(FieldArraySize));
+          } else {
+            Builder.CreateLifetimeEnd(FieldArray, Builder.getInt64(FieldArraySize));
+          }
+        }
+        II->eraseFromParent();
+      }
+      BCI->eraseFromParent();
+    }
+  }
+
+  // the fields of an element are no longer next to each other, so no
+  // fragment of the variable can describe them. the debug info is dropped
+
+  for (DbgVariableIntrinsic *DVI : FindDbgDeclareUses(/*V=*/AI)) {
+    DVI->eraseFromParent();
+  }
+
+  forgetAlloca(/*AI=*/AI);
+  AI->eraseFromParent();
+  NumStructArraysSplit += 1;
+}
+
+
+// when splitting an array of structs, a getelementptr to a field of an
+// element should index the array of the field instead:
+// getelementptr ..., index, field, a, ... -> getelementptr array, 0, index, a, ...
+// a helper function used in splitArrayOfStructs()
+void SROA::replaceArrayOfStructsGetElementPtr(GetElementPtrInst *GEPI,
+                                              Value *Index,
+                                              unsigned FieldOperandNo,
+                                              bool InBounds,
+                                              vector<AllocaInst *> &FieldArrays) {
+
+  unsigned FieldIdx = cast<ConstantInt>(GEPI->getOperand(FieldOperandNo))->getZExtValue();
+  AllocaInst *FieldArray = FieldArrays[FieldIdx];
+
+  vector<Value *> IdxVec;
+  IdxVec.push_back(ConstantInt::get(Index->getType(), 0));
+  IdxVec.push_back(Index);
+  for (unsigned i = FieldOperandNo + 1; i < GEPI->getNumOperands(); ++i) {
+    IdxVec.push_back(GEPI->getOperand(i));
+  }
+
+  GetElementPtrInst *NewGEPI = GetElementPtrInst::Create(
+                                /*PointeeType=*/FieldArray->getAllocatedType(),
+                                /*Ptr=*/FieldArray,
+                                /*IdxList=*/IdxVec,
+                                /*NameStr=*/"",       // let LLVM resolves naming conflicts
+                                /*InsertBefore=*/GEPI);
+  NewGEPI->setIsInBounds(InBounds);
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "NewGEPI: " << *NewGEPI << "\n";
+  #endif
+
+  GEPI->replaceAllUsesWith(/*V=*/NewGEPI);
+}
+
+
+//===----------------------------------------------------------------------===//
+//          after the iterations: lifetime markers of the field allocas
+//===----------------------------------------------------------------------===//
+//
+
+
+// give every field alloca still in memory, whose address isn't captured
+// and which has no lifetime markers yet, lifetime markers around its uses.
+// return the number of field allocas marked
+//
+// the new allocas are all in the entry block, so without markers the
+// stack slot of every field is live in the whole function. the range of
+// a field is:
+// start: right before the first use in the nearest common dominator of
+//        the uses, or at its end if it has no use
+// end:   right after the last use in the nearest common post-dominator of
+//        the uses, or at its beginning if it has no use
+// a block in a cycle is never used, its idom (ipdom) is taken instead:
+// the field may carry a value around the cycle, and a lifetime.start
+// in it would make that value undefined on the next iteration
+size_t SROA::markFieldLifetimes(Function &F) {
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "markFieldLifetimes: [" << F.getName() << "]\n";
+  #endif
+
+  PostDominatorTree *PostDomTreeOfFunc =
+    &getAnalysis<PostDominatorTreeWrapperPass>().getPostDomTree();
+  const DataLayout &DL = F.getParent()->getDataLayout();
+
+  // the blocks in a cycle, irreducible ones included
+
+  SmallPtrSet<BasicBlock *, 32> CycleBlocks;
+  for (scc_iterator<Function *> SCCIt = scc_begin(&F); !SCCIt.isAtEnd(); ++SCCIt) {
+    if (SCCIt.hasCycle()) {
+      CycleBlocks.insert((*SCCIt).begin(), (*SCCIt).end());
+    }
+  }
+
+  size_t NumMarked = 0;
+
+  for (WeakTrackingVH &FieldVH : SplitFieldAllocas) {
+
+    // the field may have been broken up or promoted since it was made
+    AllocaInst *AI = dyn_cast_or_null<AllocaInst>(FieldVH);
+    if (AI == NULL) {
+      continue;
+    }
+
+    // a captured address may be used anywhere after the capture
+
+    SmallPtrSet<Instruction *, 16> Uses;
+    if (!collectMemoryUses(/*AI=*/AI, /*Uses=*/Uses) || Uses.empty() ||
+        PointerMayBeCaptured(/*V=*/AI, /*ReturnCaptures=*/true,
+                             /*StoreCaptures=*/true)) {
+      continue;
+    }
+
+    BasicBlock *StartBB = NULL;
+    BasicBlock *EndBB = NULL;
+    bool HasEnd = true;
+
+    // a use in an unreachable block never runs, and the block has no
+    // common dominator with the others, so it doesn't count
+
+    for (Instruction *UseInst : Uses) {
+      BasicBlock *UseBB = UseInst->getParent();
+      if (!DomTreeOfFunc->isReachableFromEntry(UseBB)) {
+        continue;
+      }
+      StartBB = (StartBB == NULL) ? UseBB :
+                DomTreeOfFunc->findNearestCommonDominator(StartBB, UseBB);
+      if (HasEnd) {
+        EndBB = (EndBB == NULL) ? UseBB :
+                PostDomTreeOfFunc->findNearestCommonDominator(EndBB, UseBB);
+        HasEnd = (EndBB != NULL);
+      }
+    }
+
+    // leave the cycles. the entry block is never in one, while the end
+    // may be lost if the uses are only post-dominated inside a cycle
+
+    while (StartBB != NULL && CycleBlocks.count(StartBB) != 0) {
+      DomTreeNode *IDomNode = DomTreeOfFunc->getNode(StartBB)->getIDom();
+      StartBB = (IDomNode != NULL) ? IDomNode->getBlock() : NULL;
+    }
+    while (EndBB != NULL && CycleBlocks.count(EndBB) != 0) {
+      DomTreeNode *IPDomNode = PostDomTreeOfFunc->getNode(EndBB)->getIDom();
+      EndBB = (IPDomNode != NULL) ? IPDomNode->getBlock() : NULL;
+    }
+
+    // every use is unreachable
+
+    if (StartBB == NULL) {
+      continue;
+    }
+
+    Instruction *StartPoint = StartBB->getTerminator();
+    for (Instruction &I : *StartBB) {
+      if (Uses.count(&I) != 0) {
+        StartPoint = &I;
+        break;
+      }
+    }
+
+    // the end goes after the last use, which can't be a terminator
+
+    Instruction *EndPoint = NULL;
+    if (EndBB != NULL) {
+      EndPoint = &*EndBB->getFirstInsertionPt();
+      for (Instruction &I : *EndBB) {
+        if (Uses.count(&I) != 0) {
+          EndPoint = I.isTerminator() ? NULL : I.getNextNode();
+        }
+      }
+    }
+
+    #ifdef _SROA_ZIANG_DEBUG
+    errs() << "Field lifetime: [" << *AI << "] from [" << StartBB->getName()
+           << "] to [" << (EndBB != NULL ? EndBB->getName() : "") << "]\n";
+    #endif
+
+    ConstantInt *FieldSize = ConstantInt::get(Type::getInt64Ty(F.getContext()),
+                             DL.getTypeAllocSize(AI->getAllocatedType()));
+
+    IRBuilder<> StartBuilder(StartPoint);
+    StartBuilder.CreateLifetimeStart(AI, FieldSize);
+    if (EndPoint != NULL) {
+      IRBuilder<> EndBuilder(EndPoint);
+      EndBuilder.CreateLifetimeEnd(AI, FieldSize);
+    }
+
+    ++NumMarked;
+  }
+
+  // update the llvm STATISTIC
+  NumFieldLifetimes += NumMarked;
+
+  return NumMarked;
+}
+
+
+// return the instructions using the memory of AI, i.e. its users through
+// bitcasts and getelementptrs, or false if one of them is a phi or a
+// select or a lifetime marker, whose range can't be told
+// a helper function used in markFieldLifetimes()
+bool SROA::collectMemoryUses(AllocaInst *AI, SmallPtrSetImpl<Instruction *> &Uses) {
+  vector<Instruction *> PtrWorkList;
+  PtrWorkList.push_back(AI);
+
+  while (!PtrWorkList.empty()) {
+    Instruction *Ptr = PtrWorkList.back();
+    PtrWorkList.pop_back();
+
+    for (User *U : Ptr->users()) {
+      Instruction *UserInst = cast<Instruction>(U);
+      if (isa<BitCastInst>(UserInst) || isa<GetElementPtrInst>(UserInst)) {
+        PtrWorkList.push_back(UserInst);
+      } else if (isa<PHINode>(UserInst) || isa<SelectInst>(UserInst)) {
+        return false;
+      } else if (IntrinsicInst *II = dyn_cast<IntrinsicInst>(UserInst)) {
+        if (II->isLifetimeStartOrEnd()) {
+          return false;
+        }
+        Uses.insert(UserInst);
+      } else {
+        Uses.insert(UserInst);
+      }
+    }
+  }
+
+  return true;
+}
+
+
+//===----------------------------------------------------------------------===//
+//                extra credit - eliminate small array
+//===----------------------------------------------------------------------===//
+// 
+
+// small constant-size arrays go through the same steps as structs:
+// canBeEliminatedStructAlloca() accepts arrays of up to MaxArrayElements
+// elements and eliminateStructAlloca() creates one alloca per element.
+// an array can be broken up as long as every getelementptr user indexes
+// it with an in-bounds constant, or, in the dynamic-index mode, with a
+// variable (see step 2.4). arrays nested in structs and structs
+// nested in arrays are handled by the worklist, one level at a time.
+
+
+//===----------------------------------------------------------------------===//
+//          interprocedural: byval and sret struct arguments
+//===----------------------------------------------------------------------===//
+//
+
+// SROA works on one function at a time, so a struct passed byval or
+// returned through an sret pointer still goes through memory on every
+// call. The module pass SROAArgs rewrites the internal functions whose
+// callers are all known:
+// - a byval struct parameter becomes one parameter per field. the callee
+//   stores them into a local copy of the struct, the callers load them
+// - an sret struct parameter becomes the return value. the callee writes
+//   a local struct and returns it, the callers store it to the old pointer
+// a parameter is only rewritten if every use of it in the callee is U1 ...
+// U5, i.e. the local struct is broken up by SROA afterwards, e.g.
+//   opt -scalarrepl-args-ziangw2 -scalarrepl-ziangw2
+
+
+// only structs with a few fields are passed as separate parameters
+static cl::opt<unsigned> MaxArgFields(
+    "scalarrepl-args-ziangw2-max-fields", cl::init(8), cl::Hidden,
+    cl::desc("Largest byval struct that is passed as separate fields"));
+
+STATISTIC(NumByValArgsSplit, "Number of byval struct arguments passed as fields");
+STATISTIC(NumSRetArgsSplit, "Number of sret struct arguments turned into returns");
+
+
+namespace {
+  struct SROAArgs : public ModulePass {
+    static char ID; // Pass identification
+    SROAArgs() : ModulePass(ID) { }
+
+    // Entry point for the interprocedural part of the pass
+    bool runOnModule(Module &M);
+
+  private:
+
+    // return whether every use of the function is a direct call of it
+    // that can be rewritten: the function is internal and not varargs
+    // a helper function used in runOnModule()
+    bool canRewriteCallSites(const Function &F);
+
+    // return whether the given parameter is a byval struct that can be
+    // passed as its fields
+    // a helper function used in runOnModule()
+    bool isSplittableByValArg(const Argument &A);
+
+    // return whether the given parameter is an sret struct that can be
+    // returned instead
+    // a helper function used in runOnModule()
+    bool isSplittableSRetArg(const Argument &A);
+
+    // create the new function with the parameters in SplitArg rewritten,
+    // move the body of F into it, rewrite every call and erase F
+    // a helper function used in runOnModule()
+    void rewriteFunction(Function &F, const vector<bool> &SplitArg);
+
+    // return the struct type behind a byval/sret parameter
+    // a helper function used in rewriteFunction()
+    StructType *getArgStructType(const Argument &A);
+  };  // end of struct SROAArgs
+}
+
+
+char SROAArgs::ID = 0;
+static RegisterPass<SROAArgs> Y("scalarrepl-args-ziangw2",
+          "Scalar Replacement of byval/sret Arguments (by <netid>)",
+          false /* does not modify the CFG */,
+          false /* transformation, not just analysis */);
+
+
+// Public interface to create the interprocedural part of the pass.
+ModulePass *createMyScalarReplArgumentsPass() {
+  return new SROAArgs();
+}
+
+
+bool SROAArgs::runOnModule(Module &M) {
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "SROAArgs::runOnModule\n";
+  #endif
+
+  // firstly, pick the functions and their parameters to rewrite. the
+  // functions are rewritten afterwards because that replaces them
+
+  vector<Function *> FuncsToRewrite;
+  vector<vector<bool>> SplitArgsOfFuncs;
+
+  for (Function &F : M) {
+    if (!canRewriteCallSites(/*F=*/F)) {
+      continue;
+    }
+
+    vector<bool> SplitArg;
+    bool SplitAnyArg = false;
+    for (const Argument &A : F.args()) {
+      bool SplitThisArg = isSplittableByValArg(/*A=*/A) ||
+                          isSplittableSRetArg(/*A=*/A);
+      SplitArg.push_back(SplitThisArg);
+      SplitAnyArg = SplitAnyArg || SplitThisArg;
+    }
+
+    if (SplitAnyArg) {
+      FuncsToRewrite.push_back(&F);
+      SplitArgsOfFuncs.push_back(SplitArg);
+    }
+  }
+
+  // secondly, rewrite them
+
+  for (unsigned i = 0; i < FuncsToRewrite.size(); ++i) {
+    rewriteFunction(/*F=*/*FuncsToRewrite[i], /*SplitArg=*/SplitArgsOfFuncs[i]);
+  }
+
+  return !FuncsToRewrite.empty();
+}
+
+
+// return whether every use of the function is a direct call of it
+// that can be rewritten: the function is internal and not varargs
+// a helper function used in runOnModule()
+bool SROAArgs::canRewriteCallSites(const Function &F) {
+
+  if (!F.hasLocalLinkage() || F.isDeclaration() || F.isVarArg() ||
+      F.hasFnAttribute(Attribute::Naked)) {
+    return false;
+  }
+
+  // a musttail call has to keep the signature of its caller
+
+  for (const User *U : F.users()) {
+    const CallInst *CI = dyn_cast<CallInst>(U);
+    if (CI == NULL || CI->getCalledOperand() != &F ||
+        CI->getFunctionType() != F.getFunctionType() || CI->isMustTailCall()) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+// return whether the given parameter is a byval struct that can be
+// passed as its fields
+// a helper function used in runOnModule()
+bool SROAArgs::isSplittableByValArg(const Argument &A) {
+
+  if (!A.hasByValAttr()) {
+    return false;
+  }
+
+  StructType *STy = dyn_cast<StructType>(A.getParamByValType());
+  if (STy == NULL || STy->getNumElements() == 0 ||
+      STy->getNumElements() > MaxArgFields) {
+    return false;
+  }
+
+  return SROA::isSplittableAggregatePointer(/*Ptr=*/&A, /*AggrTy=*/STy,
+                                           /*OnlyFieldUses=*/false);
+}
+
+
+// return whether the given parameter is an sret struct that can be
+// returned instead
+// a helper function used in runOnModule()
+bool SROAArgs::isSplittableSRetArg(const Argument &A) {
+
+  // the callee must not see what the caller had in the memory before,
+  // which noalias guarantees, and the return value must be free
+
+  const Function *F = A.getParent();
+  if (!A.hasStructRetAttr() || !A.hasNoAliasAttr() ||
+      !F->getReturnType()->isVoidTy()) {
+    return false;
+  }
+
+  StructType *STy = dyn_cast<StructType>(A.getParamStructRetType());
+  if (STy == NULL) {
+    return false;
+  }
+
+  // nothing can be placed between a musttail call and the return
+
+  for (const BasicBlock &BB : *F) {
+    if (BB.getTerminatingMustTailCall() != NULL) {
+      return false;
+    }
+  }
+
+  return SROA::isSplittableAggregatePointer(/*Ptr=*/&A, /*AggrTy=*/STy,
+                                           /*OnlyFieldUses=*/false);
+}
+
+
+// return the struct type behind a byval/sret parameter
+// a helper function used in rewriteFunction()
+StructType *SROAArgs::getArgStructType(const Argument &A) {
+  if (A.hasByValAttr()) {
+    return cast<StructType>(A.getParamByValType());
+  }
+  return cast<StructType>(A.getParamStructRetType());
+}
+
+
+// create the new function with the parameters in SplitArg rewritten,
+// move the body of F into it, rewrite every call and erase F
+// a helper function used in runOnModule()
+void SROAArgs::rewriteFunction(Function &F, const vector<bool> &SplitArg) {
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "SROAArgs::rewriteFunction: [" << F.getName() << "]\n";
+  #endif
+
+  LLVMContext &Context = F.getContext();
+  const DataLayout &DL = F.getParent()->getDataLayout();
+  const AttributeList &FuncAttrs = F.getAttributes();
+
+  // 1. the new signature: a byval struct becomes its fields, an sret
+  // struct becomes the return type. the attributes of the other
+  // parameters are kept
+
+  Type *NewRetTy = F.getReturnType();
+  AttributeSet NewRetAttrs = FuncAttrs.getRetAttrs();
+  vector<Type *> NewParamTys;
+  vector<AttributeSet> NewParamAttrs;
+
+  for (Argument &A : F.args()) {
+    unsigned ArgNo = A.getArgNo();
+    if (!SplitArg[ArgNo]) {
+      NewParamTys.push_back(A.getType());
+      NewParamAttrs.push_back(FuncAttrs.getParamAttrs(ArgNo));
+      continue;
+    }
+
+    StructType *STy = getArgStructType(/*A=*/A);
+    if (A.hasStructRetAttr()) {
+      NewRetTy = STy;
+      NewRetAttrs = AttributeSet();
+    } else {
+      for (Type *FieldTy : STy->elements()) {
+        NewParamTys.push_back(FieldTy);
+        NewParamAttrs.push_back(AttributeSet());
+      }
+    }
+  }
+
+  FunctionType *NewFuncTy = FunctionType::get(NewRetTy, NewParamTys,
+                                              /*isVarArg=*/false);
+  Function *NewF = Function::Create(/*Ty=*/NewFuncTy,
+                                    /*Linkage=*/F.getLinkage(),
+                                    /*AddrSpace=*/F.getAddressSpace());
+  NewF->copyAttributesFrom(&F);
+  NewF->setAttributes(AttributeList::get(Context, FuncAttrs.getFnAttrs(),
+                                         NewRetAttrs, NewParamAttrs));
+  NewF->copyMetadata(&F, /*Offset=*/0);
+  F.getParent()->getFunctionList().insert(F.getIterator(), NewF);
+  NewF->takeName(&F);
+
+  // 2. rewrite every call: load the fields of a byval struct from the
+  // pointer the caller passed, store the returned sret struct to it
+
+  vector<CallInst *> Calls;
+  for (User *U : F.users()) {
+    Calls.push_back(cast<CallInst>(U));
+  }
+
+  for (CallInst *CI : Calls) {
+    IRBuilder<> Builder(CI);
+    const AttributeList &CallAttrs = CI->getAttributes();
+
+    vector<Value *> NewArgs;
+    vector<AttributeSet> NewArgAttrs;
+    Value *SRetPtr = NULL;
+    Align SRetAlign;
+
+    for (Argument &A : F.args()) {
+      unsigned ArgNo = A.getArgNo();
+      Value *ArgVal = CI->getArgOperand(ArgNo);
+      if (!SplitArg[ArgNo]) {
+        NewArgs.push_back(ArgVal);
+        NewArgAttrs.push_back(CallAttrs.getParamAttrs(ArgNo));
+        continue;
+      }
+
+      StructType *STy = getArgStructType(/*A=*/A);
+      Align ArgAlign = A.getParamAlign().valueOrOne();
+      if (A.hasStructRetAttr()) {
+        SRetPtr = ArgVal;
+        SRetAlign = ArgAlign;
+        continue;
+      }
+
+      const StructLayout *SL = DL.getStructLayout(STy);
+      for (unsigned i = 0; i < STy->getNumElements(); ++i) {
+        Value *IdxList[] = {Builder.getInt32(0), Builder.getInt32(i)};
+        Value *FieldPtr = Builder.CreateInBoundsGEP(STy, ArgVal, IdxList);
+        NewArgs.push_back(Builder.CreateAlignedLoad(
+                          STy->getElementType(i), FieldPtr,
+                          commonAlignment(ArgAlign, SL->getElementOffset(i))));
+        NewArgAttrs.push_back(AttributeSet());
+      }
+    }
+
+    CallInst *NewCI = Builder.CreateCall(NewF, NewArgs);
+    NewCI->setCallingConv(CI->getCallingConv());
+    NewCI->setTailCallKind(CI->getTailCallKind());
+    NewCI->setAttributes(AttributeList::get(Context, CallAttrs.getFnAttrs(),
+                                            (SRetPtr != NULL) ? AttributeSet() :
+                                            CallAttrs.getRetAttrs(),
+                                            NewArgAttrs));
+    NewCI->setDebugLoc(CI->getDebugLoc());
+
+    if (SRetPtr != NULL) {
+      Builder.CreateAlignedStore(NewCI, SRetPtr, SRetAlign);
+    } else {
+      CI->replaceAllUsesWith(NewCI);
+      NewCI->takeName(CI);
+    }
+    CI->eraseFromParent();
+  }
+
+  // 3. move the body. a byval struct is rebuilt in a local copy from the
+  // new parameters, an sret struct is a local whose value is returned
+
+  NewF->getBasicBlockList().splice(NewF->begin(), F.getBasicBlockList());
+
+  IRBuilder<> Builder(&*NewF->getEntryBlock().getFirstInsertionPt());
+  Function::arg_iterator NewArgIter = NewF->arg_begin();
+  AllocaInst *SRetAlloca = NULL;
+
+  for (Argument &A : F.args()) {
+    if (!SplitArg[A.getArgNo()]) {
+      A.replaceAllUsesWith(&*NewArgIter);
+      NewArgIter->takeName(&A);
+      ++NewArgIter;
+      continue;
+    }
+
+    StructType *STy = getArgStructType(/*A=*/A);
+    AllocaInst *LocalStruct = Builder.CreateAlloca(STy);
+    LocalStruct->setAlignment(std::max(A.getParamAlign().valueOrOne(),
+                                       DL.getPrefTypeAlign(STy)));
+
+    if (A.hasStructRetAttr()) {
+      SRetAlloca = LocalStruct;
+      NumSRetArgsSplit += 1;
+    } else {
+      for (unsigned i = 0; i < STy->getNumElements(); ++i) {
+        Value *IdxList[] = {Builder.getInt32(0), Builder.getInt32(i)};
+        Value *FieldPtr = Builder.CreateInBoundsGEP(STy, LocalStruct, IdxList);
+        NewArgIter->setName(A.getName() + "." + to_string(i));
+        Builder.CreateStore(&*NewArgIter, FieldPtr);
+        ++NewArgIter;
+      }
+      NumByValArgsSplit += 1;
+    }
+
+    A.replaceAllUsesWith(LocalStruct);
+    LocalStruct->takeName(&A);
+  }
+
+  if (SRetAlloca != NULL) {
+    for (BasicBlock &BB : *NewF) {
+      if (ReturnInst *RI = dyn_cast<ReturnInst>(BB.getTerminator())) {
+        Builder.SetInsertPoint(RI);
+        Builder.CreateRet(Builder.CreateLoad(SRetAlloca->getAllocatedType(),
+                                             SRetAlloca));
+        RI->eraseFromParent();
+      }
+    }
+  }
+
+  F.eraseFromParent();
+}
+
+
+//===----------------------------------------------------------------------===//
+//            interprocedural: internal global structs and arrays
+//===----------------------------------------------------------------------===//
+//
+
+// The module pass SROAGlobals applies the same rules to the internal
+// global variables of struct or small array type: if every use of the
+// global is U1 (a getelementptr, possibly a constant expression) or U2,
+// the global is replaced by one global per accessed field. Fields that
+// are never written become constant, so their loads can be folded.
+// A field that is itself an aggregate is looked at again, e.g.
+//   opt -scalarrepl-globals-ziangw2 -scalarrepl-ziangw2
+
+
+STATISTIC(NumGlobalsSplit, "Number of aggregate globals broken up");
+STATISTIC(NumGlobalFieldsConstant, "Number of field globals marked constant");
+
+
+namespace {
+  struct SROAGlobals : public ModulePass {
+    static char ID; // Pass identification
+    SROAGlobals() : ModulePass(ID) { }
+
+    // Entry point for the global part of the pass
+    bool runOnModule(Module &M);
+
+  private:
+
+    // return whether the given global variable can be broken up
+    // a helper function used in runOnModule()
+    bool canBeSplitGlobal(const GlobalVariable *GV);
+
+    // replace the global with one global per accessed field
+    // the new field globals are appended to NewGlobals
+    // a helper function used in runOnModule()
+    void splitGlobal(GlobalVariable *GV, vector<GlobalVariable *> &NewGlobals);
+
+    // when breaking up a global, the U1 type getelementptr (instruction or
+    // constant expression) should point into the field global instead
+    // a helper function used in splitGlobal()
+    void replaceGlobalGetElementPtr(GEPOperator *GEPO,
+                                    vector<GlobalVariable *> &FieldGlobals);
+
+    // return true if the memory behind Ptr is only ever read
+    // a helper function used in runOnModule()
+    bool isNeverWritten(const Value *Ptr);
+  };  // end of struct SROAGlobals
+}
+
+
+char SROAGlobals::ID = 0;
+static RegisterPass<SROAGlobals> Z("scalarrepl-globals-ziangw2",
+          "Scalar Replacement of Global Aggregates (by <netid>)",
+          false /* does not modify the CFG */,
+          false /* transformation, not just analysis */);
+
+
+// Public interface to create the global part of the pass.
+ModulePass *createMyScalarReplGlobalsPass() {
+  return new SROAGlobals();
+}
+
+
+bool SROAGlobals::runOnModule(Module &M) {
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "SROAGlobals::runOnModule\n";
+  #endif
+
+  // like step 2 of SROA, a worklist of the globals: the new field
+  // globals that are aggregates may be broken up again
+
+  vector<GlobalVariable *> GlobalWorkList;
+  for (GlobalVariable &GV : M.globals()) {
+    GlobalWorkList.push_back(&GV);
+  }
+
+  // the field globals may be broken up later, so keep weak handles
+
+  vector<WeakTrackingVH> FieldGlobals;
+  bool Changed = false;
+
+  while (!GlobalWorkList.empty()) {
+    GlobalVariable *GV = GlobalWorkList.back();
+    GlobalWorkList.pop_back();
+
+    if (!canBeSplitGlobal(/*GV=*/GV)) {
+      continue;
+    }
+
+    vector<GlobalVariable *> NewGlobals;
+    splitGlobal(/*GV=*/GV, /*NewGlobals=*/NewGlobals);
+    Changed = true;
+
+    for (GlobalVariable *NewGlobal : NewGlobals) {
+      GlobalWorkList.push_back(NewGlobal);
+      FieldGlobals.push_back(NewGlobal);
+    }
+  }
+
+  // finally, a field that is only ever read keeps its initial value
+
+  for (WeakTrackingVH &FieldVH : FieldGlobals) {
+    GlobalVariable *FieldGV = dyn_cast_or_null<GlobalVariable>(FieldVH);
+    if (FieldGV == NULL || FieldGV->isConstant()) {
+      continue;
+    }
+    if (isNeverWritten(/*Ptr=*/FieldGV)) {
+      FieldGV->setConstant(true);
+      NumGlobalFieldsConstant += 1;
+    }
+  }
+
+  return Changed;
+}
+
+
+// return whether the given global variable can be broken up
+// a helper function used in runOnModule()
+bool SROAGlobals::canBeSplitGlobal(const GlobalVariable *GV) {
+
+  // only the internal globals have all their uses in this module. a
+  // global placed in a section or comdat must keep its layout
+
+  if (!GV->hasLocalLinkage() || !GV->hasInitializer() ||
+      GV->isExternallyInitialized() || GV->hasSection() || GV->hasComdat()) {
+    return false;
+  }
+
+  // the same type check as canBeEliminatedStructAlloca()
+
+  Type *GlobalTy = GV->getValueType();
+  if (ArrayType *GlobalArrayTy = dyn_cast<ArrayType>(GlobalTy)) {
+    uint64_t NumElements = GlobalArrayTy->getNumElements();
+    if (NumElements == 0 || NumElements > MaxArrayElements) {
+      return false;
+    }
+  } else if (StructType *GlobalStructTy = dyn_cast<StructType>(GlobalTy)) {
+    if (GlobalStructTy->getNumElements() == 0) {
+      return false;
+    }
+  } else {
+    return false;
+  }
+
+  // every other global or constant still holding the address of the
+  // global makes it escape, unless it is a dead constant
+
+  GV->removeDeadConstantUsers();
+
+  return SROA::isSplittableAggregatePointer(/*Ptr=*/GV,
+                                           /*AggrTy=*/GlobalTy,
+                                           /*OnlyFieldUses=*/true);
+}
+
+
+// replace the global with one global per accessed field
+// the new field globals are appended to NewGlobals
+// a helper function used in runOnModule()
+void SROAGlobals::splitGlobal(GlobalVariable *GV,
+                              vector<GlobalVariable *> &NewGlobals) {
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "SROAGlobals::splitGlobal: [" << *GV << "]\n";
+  #endif
+
+  Module &M = *GV->getParent();
+  const DataLayout &DL = M.getDataLayout();
+  Type *GlobalTy = GV->getValueType();
+  StructType *GlobalStructTy = dyn_cast<StructType>(GlobalTy);
+  const StructLayout *GlobalStructLayout = (GlobalStructTy != NULL) ?
+                                           DL.getStructLayout(GlobalStructTy) : NULL;
+  unsigned NumElements = (GlobalStructTy != NULL) ?
+                         GlobalStructTy->getNumElements() :
+                         cast<ArrayType>(GlobalTy)->getNumElements();
+  Align GlobalAlign = DL.getPreferredAlign(GV);
+  Constant *Init = GV->getInitializer();
+
+  // firstly, find the fields that are accessed. the others get no global
+
+  vector<bool> FieldIsAccessed(NumElements, false);
+  for (User *U : GV->users()) {
+    if (GEPOperator *GEPO = dyn_cast<GEPOperator>(U)) {
+      FieldIsAccessed[cast<ConstantInt>(GEPO->getOperand(2))->getZExtValue()] = true;
+    }
+  }
+
+  // secondly, create a global per accessed field, with the matching part
+  // of the initializer and of the debug info of the old global
+
+  SmallVector<DIGlobalVariableExpression *, 1> GlobalDbgExprs;
+  GV->getDebugInfo(GlobalDbgExprs);
+
+  vector<GlobalVariable *> FieldGlobals;
+  for (unsigned i = 0; i < NumElements; ++i) {
+    if (!FieldIsAccessed[i]) {
+      FieldGlobals.push_back(NULL);
+      continue;
+    }
+
+    Type *FieldTy = (GlobalStructTy != NULL) ?
+                    GlobalStructTy->getElementType(i) :
+                    cast<ArrayType>(GlobalTy)->getElementType();
+    uint64_t FieldOffset = (GlobalStructLayout != NULL) ?
+                           GlobalStructLayout->getElementOffset(i) :
+                           i * DL.getTypeAllocSize(FieldTy);
+
+    GlobalVariable *FieldGV = new GlobalVariable(
+                              /*M=*/M,
+                              /*Ty=*/FieldTy,
+                              /*isConstant=*/GV->isConstant(),
+                              /*Linkage=*/GV->getLinkage(),
+                              /*Initializer=*/Init->getAggregateElement(i),
+                              /*Name=*/GV->getName() + "." + to_string(i),
+                              /*InsertBefore=*/GV,
+                              /*TLMode=*/GV->getThreadLocalMode(),
+                              /*AddressSpace=*/GV->getAddressSpace());
+    FieldGV->copyAttributesFrom(GV);
+    FieldGV->setAlignment(commonAlignment(GlobalAlign, FieldOffset));
+
+    for (DIGlobalVariableExpression *GlobalDbgExpr : GlobalDbgExprs) {
+      Optional<DIExpression *> FragmentExpr =
+        DIExpression::createFragmentExpression(
+                      /*Expr=*/GlobalDbgExpr->getExpression(),
+                      /*OffsetInBits=*/8 * FieldOffset,
+                      /*SizeInBits=*/DL.getTypeSizeInBits(FieldTy));
+      if (FragmentExpr.hasValue()) {
+        FieldGV->addDebugInfo(DIGlobalVariableExpression::get(
+                              M.getContext(),
+                              GlobalDbgExpr->getVariable(),
+                              FragmentExpr.getValue()));
+      }
+    }
+
+    FieldGlobals.push_back(FieldGV);
+    NewGlobals.push_back(FieldGV);
+  }
+
+  // thirdly, rewrite the uses, which are all U1 or U2
+
+  vector<User *> GlobalUsers(GV->user_begin(), GV->user_end());
+  for (User *U : GlobalUsers) {
+    if (GEPOperator *GEPO = dyn_cast<GEPOperator>(U)) {
+      replaceGlobalGetElementPtr(/*GEPO=*/GEPO, /*FieldGlobals=*/FieldGlobals);
+    } else {
+
+      // U2: the address of a defined global is never null
+
+      CmpInst *CI = cast<CmpInst>(U);
+      CI->replaceAllUsesWith(ConstantInt::getBool(
+                             CI->getContext(),
+                             CI->getPredicate() == CmpInst::ICMP_NE));
+      CI->eraseFromParent();
+    }
+  }
+
+  GV->eraseFromParent();
+  NumGlobalsSplit += 1;
+}
+
+
+// when breaking up a global, the U1 type getelementptr (instruction or
+// constant expression) should point into the field global instead
+// a helper function used in splitGlobal()
+void SROAGlobals::replaceGlobalGetElementPtr(GEPOperator *GEPO,
+                                             vector<GlobalVariable *> &FieldGlobals) {
+
+  // every index is a constant, so the new pointer is a constant as well:
+  // getelementptr @g, 0, n -> @g.n
+  // getelementptr @g, 0, n, a, ... -> getelementptr @g.n, 0, a, ...
+
+  unsigned FieldIdx = cast<ConstantInt>(GEPO->getOperand(2))->getZExtValue();
+  GlobalVariable *FieldGV = FieldGlobals[FieldIdx];
+
+  Constant *NewPtr = FieldGV;
+  if (GEPO->getNumOperands() > 3) {
+    vector<Constant *> IdxVec;
+    IdxVec.push_back(cast<Constant>(GEPO->getOperand(1)));  // ConstantInt of value 0
+    for (unsigned i = 3; i < GEPO->getNumOperands(); ++i) {
+      IdxVec.push_back(cast<Constant>(GEPO->getOperand(i)));
+    }
+    NewPtr = ConstantExpr::getInBoundsGetElementPtr(FieldGV->getValueType(),
+                                                    FieldGV, IdxVec);
+  }
+
+  GEPO->replaceAllUsesWith(NewPtr);
+  if (Instruction *GEPI = dyn_cast<Instruction>(GEPO)) {
+    GEPI->eraseFromParent();
+  } else {
+    cast<Constant>(GEPO)->destroyConstant();
+  }
+}
+
+
+// return true if the memory behind Ptr is only ever read
+// a helper function used in runOnModule()
+bool SROAGlobals::isNeverWritten(const Value *Ptr) {
+
+  for (const User *U : Ptr->users()) {
+    if (const LoadInst *LI = dyn_cast<LoadInst>(U)) {
+      if (LI->isVolatile()) {
+        return false;
+      }
+    } else if (isa<GEPOperator>(U) || isa<BitCastOperator>(U)) {
+      if (!isNeverWritten(/*Ptr=*/U)) {
+        return false;
+      }
+    } else if (!isa<CmpInst>(U)) {
+
+      // a store, a call or anything else that may write through it
+
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+//===----------------------------------------------------------------------===//
+//          interprocedural: profile-guided field reordering
+//===----------------------------------------------------------------------===//
+//
+
+// SROA only helps objects on the stack. The fields of a heap struct stay
+// in declaration order, so the few fields a hot loop touches may sit on
+// different cache lines. The module pass SROAFieldOrder reorders the
+// fields of a struct type by how often they are accessed, the hottest
+// first, so that they share a cache line:
+// 1. an instrumented run counts the loads and stores of every field and
+//    writes the counts to the profile file when the program exits
+//      opt -scalarrepl-reorder-ziangw2 -scalarrepl-reorder-ziangw2-instrument
+// 2. the fields are then reordered by the counts in the profile file
+//      opt -scalarrepl-reorder-ziangw2
+// like the U1 rule of SROA, a struct type is only reordered if its fields
+// are only reached by getelementptr, so no code depends on their offsets.
+// the objects may only be allocated, freed, copied and cleared as i8*,
+// and the type must not be part of anything visible outside the module.
+// the new layout must have the same size as the old one
+
+
+// the profile file has one line per field: <struct name> <field> <count>
+static cl::opt<string> FieldProfile(
+    "scalarrepl-reorder-ziangw2-profile", cl::init("fields.prof"), cl::Hidden,
+    cl::desc("File of the field access counts the fields are reordered by"));
+
+// instrument mode: count the field accesses instead of reordering, the
+// instrumented program writes the profile file when it exits
+static cl::opt<bool> InstrumentFields(
+    "scalarrepl-reorder-ziangw2-instrument", cl::init(false), cl::Hidden,
+    cl::desc("Instrument the field accesses to write the profile file"));
+
+STATISTIC(NumStructsReordered, "Number of struct types with their fields reordered");
+STATISTIC(NumFieldAccessesCounted, "Number of field accesses instrumented");
+
+
+// return whether Ty is STy or contains it, as an element or (with
+// ThroughPointers) behind a pointer
+static bool typeContainsStruct(Type *Ty, StructType *STy, bool ThroughPointers,
+                               SmallPtrSetImpl<Type *> &Visited) {
+  if (Ty == STy) {
+    return true;
+  }
+  if (!ThroughPointers && (Ty->isPointerTy() || Ty->isFunctionTy())) {
+    return false;
+  }
+  if (!Visited.insert(Ty).second) {
+    return false;
+  }
+  for (Type *SubTy : Ty->subtypes()) {
+    if (typeContainsStruct(SubTy, STy, ThroughPointers, Visited)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool typeContainsStruct(Type *Ty, StructType *STy, bool ThroughPointers) {
+  SmallPtrSet<Type *, 16> Visited;
+  return typeContainsStruct(Ty, STy, ThroughPointers, Visited);
+}
+
+
+namespace {
+  // maps the old types of the module to the new ones, in which the fields
+  // of the reordered struct types are permuted. a type that contains a
+  // reordered struct type, even behind a pointer, becomes a new type too
+  class ReorderedTypeMapper : public ValueMapTypeRemapper {
+  public:
+    ReorderedTypeMapper(const DenseMap<StructType *, vector<unsigned>> &NewFieldIndex)
+      : NewFieldIndex(NewFieldIndex) { }
+
+    Type *remapType(Type *SrcTy) override;
+
+  private:
+    const DenseMap<StructType *, vector<unsigned>> &NewFieldIndex;
+    DenseMap<Type *, Type *> MappedTypes;
+  };  // end of class ReorderedTypeMapper
+
+  struct SROAFieldOrder : public ModulePass {
+    static char ID; // Pass identification
+    SROAFieldOrder() : ModulePass(ID) { }
+
+    // Entry point for the field reordering part of the pass
+    bool runOnModule(Module &M);
+
+    // the allocation and free calls are recognized with the library info
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.addRequired<TargetLibraryInfoWrapperPass>();
+    }
+
+  private:
+
+    // old field index -> new field index of each struct type to reorder
+    // (or to instrument), in the order the struct types are found
+    DenseMap<StructType *, vector<unsigned>> NewFieldIndex;
+    vector<StructType *> StructsToReorder;
+
+    // the types that contain the struct type being checked
+    DenseMap<Type *, bool> ContainsCheckedStruct;
+
+    // read the field access counts of the profile file into FieldCounts
+    // return false if there is no profile file
+    // a helper function used in runOnModule()
+    bool readFieldProfile(StringMap<std::map<unsigned, uint64_t>> &FieldCounts);
+
+    // return whether no code in the module depends on the layout of STy
+    // a helper function used in runOnModule()
+    bool canReorderStruct(Module &M, StructType *STy);
+
+    // return whether Ty is STy or contains it, even behind a pointer
+    // a helper function used in canReorderStruct()
+    bool mentionsStruct(Type *Ty, StructType *STy);
+
+    // return whether I still works once the fields of STy are reordered
+    // a helper function used in canReorderStruct()
+    bool canRemapInstruction(const Instruction *I, StructType *STy,
+                             const TargetLibraryInfo &TLI);
+
+    // return whether the constant still works once the fields of STy are
+    // reordered. no constant expression may depend on the layout of STy
+    // a helper function used in canReorderStruct()
+    bool canRemapConstant(const Constant *C, StructType *STy);
+
+    // return whether U, a user of BytePtr, the i8* of an object of type
+    // ObjectPtrTy that holds STy (a cast to i8* or the raw pointer of an
+    // allocation), does not depend on the layout of STy: a free call, a
+    // lifetime marker, or a memset or a memcpy to another such pointer of
+    // whole objects
+    // a helper function used in canRemapInstruction()
+    bool isLayoutFreeBytePtrUser(const User *U, const Value *BytePtr,
+                                 Type *ObjectPtrTy, StructType *STy,
+                                 const TargetLibraryInfo &TLI);
+
+    // collect the field indices of a getelementptr that step into one of
+    // the struct types in NewFieldIndex: their operand numbers and structs
+    // a helper function used in instrumentFieldAccesses() and reorderFields()
+    void getReorderedFieldSteps(const User *GEP,
+                                vector<std::pair<unsigned, StructType *>> &Steps);
+
+    // give every field of the struct types in StructsToReorder a counter,
+    // bumped by every load and store of the field, and write the counters
+    // to the profile file when the program exits
+    // a helper function used in runOnModule()
+    void instrumentFieldAccesses(Module &M);
+
+    // permute the fields of the struct types in NewFieldIndex: rewrite the
+    // field index of every getelementptr and move every value to the new types
+    // a helper function used in runOnModule()
+    void reorderFields(Module &M);
+  };  // end of struct SROAFieldOrder
+}
+
+
+char SROAFieldOrder::ID = 0;
+static RegisterPass<SROAFieldOrder> W("scalarrepl-reorder-ziangw2",
+          "Profile-guided Struct Field Reordering (by <netid>)",
+          false /* does not modify the CFG */,
+          false /* transformation, not just analysis */);
+
+
+// Public interface to create the field reordering part of the pass.
+ModulePass *createMyFieldReorderPass() {
+  return new SROAFieldOrder();
+}
+
+
+bool SROAFieldOrder::runOnModule(Module &M) {
+
+  #ifdef _SROA_ZIANG_DEBUG
+  errs() << "SROAFieldOrder::runOnModule\n";
+  #endif
+
+  NewFieldIndex.clear();
+  StructsToReorder.clear();
+
+  // instrument mode: count the fields of every struct type that could be
+  // reordered
+
+  if (InstrumentFields) {
+    for (StructType *STy : M.getIdentifiedStructTypes()) {
+      if (canReorderStruct(/*M=*/M, /*STy=*/STy)) {
+        NewFieldIndex[STy] = vector<unsigned>();
+        StructsToReorder.push_back(STy);
+      }
+    }
+    if (StructsToReorder.empty()) {
+      return false;
+    }
+    instrumentFieldAccesses(/*M=*/M);
+    return true;
+  }
+
+  // firstly, order the fields of every struct type in the profile by
+  // their counts, the hottest first. fields of the same count keep their
+  // declaration order
+
+  StringMap<std::map<unsigned, uint64_t>> FieldCounts;
+  if (!readFieldProfile(/*FieldCounts=*/FieldCounts)) {
+    return false;
+  }
+
+  const DataLayout &DL = M.getDataLayout();
+  for (StructType *STy : M.getIdentifiedStructTypes()) {
+    if (!STy->hasName() || FieldCounts.count(STy->getName()) == 0 ||
+        STy->isOpaque()) {
+      continue;
+    }
+
+    const std::map<unsigned, uint64_t> &Counts = FieldCounts[STy->getName()];
+    unsigned NumFields = STy->getNumElements();
+    vector<uint64_t> CountOfField(NumFields, 0);
+    for (const std::pair<const unsigned, uint64_t> &Count : Counts) {
+      if (Count.first < NumFields) {
+        CountOfField[Count.first] = Count.second;
+      }
+    }
+
+    vector<unsigned> Order(NumFields);
+    std::iota(Order.begin(), Order.end(), 0);
+    std::stable_sort(Order.begin(), Order.end(), [&](unsigned A, unsigned B) {
+      return CountOfField[A] > CountOfField[B];
+    });
+    if (std::is_sorted(Order.begin(), Order.end())) {
+      continue;
+    }
+
+    // the size of the objects must not change: allocation sizes and
+    // memcpy lengths are plain integers
+
+    vector<Type *> NewFields;
+    for (unsigned OldIdx : Order) {
+      NewFields.push_back(STy->getElementType(OldIdx));
+    }
+    StructType *NewLayout = StructType::get(M.getContext(), NewFields,
+                                            STy->isPacked());
+    if (DL.getTypeAllocSize(NewLayout) != DL.getTypeAllocSize(STy)) {
+      continue;
+    }
+
+    if (!canReorderStruct(/*M=*/M, /*STy=*/STy)) {
+      continue;
+    }
+
+    vector<unsigned> NewIndex(NumFields);
+    for (unsigned i = 0; i < NumFields; ++i) {
+      NewIndex[Order[i]] = i;
+    }
+    NewFieldIndex[STy] = NewIndex;
+    StructsToReorder.push_back(STy);
+  }
+
+  if (StructsToReorder.empty()) {
+    return false;
+  }
+
+  // secondly, move the module to the new layouts
+
+  reorderFields(/*M=*/M);
+  NumStructsReordered += StructsToReorder.size();
+
+  return true;
+}
+
+
+// read the field access counts of the profile file into FieldCounts
+// return false if there is no profile file
+// a helper function used in runOnModule()
+bool SROAFieldOrder::readFieldProfile(
+                     StringMap<std::map<unsigned, uint64_t>> &FieldCounts) {
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer =
+    MemoryBuffer::getFile(FieldProfile);
+  if (!Buffer) {
+    errs() << "warning: cannot read the field profile " << FieldProfile << "\n";
+    return false;
+  }
+
+  // a struct name may contain spaces, so split at the last two
+
+  for (line_iterator Line(**Buffer, /*SkipBlanks=*/true, /*CommentMarker=*/'#');
+       !Line.is_at_eof(); ++Line) {
+    StringRef Rest, FieldStr, CountStr;
+    std::tie(Rest, CountStr) = Line->rtrim().rsplit(' ');
+    StringRef Name;
+    std::tie(Name, FieldStr) = Rest.rsplit(' ');
+
+    unsigned Field;
+    uint64_t Count;
+    if (Name.empty() || FieldStr.getAsInteger(10, Field) ||
+        CountStr.getAsInteger(10, Count)) {
+      continue;
+    }
+    FieldCounts[Name][Field] += Count;
+  }
+
+  return true;
+}
+
+
+// return whether no code in the module depends on the layout of STy
+// a helper function used in runOnModule()
+bool SROAFieldOrder::canReorderStruct(Module &M, StructType *STy) {
+
+  if (STy->isLiteral() || STy->isOpaque() || STy->isPacked() ||
+      STy->getNumElements() < 2) {
+    return false;
+  }
+
+  ContainsCheckedStruct.clear();
+
+  // the code outside the module only knows the old layout
+
+  for (GlobalVariable &GV : M.globals()) {
+    if (mentionsStruct(/*Ty=*/GV.getValueType(), /*STy=*/STy) &&
+        (!GV.hasLocalLinkage() || !GV.hasInitializer())) {
+      return false;
+    }
+    if (GV.hasInitializer() &&
+        !canRemapConstant(/*C=*/GV.getInitializer(), /*STy=*/STy)) {
+      return false;
+    }
+  }
+
+  for (GlobalAlias &GA : M.aliases()) {
+    if (mentionsStruct(/*Ty=*/GA.getValueType(), /*STy=*/STy)) {
+      return false;
+    }
+  }
+
+  for (Function &F : M) {
+    if (mentionsStruct(/*Ty=*/F.getFunctionType(), /*STy=*/STy)) {
+      if (F.isDeclaration() || !F.hasLocalLinkage()) {
+        return false;
+      }
+      for (Argument &A : F.args()) {
+        if ((A.hasPassPointeeByValueCopyAttr() || A.hasStructRetAttr()) &&
+            mentionsStruct(/*Ty=*/A.getType(), /*STy=*/STy)) {
+          return false;
+        }
+      }
+    }
+
+    if (F.isDeclaration()) {
+      continue;
+    }
+
+    const TargetLibraryInfo &TLI =
+      getAnalysis<TargetLibraryInfoWrapperPass>().getTLI(F);
+    for (BasicBlock &BB : F) {
+      for (Instruction &I : BB) {
+        if (!canRemapInstruction(/*I=*/&I, /*STy=*/STy, /*TLI=*/TLI)) {
+
+          #ifdef _SROA_ZIANG_DEBUG
+          errs() << "SROAFieldOrder: " << STy->getName() << " is used by ["
+                 << I << "]\n";
+          #endif
+
+          return false;
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+
+// return whether Ty is STy or contains it, even behind a pointer
+// a helper function used in canReorderStruct()
+bool SROAFieldOrder::mentionsStruct(Type *Ty, StructType *STy) {
+  DenseMap<Type *, bool>::iterator It = ContainsCheckedStruct.find(Ty);
+  if (It != ContainsCheckedStruct.end()) {
+    return It->second;
+  }
+  bool Contains = typeContainsStruct(Ty, STy, /*ThroughPointers=*/true);
+  ContainsCheckedStruct[Ty] = Contains;
+  return Contains;
+}
+
+
+// return whether I still works once the fields of STy are reordered
+// a helper function used in canReorderStruct()
+bool SROAFieldOrder::canRemapInstruction(const Instruction *I, StructType *STy,
+                                         const TargetLibraryInfo &TLI) {
+
+  // a getelementptr constant expression into STy is turned into an
+  // instruction before the reordering, the others must not depend on the
+  // layout at all
+
+  for (const Use &Op : I->operands()) {
+    const Constant *C = dyn_cast<Constant>(Op.get());
+    if (C == NULL) {
+      continue;
+    }
+    const GEPOperator *GEPO = dyn_cast<GEPOperator>(C);
+    if (GEPO != NULL && !isa<GlobalValue>(C)) {
+      for (const Use &GEPOp : GEPO->operands()) {
+        if (!canRemapConstant(/*C=*/cast<Constant>(GEPOp.get()), /*STy=*/STy)) {
+          return false;
+        }
+      }
+    } else if (!canRemapConstant(/*C=*/C, /*STy=*/STy)) {
+      return false;
+    }
+  }
+
+  // the instructions that take a field by its position
+
+  if (isa<ExtractValueInst>(I) || isa<InsertValueInst>(I)) {
+    return !mentionsStruct(/*Ty=*/I->getOperand(0)->getType(), /*STy=*/STy);
+  }
+  if (isa<VAArgInst>(I) || isa<IntToPtrInst>(I)) {
+    return !mentionsStruct(/*Ty=*/I->getType(), /*STy=*/STy);
+  }
+
+  // the integer of a pointer to STy may step to a field by its offset
+
+  if (isa<PtrToIntInst>(I)) {
+    return !mentionsStruct(/*Ty=*/I->getOperand(0)->getType(), /*STy=*/STy);
+  }
+
+  // a cast between a pointer to STy and i8* is fine if the i8* doesn't
+  // look at the bytes: a new object from malloc, or a free/memset/memcpy
+
+  if (const CastInst *CI = dyn_cast<CastInst>(I)) {
+    Type *SrcTy = CI->getSrcTy();
+    Type *DestTy = CI->getDestTy();
+    bool SrcHoldsStruct = SrcTy->isPointerTy() &&
+      typeContainsStruct(SrcTy->getPointerElementType(), STy,
+                         /*ThroughPointers=*/false);
+    bool DestHoldsStruct = DestTy->isPointerTy() &&
+      typeContainsStruct(DestTy->getPointerElementType(), STy,
+                         /*ThroughPointers=*/false);
+    if (!SrcHoldsStruct && !DestHoldsStruct) {
+      return true;
+    }
+    if (SrcHoldsStruct == DestHoldsStruct) {
+      return false;
+    }
+
+    Type *BytePtrTy = Type::getInt8PtrTy(I->getContext(),
+                                         CI->getSrcTy()->getPointerAddressSpace());
+    if (DestHoldsStruct) {
+      const Value *RawPtr = CI->getOperand(0);
+      if (SrcTy != BytePtrTy || !isAllocationFn(RawPtr, &TLI)) {
+        return false;
+      }
+
+      // the raw pointer of the new object is also used besides the cast,
+      // e.g. by a memset before it. other casts to the same type and null
+      // checks are fine
+
+      for (const User *U : RawPtr->users()) {
+        const CastInst *OtherCI = dyn_cast<CastInst>(U);
+        if ((OtherCI != NULL && OtherCI->getDestTy() == DestTy) || isa<ICmpInst>(U)) {
+          continue;
+        }
+        if (!isLayoutFreeBytePtrUser(/*U=*/U, /*BytePtr=*/RawPtr,
+                                     /*ObjectPtrTy=*/DestTy, /*STy=*/STy, /*TLI=*/TLI)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    if (DestTy != BytePtrTy) {
+      return false;
+    }
+    for (const User *U : CI->users()) {
+      if (!isLayoutFreeBytePtrUser(/*U=*/U, /*BytePtr=*/CI,
+                                   /*ObjectPtrTy=*/SrcTy, /*STy=*/STy, /*TLI=*/TLI)) {
+        return false;
+      }
+    }
+    return true;
+  }
 
-      // need to ensure that GEPI actually is the pointer argument of the store
+  // a struct passed in memory by value keeps the layout of the caller
 
-      if (SI->getOperand(1) != GEPI) {
-        #ifdef _SROA_ZIANG_DEBUG
-        errs() << "isU1TypeGetElementPtr: invalid store [" << *SI << "]\n";
-        #endif
+  if (const CallBase *CB = dyn_cast<CallBase>(I)) {
+    for (unsigned i = 0; i < CB->arg_size(); ++i) {
+      if ((CB->isPassPointeeByValueArgument(i) ||
+           CB->paramHasAttr(i, Attribute::StructRet)) &&
+          mentionsStruct(/*Ty=*/CB->getArgOperand(i)->getType(), /*STy=*/STy)) {
         return false;
       }
-    } else {
-      #ifdef _SROA_ZIANG_DEBUG
-      errs() << "isU1TypeGetElementPtr: invalid use [" << *U << "]\n";
-      #endif
-      return false;
     }
   }
 
-  #ifdef _SROA_ZIANG_DEBUG
-  errs() << "U1: [" << *GEPI << "]\n";
-  #endif
+  // getelementptr, load, store, alloca, phi, ... only carry the new types
+
   return true;
 }
 
 
-// return true if the given comparison instruction satisfy the following:
-// In a ’eq’ or ’ne’ comparison instruction,
-// where the other operand is the NULL pointer value
-// a helper function used in replaceStructAllocsWithIndividualFields()
-bool SROA::isU2TypeEqOrNe(const CmpInst *CI, const User *Val) {
-
-  // 1. check that it is a 'eq' or 'ne' comparison
-  // Ziang: it seems that Ptr==NULL is actually ICMP_EQ and ICMP_NEQ
-  // I tested it using llvm-dis and clang
-
-  #ifdef _SROA_ZIANG_DEBUG
-  errs() << "isU2TypeEqOrNe: [" << *CI << "]\n";
-  #endif
+// return whether the constant still works once the fields of STy are
+// reordered. no constant expression may depend on the layout of STy
+// a helper function used in canReorderStruct()
+bool SROAFieldOrder::canRemapConstant(const Constant *C, StructType *STy) {
 
-  CmpInst::Predicate CIPredicate = CI->getPredicate();
-  bool IsNeOrEq = (CIPredicate == CmpInst::ICMP_EQ) || (CIPredicate == CmpInst::ICMP_NE);
-  if (!IsNeOrEq) {
-    return false;
+  if (isa<GlobalValue>(C) || isa<ConstantData>(C)) {
+    return true;
   }
 
-  // 2. check that one operand is Val and the other is Null
+  // a constant struct would need its fields permuted as well
 
-  unsigned NumOperands = CI->getNumOperands();
-  if (NumOperands != 2) {
+  if (typeContainsStruct(C->getType(), STy, /*ThroughPointers=*/false)) {
     return false;
   }
 
-  Value *CIOperand0 = CI->getOperand(0);
-  Value *CIOperand1 = CI->getOperand(1);
-
-  if (CIOperand0 == Val) {
-    if (!isa<ConstantPointerNull>(CIOperand1)) {
+  if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(C)) {
+    if (CE->isCast() &&
+        (mentionsStruct(/*Ty=*/CE->getType(), /*STy=*/STy) ||
+         mentionsStruct(/*Ty=*/CE->getOperand(0)->getType(), /*STy=*/STy))) {
       return false;
     }
-  } else if (CIOperand1 == Val) {
-    if (!isa<ConstantPointerNull>(CIOperand0)) {
-      return false;
+    if (const GEPOperator *GEPO = dyn_cast<GEPOperator>(CE)) {
+      for (gep_type_iterator GTI = gep_type_begin(GEPO), E = gep_type_end(GEPO);
+           GTI != E; ++GTI) {
+        if (GTI.getStructTypeOrNull() == STy) {
+          return false;
+        }
+      }
     }
-  } else {
-
-    // not possible to reach here because one of the two operands
-    // must be Val
+  }
 
-    assert(false && "isU2TypeEqOrNe reaches unpossible place - internal error");
-    return false;
+  for (const Use &Op : C->operands()) {
+    if (!canRemapConstant(/*C=*/cast<Constant>(Op.get()), /*STy=*/STy)) {
+      return false;
+    }
   }
 
-  #ifdef _SROA_ZIANG_DEBUG
-  errs() << "U2: [" << *CI << "]\n";
-  #endif
   return true;
 }
 
 
-//===----------------------------------------------------------------------===//
-//                      step 2.2: eliminate the aggregate alloca
-//===----------------------------------------------------------------------===//
-//
-
-
-// actually eliminate the struct alloca
-// replace it with allocas of individual fields
-// return a vector of sub-aggregate types
-// a helper function used in replaceStructAllocsWithIndividualFields()
-vector<AllocaInst *> * SROA::eliminateStructAlloca(AllocaInst *AI, Function &F) {
-  #ifdef _SROA_ZIANG_DEBUG
-  errs() << "eliminateStructAlloca: [" << *AI << "]\n";
-  #endif
-
-  // firstly, replace the entire struct alloca with individual allocs
-  // of each fields. These new allocas will be placed at the begining
-  // of the function.
+// return whether U, a user of BytePtr, the i8* of an object of type
+// ObjectPtrTy that holds STy (a cast to i8* or the raw pointer of an
+// allocation), does not depend on the layout of STy: a free call, a
+// lifetime marker, or a memset or a memcpy to another such pointer of
+// whole objects
+// a helper function used in canRemapInstruction()
+bool SROAFieldOrder::isLayoutFreeBytePtrUser(const User *U, const Value *BytePtr,
+                                             Type *ObjectPtrTy, StructType *STy,
+                                             const TargetLibraryInfo &TLI) {
+
+  if (const MemIntrinsic *MI = dyn_cast<MemIntrinsic>(U)) {
+
+    // 1. the length must be a multiple of the size of the whole object,
+    // either a constant or a count of objects times such a constant. a
+    // shorter memset or memcpy only covers the fields at its start. the
+    // object may be an outer struct that holds STy at a nonzero offset, so
+    // a multiple of the size of STy is not enough
+
+    uint64_t ObjectSize = MI->getModule()->getDataLayout().getTypeAllocSize(
+        ObjectPtrTy->getPointerElementType());
+    const Value *Length = MI->getLength();
+    const BinaryOperator *Mul = dyn_cast<BinaryOperator>(Length);
+    if (Mul != NULL && Mul->getOpcode() == Instruction::Mul) {
+      Length = isa<ConstantInt>(Mul->getOperand(1)) ? Mul->getOperand(1) :
+                                                       Mul->getOperand(0);
+    }
+    const ConstantInt *ConstLength = dyn_cast<ConstantInt>(Length);
+    if (ConstLength == NULL || ConstLength->getZExtValue() % ObjectSize != 0) {
+      return false;
+    }
 
-  BasicBlock *FirstBlockInFunc = &F.getEntryBlock();
-  Instruction *FirstInstInFunc = FirstBlockInFunc->getFirstNonPHI();
+    // 2. a memset writes the same byte everywhere. a memcpy copies from/to
+    // another object of the same type
 
-  StructType *AllocaStructTy = dyn_cast<StructType>(AI->getAllocatedType());
-  if (AllocaStructTy == NULL) {
+    if (const MemSetInst *MSI = dyn_cast<MemSetInst>(MI)) {
+      return MSI->getRawDest() == BytePtr;
+    }
 
-    // since the alloca instruction passes my previous test
-    // the alloca type has to be struct
+    const MemTransferInst *MTI = cast<MemTransferInst>(MI);
+    const Value *Other = (MTI->getRawDest() == BytePtr) ? MTI->getRawSource() :
+                                                          MTI->getRawDest();
+    const CastInst *OtherCast = dyn_cast<CastInst>(Other);
+    return OtherCast != NULL && OtherCast->getSrcTy() == ObjectPtrTy;
+  }
 
-    assert(false && "the type of the alloca instruction isn't StructType");
-    return NULL;
+  if (const IntrinsicInst *II = dyn_cast<IntrinsicInst>(U)) {
+    return II->isLifetimeStartOrEnd();
   }
 
-  // I keep a vector of new alloca instructions for fields of
-  // the old alloca instructions in order so that when I am about
-  // to replace the usage of old alloca, I know how to deal with it.
-  // NameCountForNewAllocas is used for handling getelementptr
+  return isFreeCall(U, &TLI) != NULL;
+}
 
-  // Also, maintain a vector of new aggregate type allocas because
-  // they may also be eliminatable.
 
-  vector<AllocaInst *> NewAllocsForAI;
-  vector<AllocaInst *> *SubAggrAllocas = new vector<AllocaInst *>();
+// collect the field indices of a getelementptr that step into one of
+// the struct types in NewFieldIndex: their operand numbers and structs
+// a helper function used in instrumentFieldAccesses() and reorderFields()
+void SROAFieldOrder::getReorderedFieldSteps(const User *GEP,
+                     vector<std::pair<unsigned, StructType *>> &Steps) {
+  unsigned OperandNo = 1;
+  for (gep_type_iterator GTI = gep_type_begin(GEP), E = gep_type_end(GEP);
+       GTI != E; ++GTI, ++OperandNo) {
+    StructType *STy = GTI.getStructTypeOrNull();
+    if (STy != NULL && NewFieldIndex.count(STy)) {
+      Steps.push_back(std::make_pair(OperandNo, STy));
+    }
+  }
+}
 
-  // add an alloca for each field of the struct
 
-  for (unsigned i = 0, NumElements = AllocaStructTy->getNumElements();
-       i < NumElements; ++i) {
+// give every field of the struct types in StructsToReorder a counter,
+// bumped by every load and store of the field, and write the counters
+// to the profile file when the program exits
+// a helper function used in runOnModule()
+void SROAFieldOrder::instrumentFieldAccesses(Module &M) {
 
-    Type *IthAllocaTy = AllocaStructTy->getElementType(i);
+  LLVMContext &Context = M.getContext();
 
-    // depends on whether the first basic block in this function has 
-    // an instruction or not.
+  DenseMap<StructType *, unsigned> FirstCounter;
+  unsigned NumCounters = 0;
+  for (StructType *STy : StructsToReorder) {
+    FirstCounter[STy] = NumCounters;
+    NumCounters += STy->getNumElements();
+  }
 
-    AllocaInst *IthAllocaInst;
+  ArrayType *CountersTy = ArrayType::get(Type::getInt64Ty(Context), NumCounters);
+  GlobalVariable *Counters = new GlobalVariable(
+                             /*M=*/M,
+                             /*Ty=*/CountersTy,
+                             /*isConstant=*/false,
+                             /*Linkage=*/GlobalValue::InternalLinkage,
+                             /*Initializer=*/ConstantAggregateZero::get(CountersTy),
+                             /*Name=*/"scalarrepl.field.counts");
+
+  // 1. a load or store through a field, or through an element of an
+  // array in the field, bumps the counter of the field
+
+  for (Function &F : M) {
+    for (BasicBlock &BB : F) {
+      for (Instruction &I : BB) {
+        const Value *Ptr = getLoadStorePointerOperand(&I);
+        vector<unsigned> FieldCounters;
+        while (Ptr != NULL && isa<GEPOperator>(Ptr)) {
+          const GEPOperator *GEPO = cast<GEPOperator>(Ptr);
+          vector<std::pair<unsigned, StructType *>> Steps;
+          getReorderedFieldSteps(/*GEP=*/GEPO, /*Steps=*/Steps);
+          for (const std::pair<unsigned, StructType *> &Step : Steps) {
+            FieldCounters.push_back(FirstCounter[Step.second] +
+              cast<ConstantInt>(GEPO->getOperand(Step.first))->getZExtValue());
+          }
+          Ptr = GEPO->getPointerOperand();
+        }
 
-    if (FirstInstInFunc != NULL) {
-      IthAllocaInst = new AllocaInst(
-                      /*Ty=*/IthAllocaTy,
-                      /*AddrSpace=*/AI->getType()->getAddressSpace(), 
-                      /*ArraySize=*/NULL,
-                      /*Name=*/"",    // let LLVM resolves naming conflict
-                      /*InsertBefore=*/FirstInstInFunc);
-    } else {
-      IthAllocaInst = new AllocaInst(
-                      /*Ty=*/IthAllocaTy,
-                      /*AddrSpace=*/AI->getType()->getAddressSpace(), 
-                      /*ArraySize=*/NULL,
-                      /*Name=*/"",    // let LLVM resolves naming conflict
-                      /*InsertAtEnd=*/FirstBlockInFunc);
+        IRBuilder<> Builder(&I);
+        for (unsigned Counter : FieldCounters) {
+          Value *CounterPtr = Builder.CreateConstInBoundsGEP2_32(CountersTy,
+                                                                 Counters, 0,
+                                                                 Counter);
+          Value *Count = Builder.CreateLoad(Builder.getInt64Ty(), CounterPtr);
+          Builder.CreateStore(Builder.CreateAdd(Count, Builder.getInt64(1)),
+                              CounterPtr);
+          NumFieldAccessesCounted += 1;
+        }
+      }
     }
+  }
 
-    #ifdef _SROA_ZIANG_DEBUG
-    errs() << i << "th inst: [" << *IthAllocaInst << "]\n";
-    #endif
-
-    NewAllocsForAI.push_back(IthAllocaInst);
-
-    if (IthAllocaTy->isAggregateType()) {
-      SubAggrAllocas->push_back(IthAllocaInst);
+  // 2. a destructor of the module writes a line per field to the profile
+  // file: <struct name> <field> <count>
+
+  Function *Dump = Function::Create(
+                   /*Ty=*/FunctionType::get(Type::getVoidTy(Context), false),
+                   /*Linkage=*/GlobalValue::InternalLinkage,
+                   /*N=*/"scalarrepl.field.counts.dump",
+                   /*M=*/&M);
+  BasicBlock *EntryBB = BasicBlock::Create(Context, "entry", Dump);
+  BasicBlock *WriteBB = BasicBlock::Create(Context, "write", Dump);
+  BasicBlock *ExitBB = BasicBlock::Create(Context, "exit", Dump);
+
+  IRBuilder<> Builder(EntryBB);
+  Type *BytePtrTy = Builder.getInt8PtrTy();
+  FunctionCallee FOpen = M.getOrInsertFunction("fopen", BytePtrTy,
+                                               BytePtrTy, BytePtrTy);
+  FunctionCallee FPrintf = M.getOrInsertFunction("fprintf",
+                           FunctionType::get(Builder.getInt32Ty(), {BytePtrTy},
+                                             /*isVarArg=*/true));
+  FunctionCallee FClose = M.getOrInsertFunction("fclose", Builder.getInt32Ty(),
+                                                BytePtrTy);
+
+  Value *File = Builder.CreateCall(FOpen,
+                                   {Builder.CreateGlobalStringPtr(FieldProfile),
+                                    Builder.CreateGlobalStringPtr("w")});
+  Builder.CreateCondBr(Builder.CreateIsNull(File), ExitBB, WriteBB);
+
+  Builder.SetInsertPoint(WriteBB);
+  Value *Format = Builder.CreateGlobalStringPtr("%s %u %llu\n");
+  for (StructType *STy : StructsToReorder) {
+    Value *Name = Builder.CreateGlobalStringPtr(STy->getName());
+    for (unsigned i = 0; i < STy->getNumElements(); ++i) {
+      Value *CounterPtr = Builder.CreateConstInBoundsGEP2_32(CountersTy, Counters,
+                                                             0, FirstCounter[STy] + i);
+      Value *Count = Builder.CreateLoad(Builder.getInt64Ty(), CounterPtr);
+      Builder.CreateCall(FPrintf, {File, Format, Name, Builder.getInt32(i), Count});
     }
   }
+  Builder.CreateCall(FClose, {File});
+  Builder.CreateBr(ExitBB);
 
-  // Secondly, I handle each usage of the replaced alloca.
-  // because of the previous test canBeEliminatedStructAlloca()
-  // each usage should only be U1 or U2
-  // in various places below I've insert some asserts to check that
+  Builder.SetInsertPoint(ExitBB);
+  Builder.CreateRetVoid();
 
-  // maintain a vector of old usages of the old allocas to be erased later
-  // we can't erase them in the for loop because it might affect the iterator
+  appendToGlobalDtors(M, Dump, /*Priority=*/65535);
+}
 
-  vector<Instruction *> UserInstToBeErased;
 
-  for (User *U : AI->users()) {
-    if (GetElementPtrInst *GEPI = dyn_cast<GetElementPtrInst>(U)) {
-      replaceU1TypeGetElementPtr(/*GEPI=*/GEPI,
-                                 /*F=*/F,
-                                 /*NewAllocas=*/NewAllocsForAI);
-      UserInstToBeErased.push_back(GEPI);
-    } else if (CmpInst *CI = dyn_cast<CmpInst>(U)) {
-      replaceU2TypeEqOrNe(/*CI=*/CI,
-                          /*F=*/F,
-                          /*NewAllocas=*/NewAllocsForAI);
-      UserInstToBeErased.push_back(CI);
-    } else {
-      assert(false && "One user of the replaced alloca isn't U1 or U2");
+// permute the fields of the struct types in NewFieldIndex: rewrite the
+// field index of every getelementptr and move every value to the new types
+// a helper function used in runOnModule()
+void SROAFieldOrder::reorderFields(Module &M) {
+
+  // 1. a getelementptr constant expression into a reordered struct type
+  // becomes an instruction, so that its field index can be rewritten
+
+  for (Function &F : M) {
+    for (BasicBlock &BB : F) {
+      for (Instruction &I : BB) {
+        for (unsigned OpIdx = 0; OpIdx < I.getNumOperands(); ++OpIdx) {
+          ConstantExpr *CE = dyn_cast<ConstantExpr>(I.getOperand(OpIdx));
+          if (CE == NULL || CE->getOpcode() != Instruction::GetElementPtr) {
+            continue;
+          }
+          vector<std::pair<unsigned, StructType *>> Steps;
+          getReorderedFieldSteps(/*GEP=*/CE, /*Steps=*/Steps);
+          if (Steps.empty()) {
+            continue;
+          }
+
+          // an incoming value of a phi is computed in the incoming block, and
+          // all the entries of the same block must stay the same value
+
+          Instruction *GEPI = CE->getAsInstruction();
+          if (PHINode *PN = dyn_cast<PHINode>(&I)) {
+            BasicBlock *IncomingBB = PN->getIncomingBlock(OpIdx);
+            GEPI->insertBefore(IncomingBB->getTerminator());
+            PN->setIncomingValueForBlock(IncomingBB, GEPI);
+          } else {
+            GEPI->insertBefore(&I);
+            I.setOperand(OpIdx, GEPI);
+          }
+        }
+      }
     }
   }
 
-  // Finally, eliminate all the uses of the old allocas and then
-  // erase the old alloca
+  // 2. rewrite the field indices, while the old types are still there to
+  // find them
 
-  for (Instruction *UserInst : UserInstToBeErased) {
-    UserInst->eraseFromParent();
-  }
-  AI->eraseFromParent();
+  for (Function &F : M) {
+    for (BasicBlock &BB : F) {
+      for (Instruction &I : BB) {
+        GetElementPtrInst *GEPI = dyn_cast<GetElementPtrInst>(&I);
+        if (GEPI == NULL) {
+          continue;
+        }
+        vector<std::pair<unsigned, StructType *>> Steps;
+        getReorderedFieldSteps(/*GEP=*/GEPI, /*Steps=*/Steps);
 
-  // return a vector of new aggregate type allocas because
-  // they may also be eliminatable.
+        // the steps after a field index are found through it, so the new
+        // indices are only set once all of them are known
 
-  return SubAggrAllocas;
-}
+        vector<Value *> NewIndices;
+        for (const std::pair<unsigned, StructType *> &Step : Steps) {
+          ConstantInt *OldIdx = cast<ConstantInt>(GEPI->getOperand(Step.first));
+          NewIndices.push_back(ConstantInt::get(OldIdx->getType(),
+                               NewFieldIndex[Step.second][OldIdx->getZExtValue()]));
+        }
+        for (unsigned i = 0; i < Steps.size(); ++i) {
+          GEPI->setOperand(Steps[i].first, NewIndices[i]);
+        }
+      }
+    }
+  }
 
+  // 3. a global or function whose type changes is created again with the
+  // new type, everything else is moved to the new types in place
 
-// when eliminating an alloca, the U1 type getelementptr use should be
-// modified apropriately
-// a helper function used in eliminateStructAlloca()
-void SROA::replaceU1TypeGetElementPtr(GetElementPtrInst *GEPI,
-                                      Function &F,
-                                      vector<AllocaInst *> &NewAllocs) {
-  
-  #ifdef _SROA_ZIANG_DEBUG
-  errs() << "replaceU1TypeGetElementPtr: [" << *GEPI << "]\n";
-  #endif
+  ReorderedTypeMapper TypeMapper(NewFieldIndex);
+  ValueToValueMapTy VMap;
+  RemapFlags Flags = RF_IgnoreMissingLocals | RF_NoModuleLevelChanges;
 
-  unsigned NumOperands = GEPI->getNumOperands();
-  if (NumOperands < 3) {
-    assert(false && "the numOperands for getelementptr can't be < 3");
-    return;
+  vector<GlobalVariable *> OldGlobals;
+  for (GlobalVariable &GV : M.globals()) {
+    if (TypeMapper.remapType(GV.getValueType()) != GV.getValueType()) {
+      OldGlobals.push_back(&GV);
+    }
   }
-
-  // figure out which field this getelementptr is trying to access
-
-  ConstantInt *FieldConst = dyn_cast<ConstantInt>(GEPI->getOperand(2));
-  if (FieldConst == NULL) {
-    assert(false && "the third argument of U1 Type must be a ConstantInt");
-    return;
+  for (GlobalVariable *GV : OldGlobals) {
+    GlobalVariable *NewGV = new GlobalVariable(
+                            /*M=*/M,
+                            /*Ty=*/TypeMapper.remapType(GV->getValueType()),
+                            /*isConstant=*/GV->isConstant(),
+                            /*Linkage=*/GV->getLinkage(),
+                            /*Initializer=*/NULL,
+                            /*Name=*/"",
+                            /*InsertBefore=*/GV,
+                            /*TLMode=*/GV->getThreadLocalMode(),
+                            /*AddressSpace=*/GV->getAddressSpace());
+    NewGV->copyAttributesFrom(GV);
+    NewGV->copyMetadata(GV, /*Offset=*/0);
+    NewGV->takeName(GV);
+    VMap[GV] = NewGV;
   }
-  int FieldConstVal = FieldConst->getSExtValue();
-
-  AllocaInst *StructFieldValue = NewAllocs[FieldConstVal];
-
-  // there are essentially two types of getelementptr to replace
-
-  if (NumOperands == 3) {
-    // 1. getelementptr %struct %1, i32 0, i32 n (where n is an integer)
-    // for this type of getelementptr, we can simply get rid of the whole GEPI
-    // and replace each use of it with the alloca of the individual field
 
-    GEPI->replaceAllUsesWith(/*V=*/StructFieldValue);
-  } else {
-    // 2. getelementptr %struct %1, i32 0, i32 n, i32 a ...
-    // for this type, it means that the new alloca is also an aggregate type
-    // in this case, create a new getelementptr inst to replace the old one
-    // with one less layer of pointer arithmetic:
-    // getelementptr %struct %1, i32 0, i32 n, i32 a ...
-    // -> getelementptr %field %2, i32 0, i32 a, ...
+  vector<Function *> OldFunctions;
+  for (Function &F : M) {
+    if (TypeMapper.remapType(F.getFunctionType()) != F.getFunctionType()) {
+      OldFunctions.push_back(&F);
+    }
+  }
+  for (Function *F : OldFunctions) {
+    Function *NewF = Function::Create(
+                     /*Ty=*/cast<FunctionType>(TypeMapper.remapType(F->getFunctionType())),
+                     /*Linkage=*/F->getLinkage(),
+                     /*AddrSpace=*/F->getAddressSpace());
+    NewF->copyAttributesFrom(F);
+    NewF->copyMetadata(F, /*Offset=*/0);
+    M.getFunctionList().insert(F->getIterator(), NewF);
+    NewF->takeName(F);
+    NewF->getBasicBlockList().splice(NewF->begin(), F->getBasicBlockList());
+
+    Function::arg_iterator NewArgIter = NewF->arg_begin();
+    for (Argument &A : F->args()) {
+      VMap[&A] = &*NewArgIter;
+      NewArgIter->takeName(&A);
+      ++NewArgIter;
+    }
+    VMap[F] = NewF;
+  }
 
-    vector<Value *> IdxVec;
-    IdxVec.push_back(GEPI->getOperand(1));  // ConstantInt of value 0
-    for (unsigned i = 3; i < NumOperands; i++) {
-      IdxVec.push_back(GEPI->getOperand(i));
+  for (GlobalVariable &GV : M.globals()) {
+    if (GV.hasInitializer() && VMap.count(&GV) == 0) {
+      GV.setInitializer(MapValue(GV.getInitializer(), VMap, Flags, &TypeMapper));
     }
-    ArrayRef<Value *> IdxList(IdxVec);
+  }
+  for (GlobalVariable *GV : OldGlobals) {
+    cast<GlobalVariable>(VMap[GV])->setInitializer(
+      MapValue(GV->getInitializer(), VMap, Flags, &TypeMapper));
+  }
 
-    GetElementPtrInst *NewGEPI = GetElementPtrInst::CreateInBounds(
-                                  /*PointeeType=*/StructFieldValue->getAllocatedType(),
-                                  /*Ptr=*/StructFieldValue,
-                                  /*IdxList=*/IdxList,
-                                  /*NameStr=*/"",       // let LLVM resolves naming conflicts
-                                  /*InsertBefore=*/GEPI);
+  for (Function &F : M) {
+    for (BasicBlock &BB : F) {
+      for (Instruction &I : BB) {
+        RemapInstruction(&I, VMap, Flags, &TypeMapper);
+      }
+    }
+  }
 
-    #ifdef _SROA_ZIANG_DEBUG
-    errs() << "NewGEPI: " << *NewGEPI << "\n";
-    #endif
+  // 4. erase the old globals and functions. anything left pointing to one
+  // gets the new one instead
 
-    GEPI->replaceAllUsesWith(/*V=*/NewGEPI);
+  for (GlobalVariable *GV : OldGlobals) {
+    GV->dropAllReferences();
+  }
+  for (Function *F : OldFunctions) {
+    F->dropAllReferences();
+  }
+  for (GlobalVariable *GV : OldGlobals) {
+    GV->removeDeadConstantUsers();
+    if (!GV->use_empty()) {
+      GV->replaceAllUsesWith(ConstantExpr::getBitCast(cast<Constant>(VMap[GV]),
+                                                      GV->getType()));
+    }
+    GV->eraseFromParent();
+  }
+  for (Function *F : OldFunctions) {
+    F->removeDeadConstantUsers();
+    if (!F->use_empty()) {
+      F->replaceAllUsesWith(ConstantExpr::getBitCast(cast<Constant>(VMap[F]),
+                                                     F->getType()));
+    }
+    F->eraseFromParent();
   }
 }
 
 
-// when eliminating an alloca, the U2 type nq/ne use should be
-// modified apropriately
-// a helper function used in eliminateStructAlloca()
-void SROA::replaceU2TypeEqOrNe(CmpInst *CI,
-                               Function &F,
-                               vector<AllocaInst *> &NewAllocs) {
-
-  #ifdef _SROA_ZIANG_DEBUG
-  errs() << "replaceU2TypeEqOrNe: [" << *CI << "]\n";
-  #endif
-
-  // if the alloca is used in a comparison instruction with NULL
-  // I can directly infer whether the result is true or false based on the predicate
-  // if the predicate is EQ, then the result is false.
-  // if the predicate is NE, then the result is true.
+// maps the old types of the module to the new ones, in which the fields
+// of the reordered struct types are permuted
+Type *ReorderedTypeMapper::remapType(Type *SrcTy) {
 
-  ConstantInt *ComparisonResult;
+  DenseMap<Type *, Type *>::iterator It = MappedTypes.find(SrcTy);
+  if (It != MappedTypes.end()) {
+    return It->second;
+  }
 
-  CmpInst::Predicate CIPredicate = CI->getPredicate();
-  if (CIPredicate == CmpInst::ICMP_EQ) {
-    ComparisonResult = ConstantInt::getFalse(F.getContext());
-  } else if (CIPredicate == CmpInst::ICMP_NE) {
-    ComparisonResult = ConstantInt::getTrue(F.getContext());
-  } else {
-    assert(false && "CIPredicate isn't ICMP_EQ or ICMP_NE");
-    return;
+  bool ContainsReordered = false;
+  for (const std::pair<StructType *, vector<unsigned>> &Entry : NewFieldIndex) {
+    if (typeContainsStruct(SrcTy, Entry.first, /*ThroughPointers=*/true)) {
+      ContainsReordered = true;
+      break;
+    }
+  }
+  if (!ContainsReordered) {
+    MappedTypes[SrcTy] = SrcTy;
+    return SrcTy;
   }
 
-  // Then, I simply propagate the comparison result
+  // an identified struct may contain itself behind a pointer, so the new
+  // struct is created first and given its fields afterwards. it takes the
+  // name of the old one
+
+  StructType *SrcStructTy = dyn_cast<StructType>(SrcTy);
+  if (SrcStructTy != NULL && !SrcStructTy->isLiteral()) {
+    StructType *NewStructTy = StructType::create(SrcTy->getContext());
+    if (SrcStructTy->hasName()) {
+      string Name = SrcStructTy->getName().str();
+      SrcStructTy->setName(Name + ".old");
+      NewStructTy->setName(Name);
+    }
+    MappedTypes[SrcTy] = NewStructTy;
 
-  CI->replaceAllUsesWith(ComparisonResult);
-}
+    vector<Type *> Fields;
+    for (Type *FieldTy : SrcStructTy->elements()) {
+      Fields.push_back(remapType(FieldTy));
+    }
+    DenseMap<StructType *, vector<unsigned>>::const_iterator IndexIt =
+      NewFieldIndex.find(SrcStructTy);
+    if (IndexIt != NewFieldIndex.end()) {
+      vector<Type *> ReorderedFields(Fields.size());
+      for (unsigned i = 0; i < Fields.size(); ++i) {
+        ReorderedFields[IndexIt->second[i]] = Fields[i];
+      }
+      Fields.swap(ReorderedFields);
+    }
+    NewStructTy->setBody(Fields, SrcStructTy->isPacked());
+    return NewStructTy;
+  }
 
+  vector<Type *> SubTys;
+  for (Type *SubTy : SrcTy->subtypes()) {
+    SubTys.push_back(remapType(SubTy));
+  }
 
-//===----------------------------------------------------------------------===//
-//                extra credit - eliminate small array
-//===----------------------------------------------------------------------===//
-// 
+  Type *NewTy = SrcTy;
+  if (PointerType *PtrTy = dyn_cast<PointerType>(SrcTy)) {
+    NewTy = PointerType::get(SubTys[0], PtrTy->getAddressSpace());
+  } else if (ArrayType *ArrTy = dyn_cast<ArrayType>(SrcTy)) {
+    NewTy = ArrayType::get(SubTys[0], ArrTy->getNumElements());
+  } else if (VectorType *VecTy = dyn_cast<VectorType>(SrcTy)) {
+    NewTy = VectorType::get(SubTys[0], VecTy->getElementCount());
+  } else if (FunctionType *FuncTy = dyn_cast<FunctionType>(SrcTy)) {
+    NewTy = FunctionType::get(SubTys[0], makeArrayRef(SubTys).slice(1),
+                              FuncTy->isVarArg());
+  } else if (SrcStructTy != NULL) {
+    NewTy = StructType::get(SrcTy->getContext(), SubTys, SrcStructTy->isPacked());
+  }
 
-// this file only fulfills the basic requirement
-// for additional work, see ScalarReplAggregates-ziangw2-ec.cpp
+  MappedTypes[SrcTy] = NewTy;
+  return NewTy;
+}
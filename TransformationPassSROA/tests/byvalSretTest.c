@@ -0,0 +1,48 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+// the following tests the interprocedural part of the pass (see the Makefile)
+// structs bigger than two registers are passed byval and returned through
+// an sret pointer. for these static functions, -scalarrepl-args-ziangw2
+// passes the fields as separate parameters and returns the struct as a
+// value, so that -scalarrepl-ziangw2 can break up the structs on both sides
+
+// before my pass: -sccp
+
+struct Vec3 {
+	double x;
+	double y;
+	double z;
+};
+
+static struct Vec3 add(struct Vec3 a, struct Vec3 b) {
+	struct Vec3 r;
+	r.x = a.x + b.x;
+	r.y = a.y + b.y;
+	r.z = a.z + b.z;
+	return r;
+}
+
+static double dot(struct Vec3 a, struct Vec3 b) {
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// the address of the parameter escapes, so it stays byval
+static double first(struct Vec3 a) {
+	double *p = &a.x;
+	return p[0];
+}
+
+int main(int argc, char *argv[]){
+	struct Vec3 u = {argc, 2.0, 3.0};
+	struct Vec3 v = {4.0, 5.0, argc * 6.0};
+
+	struct Vec3 w = add(u, v);
+	for (int i = 0; i < 3; ++i) {
+		w = add(w, u);
+	}
+
+	printf("w: [%f] [%f] [%f]\n", w.x, w.y, w.z);
+	printf("dot: [%f] [%f]\n", dot(w, v), first(w));
+	return 0;
+}
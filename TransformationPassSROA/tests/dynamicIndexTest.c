@@ -0,0 +1,41 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+// the following tests the dynamic-index mode (see the Makefile)
+// a tiny lookup table and the state array of a small state machine are
+// indexed by a variable. in the dynamic-index mode they are still broken
+// up: a read selects among all the elements, a write updates every element
+// with a select, and the elements are then promoted to registers
+
+// before my pass: -sccp
+
+int main(int argc, char *argv[]){
+	// a lookup table read with a runtime index
+	int tbl[4];
+	tbl[0] = 3;
+	tbl[1] = 1;
+	tbl[2] = 4;
+	tbl[3] = argc;
+
+	// the per-state counters of a 3-state machine
+	int counts[3] = {0, 0, 0};
+	int state = 0;
+
+	int sum = 0;
+	for (int i = 0; i < 20; ++i) {
+		sum += tbl[i & 3];
+		counts[state] += 1;
+		state = (state + tbl[(i + state) & 3]) % 3;
+	}
+
+	// an array too big for the mode stays in memory
+	int big[16];
+	for (int i = 0; i < 16; ++i) {
+		big[i] = i * argc;
+	}
+
+	printf("sum: [%d]\n", sum);
+	printf("counts: [%d] [%d] [%d]\n", counts[0], counts[1], counts[2]);
+	printf("big: [%d]\n", big[argc + 3]);
+	return 0;
+}
@@ -0,0 +1,34 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+// the following tests the field-lifetime mode (see the Makefile)
+// the history and the table of a Buffers are too large to be broken up,
+// so both stay in memory after the struct is split. the history is only
+// used in the first loop and the table after it, so their lifetime
+// markers let the backend give them the same stack slot
+
+// before my pass: -sccp
+
+struct Buffers {
+	int history[64];
+	int table[64];
+	int count;
+};
+
+int main(int argc, char *argv[]){
+	struct Buffers b;
+	b.count = 0;
+
+	for (int i = 0; i < 64; ++i) {
+		b.history[3] = i * argc;
+		b.count += b.history[3];
+	}
+
+	if (argc > 0) {
+		b.table[40] = b.count / 2;
+		b.count += b.table[40];
+	}
+
+	printf("Count: [%d]\n", b.count);
+	return 0;
+}
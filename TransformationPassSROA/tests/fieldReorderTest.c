@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+
+// the following tests the field reordering part of the pass (see the
+// Makefile), and is the benchmark for it: make fieldReorderTest-perf
+// the list is walked many times, only reading id and next and bumping
+// hits. these three are spread over three cache lines of a record, the
+// profile moves them to the front, into one cache line
+
+// a Point is also embedded in a Tagged, after its tag. y is its hottest
+// field, but Point must keep its layout: copyHeader copies the tag and x
+// of a Tagged, 16 bytes, which is a multiple of the size of a Point but
+// not of a Tagged. reordering Point would make it copy y instead of x
+
+// before my pass: -sccp
+
+#define NUM_RECORDS (1 << 18)
+#define NUM_WALKS 20
+
+struct Record {
+	long id;
+	char name[56];
+	double balance[8];
+	long hits;
+	struct Record *next;
+};
+
+struct Point {
+	long x;
+	long y;
+};
+
+struct Tagged {
+	long tag;
+	struct Point p;
+};
+
+static void copyHeader(struct Tagged *to, struct Tagged *from) {
+	memcpy(to, from, offsetof(struct Tagged, p) + sizeof(long));
+}
+
+static struct Record *makeList(int n) {
+	struct Record **all = malloc(n * sizeof(struct Record *));
+	for (int i = 0; i < n; ++i) {
+		struct Record *r = malloc(sizeof(struct Record));
+		r->id = i;
+		r->name[0] = 'a' + i % 26;
+		r->balance[0] = i * 0.5;
+		r->hits = 0;
+		all[i] = r;
+	}
+
+	// link the records in a random order, so that the walk is not a
+	// stream the hardware prefetcher can follow
+	unsigned seed = 526;
+	for (int i = n - 1; i > 0; --i) {
+		seed = seed * 1103515245 + 12345;
+		int j = (seed >> 8) % (i + 1);
+		struct Record *tmp = all[i];
+		all[i] = all[j];
+		all[j] = tmp;
+	}
+	for (int i = 0; i < n - 1; ++i) {
+		all[i]->next = all[i + 1];
+	}
+	all[n - 1]->next = NULL;
+
+	struct Record *head = all[0];
+	free(all);
+	return head;
+}
+
+static long walk(struct Record *head) {
+	long sum = 0;
+	for (struct Record *r = head; r != NULL; r = r->next) {
+		r->hits++;
+		sum += r->id;
+	}
+	return sum;
+}
+
+int main(int argc, char *argv[]){
+	struct Record *head = makeList(NUM_RECORDS);
+
+	long sum = 0;
+	for (int i = 0; i < NUM_WALKS; ++i) {
+		sum += walk(head);
+	}
+
+	printf("sum: [%ld] hits: [%ld]\n", sum, head->hits);
+	printf("first: [%c] [%f]\n", head->name[0], head->balance[0]);
+
+	struct Tagged *a = malloc(sizeof(struct Tagged));
+	struct Tagged *b = malloc(sizeof(struct Tagged));
+	a->tag = 100;
+	a->p.x = 80;
+	a->p.y = 1;
+	b->tag = 0;
+	b->p.x = 0;
+	b->p.y = 0;
+	for (int i = 0; i < NUM_WALKS; ++i) {
+		b->p.y += a->p.y;
+	}
+	copyHeader(b, a);
+	printf("tagged: [%ld] [%ld] [%ld]\n", b->tag, b->p.x, b->p.y);
+	free(a);
+	free(b);
+
+	while (head != NULL) {
+		struct Record *next = head->next;
+		free(head);
+		head = next;
+	}
+	return 0;
+}
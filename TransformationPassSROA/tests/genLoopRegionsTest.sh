@@ -0,0 +1,54 @@
+#!/bin/sh
+# generate a function to compare the two promotions on (make <test>-ssa):
+# VARS scalar allocas and REGIONS loop regions, each a diamond. every
+# variable is stored in every region but only read in one region out of
+# VARS, so most of the phis PromoteMemToReg could place are dead
+# usage: sh genLoopRegionsTest.sh 200 400 > loopRegionsTest.ll
+
+VARS=${1:-200}
+REGIONS=${2:-400}
+
+awk -v vars=$VARS -v regions=$REGIONS 'BEGIN {
+	print "define i32 @f(i32 %n) {"
+	print "entry:"
+	for (v = 0; v < vars; ++v) {
+		printf "  %%x%d = alloca i32\n", v
+	}
+	for (v = 0; v < vars; ++v) {
+		printf "  store i32 %d, i32* %%x%d\n", v, v
+	}
+	print "  %acc = alloca i32"
+	print "  store i32 0, i32* %acc"
+	print "  br label %h0"
+	for (r = 0; r < regions; ++r) {
+		printf "h%d:\n", r
+		printf "  %%i%d = load i32, i32* %%acc\n", r
+		printf "  %%c%d = icmp slt i32 %%i%d, %%n\n", r, r
+		printf "  br i1 %%c%d, label %%t%d, label %%e%d\n", r, r, r
+		printf "t%d:\n", r
+		for (v = 0; v < vars; ++v) {
+			printf "  store i32 %d, i32* %%x%d\n", r + v, v
+		}
+		printf "  br label %%j%d\n", r
+		printf "e%d:\n", r
+		for (v = 0; v < vars; v += 2) {
+			printf "  store i32 %d, i32* %%x%d\n", r * v, v
+		}
+		printf "  br label %%j%d\n", r
+		printf "j%d:\n", r
+		printf "  %%u%d = load i32, i32* %%x%d\n", r, r % vars
+		printf "  %%a%d = add i32 %%i%d, %%u%d\n", r, r, r
+		printf "  %%k%d = icmp slt i32 %%a%d, 0\n", r, r
+		printf "  store i32 %%a%d, i32* %%acc\n", r
+		printf "  br i1 %%k%d, label %%h%d, label %%h%d\n", r, r, r + 1
+	}
+	printf "h%d:\n", regions
+	print "  %z = load i32, i32* %acc"
+	print "  ret i32 %z"
+	print "}"
+	print "define i32 @main() {"
+	print "  %r = call i32 @f(i32 100)"
+	print "  %m = and i32 %r, 255"
+	print "  ret i32 %m"
+	print "}"
+}'
@@ -0,0 +1,62 @@
+#!/bin/sh
+# generate a large function to time the pass on: CHAINS chains of DEPTH
+# structs, each holding a pointer to the previous one, like
+# threeLevelStructTest.c but deeper. each level is only broken up once the
+# one above it is promoted, so the pass needs DEPTH iterations. BLOCKS
+# loop regions of two blocks each make the function large
+# usage: sh genNestedChainTest.sh 20000 30 20 > nestedChainTest.ll
+
+BLOCKS=${1:-20000}
+DEPTH=${2:-30}
+CHAINS=${3:-20}
+
+awk -v blocks=$BLOCKS -v depth=$DEPTH -v chains=$CHAINS 'BEGIN {
+	print "%S0 = type { i32, i32 }"
+	for (d = 1; d <= depth; ++d) {
+		printf "%%S%d = type { i32, %%S%d* }\n", d, d - 1
+	}
+	print "define i32 @big(i32 %n) {"
+	print "entry:"
+	for (c = 0; c < chains; ++c) {
+		for (d = 0; d <= depth; ++d) {
+			printf "  %%c%d_%d = alloca %%S%d\n", c, d, d
+		}
+	}
+	for (c = 0; c < chains; ++c) {
+		printf "  %%c%d_0f = getelementptr %%S0, %%S0* %%c%d_0, i32 0, i32 0\n", c, c
+		printf "  store i32 %d, i32* %%c%d_0f\n", c, c
+		for (d = 1; d <= depth; ++d) {
+			printf "  %%c%d_%dp = getelementptr %%S%d, %%S%d* %%c%d_%d, i32 0, i32 1\n", c, d, d, d, c, d
+			printf "  store %%S%d* %%c%d_%d, %%S%d** %%c%d_%dp\n", d - 1, c, d - 1, d - 1, c, d
+		}
+	}
+	print "  %acc0 = alloca i32"
+	print "  store i32 0, i32* %acc0"
+	print "  br label %b0"
+	for (b = 0; b < blocks; ++b) {
+		printf "b%d:\n", b
+		printf "  %%v%d = load i32, i32* %%acc0\n", b
+		printf "  %%w%d = add i32 %%v%d, %d\n", b, b, b
+		printf "  store i32 %%w%d, i32* %%acc0\n", b
+		printf "  %%t%d = icmp slt i32 %%w%d, %%n\n", b, b
+		printf "  br i1 %%t%d, label %%b%d, label %%x%d\n", b, b + 1, b
+		printf "x%d:\n", b
+		printf "  br label %%b%d\n", b + 1
+	}
+	printf "b%d:\n", blocks
+	last = "0"
+	for (c = 0; c < chains; ++c) {
+		p = sprintf("%%c%d_%d", c, depth)
+		for (d = depth; d > 0; --d) {
+			printf "  %%l%d_%dg = getelementptr %%S%d, %%S%d* %s, i32 0, i32 1\n", c, d, d, d, p
+			printf "  %%l%d_%d = load %%S%d*, %%S%d** %%l%d_%dg\n", c, d, d - 1, d - 1, c, d
+			p = sprintf("%%l%d_%d", c, d)
+		}
+		printf "  %%r%dg = getelementptr %%S0, %%S0* %s, i32 0, i32 0\n", c, p
+		printf "  %%r%d = load i32, i32* %%r%dg\n", c, c
+		printf "  %%s%d = add i32 %s, %%r%d\n", c, last, c
+		last = sprintf("%%s%d", c)
+	}
+	printf "  ret i32 %s\n", last
+	print "}"
+}'
@@ -0,0 +1,48 @@
+#!/bin/sh
+# generate a module to time the pass on: FUNCS functions, each clears a
+# struct of FIELDS i32 with a memset and then only touches 4 fields.
+# a field that is never accessed gets no alloca
+# usage: sh genWideStructsTest.sh 500 1000 > wideStructsTest.ll
+
+FUNCS=${1:-500}
+FIELDS=${2:-1000}
+
+awk -v funcs=$FUNCS -v fields=$FIELDS 'BEGIN {
+	print "target datalayout = \"e-m:e-i64:64-f80:128-n8:16:32:64-S128\""
+	type = "%W = type { i32"
+	for (i = 1; i < fields; ++i) {
+		type = type ", i32"
+	}
+	print type " }"
+	print "declare void @llvm.memset.p0i8.i64(i8*, i8, i64, i1)"
+	print "declare i32 @printf(i8*, ...)"
+	print "@fmt = private constant [4 x i8] c\"%d\\0A\\00\""
+	for (f = 0; f < funcs; ++f) {
+		printf "define i32 @f%d(i32 %%a) {\n", f
+		print "  %w = alloca %W"
+		print "  %c = bitcast %W* %w to i8*"
+		printf "  call void @llvm.memset.p0i8.i64(i8* %%c, i8 0, i64 %d, i1 false)\n", 4 * fields
+		for (k = 0; k < 3; ++k) {
+			printf "  %%g%d = getelementptr %%W, %%W* %%w, i32 0, i32 %d\n", k, (f * 7 + k * 31) % fields
+			printf "  store i32 %%a, i32* %%g%d\n", k
+		}
+		print "  %x = load i32, i32* %g0"
+		print "  %y = load i32, i32* %g2"
+		printf "  %%g3 = getelementptr %%W, %%W* %%w, i32 0, i32 %d\n", (f * 13) % fields
+		print "  %z = load i32, i32* %g3"
+		print "  %s = add i32 %x, %y"
+		print "  %t = add i32 %s, %z"
+		print "  ret i32 %t"
+		print "}"
+	}
+	print "define i32 @main() {"
+	print "  %acc0 = add i32 0, 0"
+	for (f = 0; f < funcs; ++f) {
+		printf "  %%r%d = call i32 @f%d(i32 %d)\n", f, f, f
+		printf "  %%acc%d = add i32 %%acc%d, %%r%d\n", f + 1, f, f
+	}
+	print "  %fp = getelementptr [4 x i8], [4 x i8]* @fmt, i32 0, i32 0"
+	printf "  call i32 (i8*, ...) @printf(i8* %%fp, i32 %%acc%d)\n", funcs
+	print "  ret i32 0"
+	print "}"
+}'
@@ -0,0 +1,51 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+// the following tests the global part of the pass (see the Makefile)
+// -scalarrepl-globals-ziangw2 replaces the static structs below by one
+// global per field. the fields of config are never written, so they
+// become constants
+
+// before my pass: -sccp
+
+struct Config {
+	int scale;
+	int offsets[4];
+	double ratio;
+};
+
+struct Stats {
+	int count;
+	long sum;
+	double max;
+};
+
+static struct Config config = {3, {1, 2, 3, 4}, 0.5};
+static struct Stats stats;
+
+// its address escapes, so it stays a struct
+static struct Stats saved;
+
+static void record(int value) {
+	stats.count++;
+	stats.sum += value * config.scale + config.offsets[2];
+	if (value * config.ratio > stats.max) {
+		stats.max = value * config.ratio;
+	}
+}
+
+static void save(struct Stats *to) {
+	to->count = stats.count;
+	to->sum = stats.sum;
+}
+
+int main(int argc, char *argv[]){
+	for (int i = 0; i < 10; ++i) {
+		record(i * argc);
+	}
+	save(&saved);
+
+	printf("stats: [%d] [%ld] [%f]\n", stats.count, stats.sum, stats.max);
+	printf("saved: [%d] [%ld]\n", saved.count, saved.sum);
+	return 0;
+}
@@ -0,0 +1,65 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+// the following tests the heap-to-stack mode (see the Makefile)
+// the malloc in pointSum() and the calloc in the loop are small, freed on
+// every path and their pointers never escape, so they become allocas. the
+// Point is then broken up into registers. the list nodes are stored into
+// each other, so they stay on the heap
+
+// before my pass: -sccp
+
+struct Point {
+	int x;
+	int y;
+	double weight;
+};
+
+struct Node {
+	int value;
+	struct Node *next;
+};
+
+static int pointSum(int a, int b) {
+	struct Point *p = malloc(sizeof(struct Point));
+	if (p == NULL) {
+		return -1;
+	}
+	p->x = a;
+	p->y = b;
+	p->weight = 0.5;
+	int sum = p->x + p->y * (int)(p->weight * 4);
+	free(p);
+	return sum;
+}
+
+int main(int argc, char *argv[]){
+	int total = 0;
+
+	for (int i = 0; i < 10; ++i) {
+		total += pointSum(i, argc);
+
+		// calloc'ed memory is zero, even though the slot is reused
+		int *counts = calloc(4, sizeof(int));
+		counts[i % 4] += i;
+		total += counts[0] + counts[1] + counts[2] + counts[3];
+		free(counts);
+	}
+
+	struct Node *head = NULL;
+	for (int i = 0; i < 4; ++i) {
+		struct Node *node = malloc(sizeof(struct Node));
+		node->value = i * argc;
+		node->next = head;
+		head = node;
+	}
+	while (head != NULL) {
+		struct Node *next = head->next;
+		total += head->value;
+		free(head);
+		head = next;
+	}
+
+	printf("Total: [%d]\n", total);
+	return 0;
+}
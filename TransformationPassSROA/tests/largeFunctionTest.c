@@ -0,0 +1,61 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+// a large synthetic function to time the pass on
+// it has 1024 chains of struct allocas like in threeLevelStructTest.c
+// (4 x CHAIN256), each with an if/else, so over 3000 basic blocks. the
+// pass needs several iterations on one large function to registerize
+// everything
+
+// time it with: make largeFunctionTest-time
+
+// before my pass: -sccp
+
+struct S1 {
+	int a;
+	int b;
+};
+
+struct S2 {
+	int x;
+	struct S1 *s1;
+};
+
+struct S3 {
+	int n;
+	struct S2 *s2;
+};
+
+#define CHAIN(i) { \
+	struct S1 s1; \
+	s1.a = (i); \
+	s1.b = (i) + argc; \
+	struct S2 s2; \
+	s2.x = (i) * 2; \
+	s2.s1 = &s1; \
+	struct S3 s3; \
+	s3.n = (i) % 7; \
+	s3.s2 = &s2; \
+	if (sum % 3 != s3.n % 3) { \
+		sum += s3.s2->s1->a + s3.s2->s1->b; \
+	} else { \
+		sum -= s3.s2->x + s3.n; \
+	} \
+}
+
+#define CHAIN4(i) CHAIN(4 * (i)) CHAIN(4 * (i) + 1) CHAIN(4 * (i) + 2) CHAIN(4 * (i) + 3)
+#define CHAIN16(i) CHAIN4(4 * (i)) CHAIN4(4 * (i) + 1) CHAIN4(4 * (i) + 2) CHAIN4(4 * (i) + 3)
+#define CHAIN64(i) CHAIN16(4 * (i)) CHAIN16(4 * (i) + 1) CHAIN16(4 * (i) + 2) CHAIN16(4 * (i) + 3)
+#define CHAIN256(i) CHAIN64(4 * (i)) CHAIN64(4 * (i) + 1) CHAIN64(4 * (i) + 2) CHAIN64(4 * (i) + 3)
+
+int main(int argc, char *argv[]){
+	int sum = 0;
+
+	CHAIN256(0)
+	CHAIN256(1)
+	CHAIN256(2)
+	CHAIN256(3)
+
+	printf("Sum: [%d]\n", sum);
+	return 0;
+}
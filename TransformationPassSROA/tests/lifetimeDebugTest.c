@@ -0,0 +1,46 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+// the following tests structs compiled the way clang does above -O0
+// (see the Makefile): every local struct is wrapped in
+// llvm.lifetime.start/end through an i8* bitcast and, with -g, described
+// by an llvm.dbg.declare. these uses must not keep a struct alive: the
+// lifetime markers are copied to every field, the llvm.dbg.declare is
+// split into one fragment per field, and a pointer to the leading
+// field taken through a bitcast is the field alloca itself
+
+// before my pass: -sccp
+
+struct Point {
+	int x;
+	int y;
+};
+
+struct Rect {
+	struct Point lo;
+	double area;
+};
+
+int main(int argc, char *argv[]){
+	struct Rect r;
+	r.lo.x = argc;
+	r.lo.y = argc + 1;
+	r.area = 2.5;
+
+	// a pointer to the leading field is a bitcast of the struct
+	int *first = (int *) &r;
+	*first += 10;
+
+	// a struct whose lifetime ends in a nested scope
+	int sum = 0;
+	for (int i = 0; i < 3; ++i) {
+		struct Point p;
+		p.x = i;
+		p.y = r.lo.x;
+		sum += p.x + p.y;
+	}
+
+	printf("r: [%d] [%d] [%f]\n", r.lo.x, r.lo.y, r.area);
+	printf("sum: [%d]\n", sum);
+	return 0;
+}
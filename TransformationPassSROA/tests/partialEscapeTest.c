@@ -0,0 +1,50 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+// the following tests the partial-escape mode (see the Makefile)
+// the address of the struct is passed to helpers that don't keep it.
+// the struct is still broken up, the arithmetic on its fields is done
+// in registers and every call gets a temporary copy of the struct. the
+// fields are loaded back only after the call that may modify them
+
+// before my pass: -sccp -mem2reg -function-attrs
+
+struct Vec {
+	int x;
+	int y;
+	struct {
+		int w;
+		float f;
+	} extra;
+};
+
+int length2(const struct Vec *v) {
+	return v->x * v->x + v->y * v->y + v->extra.w;
+}
+
+void scale(struct Vec *v, int k) {
+	v->x *= k;
+	v->y *= k;
+	v->extra.f *= k;
+}
+
+int main(int argc, char *argv[]){
+	struct Vec v;
+	v.x = argc;
+	v.y = argc + 1;
+	v.extra.w = 3;
+	v.extra.f = 0.5;
+
+	int total = 0;
+	for (int i = 0; i < 4; ++i) {
+		v.x += i;
+		total += length2(&v);
+	}
+
+	scale(&v, 2);
+	v.y += 1;
+
+	printf("v: [%d] [%d] [%d] [%f]\n", v.x, v.y, v.extra.w, v.extra.f);
+	printf("total: [%d] [%d]\n", total, length2(&v));
+	return 0;
+}
@@ -0,0 +1,34 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+// the following tests the partial-promotion mode (see the Makefile)
+// the address of sum is passed to logValue() every 256 iterations and to
+// addBonus() after the loop, so sum can't be promoted. in the
+// partial-promotion mode it stays in a register in the loop, and is only
+// stored before and loaded back after the calls
+
+// before my pass: -sccp -mem2reg -function-attrs
+
+static void logValue(const char *name, const int *value) {
+	printf("%s: [%d]\n", name, *value);
+}
+
+static void addBonus(int *value) {
+	*value += 1000;
+}
+
+int main(int argc, char *argv[]){
+	int sum = 0;
+
+	for (int i = 0; i < 4096; ++i) {
+		sum += i * argc;
+		if (i % 256 == 0) {
+			logValue("sum", &sum);
+		}
+	}
+
+	addBonus(&sum);
+
+	printf("Sum: [%d]\n", sum);
+	return 0;
+}
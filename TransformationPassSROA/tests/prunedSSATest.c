@@ -0,0 +1,49 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+// the following tests the pruned-SSA mode (see the Makefile)
+// a loop over a chain of stages, each stage writes all the temporaries on
+// one branch and only half of them on the other, but reads just one. a
+// temporary is live in few blocks, so pruning by liveness leaves out most
+// of the phis a minimal SSA form would place at the joins
+
+// compare the phis and the time of both promotions with: make prunedSSATest-ssa
+
+// before my pass: -sccp
+
+#define STAGE(i) { \
+	if ((acc + (i)) % 3 != 0) { \
+		t0 = acc + (i); t1 = acc - (i); t2 = acc ^ (i); t3 = acc * (i); \
+		t4 = (i) - acc; t5 = acc | (i); t6 = acc & (i); t7 = acc << 1; \
+	} else { \
+		t0 = (i); t2 = (i) * 2; t4 = (i) * 4; t6 = (i) * 6; \
+	} \
+	switch ((i) % 8) { \
+	case 0: acc += t0; break; \
+	case 1: acc += t1; break; \
+	case 2: acc += t2; break; \
+	case 3: acc += t3; break; \
+	case 4: acc += t4; break; \
+	case 5: acc += t5; break; \
+	case 6: acc += t6; break; \
+	default: acc += t7; break; \
+	} \
+	acc %= 100003; \
+}
+
+#define STAGE4(i) STAGE(4 * (i)) STAGE(4 * (i) + 1) STAGE(4 * (i) + 2) STAGE(4 * (i) + 3)
+#define STAGE16(i) STAGE4(4 * (i)) STAGE4(4 * (i) + 1) STAGE4(4 * (i) + 2) STAGE4(4 * (i) + 3)
+#define STAGE64(i) STAGE16(4 * (i)) STAGE16(4 * (i) + 1) STAGE16(4 * (i) + 2) STAGE16(4 * (i) + 3)
+
+int main(int argc, char *argv[]){
+	int acc = argc;
+	int t0 = 0, t1 = 0, t2 = 0, t3 = 0, t4 = 0, t5 = 0, t6 = 0, t7 = 0;
+
+	for (int round = 0; round < 1000; ++round) {
+		STAGE64(0)
+		STAGE64(1)
+	}
+
+	printf("Acc: [%d]\n", acc);
+	return 0;
+}
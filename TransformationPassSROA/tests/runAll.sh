@@ -12,8 +12,8 @@ run_test()
 	make
 }
 
-for entry in $PWD/*Test.c
+for entry in $PWD/*Test.c $PWD/*Test.ll.in
 do
-	testName=$(basename $entry .c)
+	testName=$(basename $(basename $entry .c) .ll.in)
 	run_test $testName
 done
\ No newline at end of file
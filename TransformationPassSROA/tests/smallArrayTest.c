@@ -0,0 +1,51 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+// the following tests small constant-size arrays
+// every element is accessed with a constant index, so the arrays
+// are broken up into one alloca per element and then promoted
+// arrays nested in structs and structs nested in arrays are also
+// broken up, one level per iteration
+
+// before my pass: -sccp
+
+struct Vec {
+	float v[4];
+	int len;
+};
+
+struct Pair {
+	int a;
+	int b;
+};
+
+int main(int argc, char *argv[]){
+	// a plain array
+	float v[4];
+	v[0] = 1.0;
+	v[1] = 2.0;
+	v[2] = 3.0;
+	v[3] = v[0] + v[1] + v[2];
+
+	// an array of ints
+	int idx[8];
+	idx[0] = 7;
+	idx[7] = idx[0] * 2;
+
+	// an array nested in a struct
+	struct Vec w;
+	w.len = 4;
+	w.v[0] = v[3];
+	w.v[3] = 0.5;
+
+	// structs nested in an array
+	struct Pair pairs[3];
+	pairs[0].a = 1;
+	pairs[2].b = pairs[0].a + idx[7];
+
+	printf("v: [%f] [%f]\n", v[0], v[3]);
+	printf("idx: [%d] [%d]\n", idx[0], idx[7]);
+	printf("w: [%d] [%f] [%f]\n", w.len, w.v[0], w.v[3]);
+	printf("pairs: [%d] [%d]\n", pairs[0].a, pairs[2].b);
+	return 0;
+}
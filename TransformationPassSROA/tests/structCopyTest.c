@@ -0,0 +1,49 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// the following tests struct copies and zero-initialization
+// clang emits llvm.memcpy for a struct assignment and llvm.memset for
+// a zero-initialized struct. these are U3 type uses: they are split
+// into per-field loads/stores (or a smaller memcpy/memset of a nested
+// struct, which is split again in the next round)
+
+// before my pass: -sccp
+
+struct In {
+	int a;
+	float b;
+};
+
+struct S {
+	int x;
+	struct In in;
+	short arr[2];
+};
+
+struct S global = {5, {6, 7.0}, {8, 9}};
+
+int main(int argc, char *argv[]){
+	// zero-initialized with memset
+	struct S s1 = {0};
+	s1.x = argc;
+
+	// copy between two candidate allocas
+	struct S s2 = s1;
+
+	// copy from a global that stays in memory
+	struct S s3;
+	s3 = global;
+
+	// copy of a nested struct
+	s2.in = s3.in;
+
+	// an explicit memset with a non-zero byte
+	struct In s4;
+	memset(&s4, 1, sizeof(s4));
+
+	printf("s2: [%d] [%d] [%f] [%d]\n", s2.x, s2.in.a, s2.in.b, s2.arr[1]);
+	printf("s3: [%d] [%d]\n", s3.x, s3.arr[1]);
+	printf("s4: [%d]\n", s4.a);
+	return 0;
+}
@@ -0,0 +1,52 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+// the following tests the struct-of-arrays mode (see the Makefile)
+// pts is too big to be broken up and is indexed by a variable. in the
+// struct-of-arrays mode it becomes one array per field, so the loops over
+// a single field walk a float array with unit stride
+
+// before my pass: -sccp
+
+#define NUM_POINTS 64
+
+struct Point {
+	float x;
+	float y;
+	float z;
+};
+
+// its address escapes, so it stays an array of structs
+static float sumX(struct Point *ps, int n) {
+	float sum = 0;
+	for (int i = 0; i < n; ++i) {
+		sum += ps[i].x;
+	}
+	return sum;
+}
+
+int main(int argc, char *argv[]){
+	struct Point pts[NUM_POINTS] = {0};
+	for (int i = 0; i < NUM_POINTS; i += 2) {
+		pts[i].x = i * argc;
+		pts[i].y = i * 0.5f;
+	}
+
+	float sumx = 0;
+	float sumy = 0;
+	for (int i = 0; i < NUM_POINTS; ++i) {
+		sumx += pts[i].x;
+	}
+	for (int i = 0; i < NUM_POINTS; ++i) {
+		sumy += pts[i].y;
+	}
+
+	struct Point escaped[4];
+	for (int i = 0; i < 4; ++i) {
+		escaped[i].x = pts[i * 2].x;
+	}
+
+	printf("sums: [%f] [%f] [%f]\n", sumx, sumy, pts[7].z);
+	printf("escaped: [%f]\n", sumX(escaped, 4));
+	return 0;
+}
@@ -0,0 +1,48 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+// the following tests the vector-promotion mode
+// (-scalarrepl-ziangw2-vectorize, turned on for this test in the Makefile)
+// an aggregate whose elements all have the same int/fp type and which
+// fits in a vector register becomes one vector alloca, which is then
+// promoted to a vector virtual register
+
+// before my pass: -sccp
+
+struct Vec4 {
+	float x;
+	float y;
+	float z;
+	float w;
+};
+
+int main(int argc, char *argv[]){
+	// becomes a <4 x float>
+	struct Vec4 p;
+	p.x = 1.0;
+	p.y = 2.0;
+	p.z = 3.0;
+	p.w = 1.0;
+
+	// becomes a <4 x int>
+	int acc[4];
+	acc[0] = 0;
+	acc[1] = 0;
+	acc[2] = argc;
+	acc[3] = 0;
+
+	for (int i = 0; i < 10; i++) {
+		p.x = p.x + p.w;
+		p.y = p.y * 2.0;
+		acc[0] = acc[0] + i;
+		acc[3] = acc[3] + acc[2];
+	}
+
+	// too large for a vector register, broken up into scalars instead
+	int big[32];
+	big[31] = acc[0] + acc[3];
+
+	printf("p: [%f] [%f] [%f] [%f]\n", p.x, p.y, p.z, p.w);
+	printf("acc: [%d] [%d] [%d]\n", acc[0], acc[3], big[31]);
+	return 0;
+}
@@ -0,0 +1,43 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+// a wide struct, like a generated message type with hundreds of fields,
+// of which every function only touches a handful. the fields that are
+// never read get no alloca at all: the zero-initialization (a memset)
+// writes only the fields that are accessed later
+
+// time it with: make wideStructTest-time
+
+// before my pass: -sccp
+
+#define FIELD(i) int f##i;
+#define FIELD4(i) FIELD(i##0) FIELD(i##1) FIELD(i##2) FIELD(i##3)
+#define FIELD16(i) FIELD4(i##0) FIELD4(i##1) FIELD4(i##2) FIELD4(i##3)
+#define FIELD64(i) FIELD16(i##0) FIELD16(i##1) FIELD16(i##2) FIELD16(i##3)
+#define FIELD256(i) FIELD64(i##0) FIELD64(i##1) FIELD64(i##2) FIELD64(i##3)
+
+// 512 int fields named f<base-4 digits>, e.g. f00000 ... f13333
+
+struct Wide {
+	FIELD256(0)
+	FIELD256(1)
+};
+
+#define USE(name, a, b, c) \
+int name(int n) { \
+	struct Wide w = {0}; \
+	w.a = n; \
+	w.b = n * 2; \
+	return w.a + w.b + w.c; \
+}
+
+USE(use0, f00000, f01230, f13333)
+USE(use1, f00001, f10000, f02222)
+USE(use2, f03333, f00123, f11111)
+USE(use3, f12301, f03210, f00000)
+
+int main(int argc, char *argv[]){
+	int sum = use0(argc) + use1(argc + 1) + use2(argc + 2) + use3(argc + 3);
+	printf("sum: [%d]\n", sum);
+	return 0;
+}